@@ -0,0 +1,112 @@
+/**
+ * This file contains the following function definitions for the batch mode:
+ * - RunBatch
+ *
+ * The batch mode loads the chipload table once, reads a list of jobs and solves them in parallel,
+ * then writes the results to the output file in the same order as the jobs were read.
+ */
+
+// Include headers & libraries
+#include <algorithm>    // for std::max
+#include <chrono>       // for timing the run
+#include <cstdio>       // for standard input/output operations
+#include <string>       // for std::string
+#include <vector>       // for std::vector
+#include "chipload.h"   // for external user defined functions
+
+/**
+ * Function: solves every job in a jobs file and writes the results to the output file.
+ *
+ * Parameters:
+ * @param file_chipload: The chipload table .csv file.
+ * @param file_jobs: The jobs file (see ReadJobsFromFile).
+ * @param file_output: The file the results, errors and warnings are written to (text, or CSV / JSON lines by extension).
+ *
+ * Returns:
+ * @return 0 if every job was solved, otherwise the first error code found (1, 2 or 3 if the run couldn't start).
+ */
+int RunBatch(const std::string &file_chipload, const std::string &file_jobs, const std::string &file_output) {
+    auto start = std::chrono::steady_clock::now();
+    Report report;
+    OpenReport(report, file_output);
+
+    if (!Load(file_chipload)) {
+        ErrorMessage(report, 1);
+        printf("Failed to Load materials\n");
+        return 1;
+    }
+
+    std::vector<std::string> unique_materials;
+    unsigned int unique_materials_count = 0;
+    if (!UniqueElements(unique_materials, &unique_materials_count)) {
+        ErrorMessage(report, 2);
+        printf("Memory allocation for unique materials has failed\n");
+        Unload();
+        return 2;
+    }
+
+    FuzzyIndex material_index;
+    BuildFuzzyIndex(unique_materials, material_index);
+
+    std::vector<Job> jobs;
+    if (!ReadJobsFromFile(file_jobs, jobs)) {
+        ErrorMessage(report, 3);
+        printf("Failed to read from file.\n");
+        Unload();
+        return 3;
+    }
+
+    // Solve, each job only writes its own result slot
+    std::vector<JobResult> results(jobs.size());
+    ParallelFor(jobs.size(), [&](size_t i) {
+        SolveJob(jobs[i], material_index, machine, results[i]);
+    });
+    ConvertResultFeedRates(results); // the report's feedrates, a column per output unit
+    auto solved = std::chrono::steady_clock::now();
+
+    // Write, in input order
+    int first_error = 0;
+    size_t failed = 0;
+    for (size_t i = 0; i < jobs.size(); i++) {
+        const JobResult &result = results[i];
+        report.job = i + 1;
+        for (int warning : result.warnings) {
+            WarningMessage(report, warning);
+        }
+        if (result.error != 0) {
+            if (result.error == 14) {
+                WarningMessage(report, result.error);
+            } else {
+                ErrorMessage(report, result.error);
+            }
+            if (first_error == 0) first_error = result.error;
+            failed++;
+            continue;
+        }
+        if (!WriteResultsToFile(report, result.material, result.tool_diameter, result.tool_unit, result.tool_teeth, result.speed, result.feeds, result.feed_rate, result.out_unit, DescribeLimits(result), unique_materials, jobs[i].checklist, jobs[i].supported_materials_list)) {
+            printf("Couldn't write results to file\n");
+            Unload();
+            return 15;
+        }
+        WriteSuggestions(report, jobs[i].material, result, unique_materials);
+    }
+    if (!CloseReport(report)) {
+        printf("Couldn't write results to file\n");
+        Unload();
+        return 15;
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    Unload();
+
+    double solve_seconds = std::chrono::duration<double>(solved - start).count();
+    double total_seconds = std::chrono::duration<double>(end - start).count();
+    printf("Solved %zu jobs (%zu failed) in %.3f s, %.0f jobs/s (%.0f jobs/s including writing)\n",
+           jobs.size(), failed, solve_seconds, jobs.size() / std::max(solve_seconds, 1e-9), jobs.size() / std::max(total_seconds, 1e-9));
+    uint64_t hits, misses;
+    ResultCacheStats(hits, misses);
+    printf("Result cache: %llu hits, %llu misses (%.1f%% hit rate)\n", (unsigned long long)hits, (unsigned long long)misses,
+           100.0 * hits / std::max<uint64_t>(hits + misses, 1));
+
+    return first_error;
+}
@@ -0,0 +1,311 @@
+/**
+ * This is the benchmark suite of the CHIPLOAD CALCULATOR, built and run with:
+ *
+ *     make bench [BENCH_ROWS=100000] [BENCH_WORDS=50000]
+ *
+ * It times the hot functions one at a time over a synthetic catalog of BENCH_ROWS rows and a synthetic
+ * dictionary of BENCH_WORDS materials, then an end-to-end scenario doing what main does for one job.
+ * Results are printed as JSON on stdout: for each benchmark the mean ns/op, the heap allocations/op
+ * and the p50/p90/p99/max latency. Fast functions are timed in batches, so the percentiles are over
+ * the per-op mean of each batch (batch_ops tells how many calls a batch holds).
+ */
+
+// Include headers & libraries
+#include <algorithm>    // for std::sort
+#include <atomic>       // for the allocation counter
+#include <chrono>       // for timing
+#include <cstdio>       // for standard input/output operations
+#include <cstdlib>      // for malloc, free and getenv
+#include <functional>   // for std::function
+#include <new>          // for replacing operator new
+#include <random>       // for the synthetic data
+#include <string>       // for std::string
+#include <vector>       // for std::vector
+#include <unistd.h>     // for unlink
+#include "chipload.h"   // for external user defined functions
+
+// Heap allocations, counted by the replacement operator new
+static std::atomic<unsigned long> allocations{0};
+
+void *operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+
+// Keeps results alive so the compiler can't drop the calls being timed
+static volatile long sink;
+
+// Represents the timing of one benchmark
+struct BenchResult {
+    std::string name;
+    size_t ops;
+    size_t batch_ops;
+    double ns_per_op;
+    double allocations_per_op;
+    double p50, p90, p99, max;
+};
+
+static std::vector<BenchResult> results;
+
+/**
+ * Function: times a benchmark, samples batches of batch_ops calls.
+ *
+ * Parameters:
+ * @param name: The name of the benchmark in the JSON output.
+ * @param samples: The number of batches.
+ * @param batch_ops: The number of calls per batch.
+ * @param op: The operation, called with the index of the call.
+ */
+static void Bench(const std::string &name, size_t samples, size_t batch_ops, const std::function<void(size_t)> &op) {
+    // Warm up
+    for (size_t i = 0; i < std::min<size_t>(batch_ops, 100); i++) op(i);
+
+    std::vector<double> per_op(samples);
+    unsigned long allocations_before = allocations.load();
+    auto start = std::chrono::steady_clock::now();
+    size_t call = 0;
+    for (size_t s = 0; s < samples; s++) {
+        auto batch_start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < batch_ops; i++) op(call++);
+        auto batch_end = std::chrono::steady_clock::now();
+        per_op[s] = std::chrono::duration<double, std::nano>(batch_end - batch_start).count() / batch_ops;
+    }
+    double total = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    unsigned long allocated = allocations.load() - allocations_before;
+
+    std::sort(per_op.begin(), per_op.end());
+    auto percentile = [&](double p) { return per_op[std::min(per_op.size() - 1, (size_t)(p * per_op.size()))]; };
+    results.push_back({name, call, batch_ops, total / call, (double)allocated / call,
+                       percentile(0.50), percentile(0.90), percentile(0.99), per_op.back()});
+    fprintf(stderr, "%-28s %12.1f ns/op %8.2f allocs/op\n", name.c_str(), total / call, (double)allocated / call);
+}
+
+/**
+ * Function: reads a size from the environment.
+ */
+static size_t EnvSize(const char *name, size_t fallback) {
+    const char *value = getenv(name);
+    return value ? strtoul(value, nullptr, 10) : fallback;
+}
+
+/**
+ * Function: makes a material name like the ones of merged vendor catalogs, ex.: "Aluminium 6061-T3 V07".
+ */
+static std::string SyntheticMaterial(size_t i) {
+    static const char *families[] = {"Aluminium", "Steel", "Stainless", "Brass", "Copper", "Titanium", "Acrylic",
+                                     "Polycarbonate", "Delrin", "Nylon", "MDF", "Plywood", "Oak", "Pine", "Walnut",
+                                     "Maple", "Birch", "Cherry", "HDPE", "PVC"};
+    char name[64];
+    snprintf(name, sizeof(name), "%s %zu-T%zu V%02zu", families[i % 20], 1000 + (i / 20) % 500 * 7, i / 10000 % 9, i / 20 / 500 % 100);
+    return name;
+}
+
+int main(void) {
+    size_t n_rows = EnvSize("BENCH_ROWS", 100000);
+    size_t n_words = EnvSize("BENCH_WORDS", 50000);
+    const std::string catalog = "/tmp/chipload_bench_catalog.csv";
+    const std::string input = "/tmp/chipload_bench_input.txt";
+    const std::string output = "/tmp/chipload_bench_output.txt";
+    std::mt19937 random(42);
+
+    // Synthetic catalog, n_rows rows spread over n_rows / 5 materials
+    size_t n_materials = std::max<size_t>(1, n_rows / 5);
+    FILE *file = fopen(catalog.c_str(), "w");
+    if (!file) return 1;
+    fprintf(file, "Material, Tool(diam_metric), Chipload(metric), Rpmfactor(optional)\n");
+    for (size_t i = 0; i < n_rows; i++) {
+        fprintf(file, "%s, %zu, %.3f, 1\n", SyntheticMaterial(i % n_materials).c_str(), 2 + i / n_materials, 0.01 + (i % 97) / 1000.0);
+    }
+    fclose(file);
+
+    // Synthetic dictionary and queries with one or two typos
+    std::vector<std::string> dictionary;
+    for (size_t i = 0; i < n_words; i++) dictionary.push_back(SyntheticMaterial(i));
+    std::vector<std::string> queries;
+    for (size_t i = 0; i < 256; i++) {
+        std::string query = dictionary[random() % dictionary.size()];
+        query[random() % query.size()] = 'x';
+        if (i % 2) query.erase(random() % query.size(), 1);
+        queries.push_back(query);
+    }
+
+    // Input file like SpeedNFeeds.txt
+    file = fopen(input.c_str(), "w");
+    if (!file) return 1;
+    fprintf(file, "I'm a beginner: No\nMaterial to cut: %s\nTool Diameter: 3 mm\nTool Flutes: 2\nJob Quality: 4\n"
+                  "I want to get the FeedRate in: mm/m\nPrint a generic CNC CHECKLIST for the job: No\nPrint a LIST of supported materials: No\n",
+            SyntheticMaterial(1).c_str());
+    fclose(file);
+
+    // Load, cold (parse the .csv) and from the snapshot
+    Bench("Load", 5, 1, [&](size_t) {
+        unlink((catalog + ".snapshot").c_str());
+        sink = Load(catalog);
+    });
+    Bench("Load/snapshot", 20, 1, [&](size_t) { sink = Load(catalog); });
+
+    std::vector<std::pair<std::string, float>> lookups;
+    for (size_t i = 0; i < 1024; i++) lookups.emplace_back(SyntheticMaterial(random() % n_materials), 2 + random() % 5);
+    Bench("Search", 1000, 1000, [&](size_t i) {
+        float chipload, rpm_factor;
+        sink = Search(lookups[i % lookups.size()].first, lookups[i % lookups.size()].second, chipload, rpm_factor);
+    });
+
+    // A tool crib of sizes between and outside the catalog rows, looked up at once
+    std::vector<float> sizes(1024), chiploads(sizes.size()), rpm_factors(sizes.size());
+    std::vector<DiameterMatch> matches(sizes.size());
+    for (size_t i = 0; i < sizes.size(); i++) sizes[i] = 1 + i * (n_rows / n_materials + 2.0f) / sizes.size();
+    Bench("SearchDiameters/1024", 200, 1, [&](size_t i) {
+        sink = SearchDiameters(lookups[i % lookups.size()].first, sizes.data(), sizes.size(), chiploads.data(), rpm_factors.data(), matches.data());
+    });
+
+    std::vector<std::string> unique_materials;
+    unsigned int unique_materials_count = 0;
+    Bench("UniqueElements", 20, 1, [&](size_t) { sink = UniqueElements(unique_materials, &unique_materials_count); });
+
+    Bench("LevenshteinDistance", 1000, 1000, [&](size_t i) {
+        sink = LevenshteinDistance(queries[i % queries.size()], dictionary[i % dictionary.size()]);
+    });
+    Bench("LevenshteinDistance/bounded", 1000, 1000, [&](size_t i) {
+        sink = LevenshteinDistance(queries[i % queries.size()], dictionary[i % dictionary.size()], MAX_MATERIAL_DISTANCE);
+    });
+    Bench("BestMatch", 50, 1, [&](size_t i) {
+        sink = BestMatch(queries[i % queries.size()], dictionary, MAX_MATERIAL_DISTANCE);
+    });
+    FuzzyIndex index;
+    Bench("BuildFuzzyIndex", 3, 1, [&](size_t) { BuildFuzzyIndex(dictionary, index); });
+    Bench("FuzzyMatches", 200, 1, [&](size_t i) {
+        sink = FuzzyMatches(index, queries[i % queries.size()], MAX_MATERIAL_DISTANCE, N_SUGGESTIONS).size();
+    });
+
+    const char *numbers[] = {"1/4 inches", "3.175mm", "6 mm", "0.5in", "1 1/4 in"};
+    Bench("CleanNumber", 1000, 1000, [&](size_t i) { sink = CleanNumber(numbers[i % 5]); });
+
+    Bench("Convert", 1000, 1000, [&](size_t i) {
+        sink = Convert(FeedRate{(float)i, (FeedUnit)(i % N_FEED_UNITS)}, (FeedUnit)(i / N_FEED_UNITS % N_FEED_UNITS)).value;
+    });
+    std::vector<float> column(1 << 16, 1700.0f), converted(column.size());
+    Bench("ConvertFeedRates/65536", 100, 1, [&](size_t i) {
+        ConvertFeedRates(column.data(), converted.data(), column.size(), UNIT_MM_M, (FeedUnit)(i % N_FEED_UNITS));
+        sink = converted[0];
+    });
+    Bench("ParseFeedUnit", 1000, 1000, [&](size_t i) {
+        FeedUnit unit;
+        sink = ParseFeedUnit(feed_unit_names[i % feed_unit_names.size()], unit);
+    });
+
+    Bench("Simplex", 1000, 1000, [&](size_t i) {
+        Point optimum;
+        float chipload = 0.02 + (i % 100) / 1000.0;
+        sink = Simplex(machine, chipload + MAXDEV, chipload - MAXDEV, 0, i % 2, optimum);
+    });
+    grid_simplex = true;
+    Bench("Simplex/grid", 100, 10, [&](size_t i) {
+        Point optimum;
+        float chipload = 0.02 + (i % 100) / 1000.0;
+        sink = Simplex(machine, chipload + MAXDEV, chipload - MAXDEV, 0, i % 2, optimum);
+    });
+    grid_simplex = false;
+    Bench("Midpoint", 1000, 1000, [&](size_t i) {
+        sink = Midpoint(machine, 0.02 + (i % 100) / 1000.0).y;
+    });
+
+    std::vector<float> upper(MAP_COLUMNS), lower(MAP_COLUMNS);
+    std::vector<unsigned char> cells(MAP_COLUMNS);
+    for (int i = 0; i < MAP_COLUMNS; i++) {
+        upper[i] = 0.15f * (CNCMINSPEED + i * 14);
+        lower[i] = 0.05f * (CNCMINSPEED + i * 14);
+    }
+    Bench("ClassifyRow/1000", 1000, 100, [&](size_t i) {
+        ClassifyRow(i % CNCMAXFEED, upper.data(), lower.data(), MAP_COLUMNS, CNCMAXFEED, cells.data());
+        sink = cells[i % MAP_COLUMNS];
+    });
+
+    std::vector<float> stepovers(4096), depths(stepovers.size()), thinning(stepovers.size()), effective(stepovers.size());
+    for (size_t i = 0; i < stepovers.size(); i++) {
+        stepovers[i] = 0.3f + (i % 64) * 0.1f;
+        depths[i] = 0.2f + (i / 64) * 0.05f;
+    }
+    Bench("EngagementFactors/4096", 1000, 10, [&](size_t i) {
+        EngagementFactors(6.35f, i % 2, stepovers.data(), depths.data(), stepovers.size(), thinning.data(), effective.data());
+        sink = thinning[i % thinning.size()];
+    });
+
+    std::vector<std::string> few_materials(dictionary.begin(), dictionary.begin() + std::min<size_t>(20, dictionary.size()));
+    unlink(output.c_str());
+    Report report;
+    OpenReport(report, output);
+    Bench("WriteResultsToFile", 100, 10, [&](size_t i) {
+        sink = WriteResultsToFile(report, "Aluminium", 3, "mm", 2, 3, {17000, 1700}, 1700, "mm/m", "max rpm", few_materials, i % 2, i % 3 == 0);
+    });
+
+    CloseReport(report);
+
+    // End to end, what main does for one job (the table loads from its snapshot)
+    unlink(output.c_str());
+    Bench("EndToEnd", 20, 1, [&](size_t) {
+        Job job;
+        JobResult result;
+        std::vector<std::string> materials;
+        unsigned int count = 0;
+        FuzzyIndex material_index;
+        Report report;
+        OpenReport(report, output);
+        Load(catalog);
+        UniqueElements(materials, &count);
+        BuildFuzzyIndex(materials, material_index);
+        ReadFromFile(input, job);
+        if (SolveJob(job, material_index, machine, result) == 0) {
+            WriteResultsToFile(report, result.material, result.tool_diameter, result.tool_unit, result.tool_teeth, result.speed, result.feeds, result.feed_rate, result.out_unit, DescribeLimits(result), materials, job.checklist, job.supported_materials_list);
+        }
+        Unload();
+    });
+
+    // One job after another on a loaded table, the batch and daemon path (normalization shouldn't allocate)
+    Load(catalog);
+    std::vector<std::string> materials;
+    unsigned int materials_count = 0;
+    UniqueElements(materials, &materials_count);
+    FuzzyIndex material_index;
+    BuildFuzzyIndex(materials, material_index);
+    std::vector<Job> jobs(256);
+    for (size_t i = 0; i < jobs.size(); i++) {
+        jobs[i].material = materials[random() % materials.size()];
+        jobs[i].tool = i % 2 ? "1 1/4 in" : "6.35 mm";
+        jobs[i].tool_teeth = "2";
+        jobs[i].job_quality = std::to_string(1 + i % 5);
+        jobs[i].out_unit = "mm/m";
+    }
+    Bench("SolveJob", 1000, 100, [&](size_t i) {
+        JobResult result;
+        sink = SolveJob(jobs[i % jobs.size()], material_index, machine, result);
+    });
+    JobResult pareto_job;
+    SolveJob(jobs[0], material_index, machine, pareto_job);
+    std::vector<ParetoPoint> front;
+    Bench("ParetoFront/1024", 100, 1, [&](size_t) { sink = ParetoFront(pareto_job, machine, PARETO_SAMPLES, front); });
+    Unload();
+
+    // JSON report
+    printf("{\n  \"rows\": %zu,\n  \"words\": %zu,\n  \"benchmarks\": [\n", n_rows, n_words);
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult &r = results[i];
+        printf("    {\"name\": \"%s\", \"ops\": %zu, \"batch_ops\": %zu, \"ns_per_op\": %.1f, \"allocations_per_op\": %.3f, "
+               "\"p50_ns\": %.1f, \"p90_ns\": %.1f, \"p99_ns\": %.1f, \"max_ns\": %.1f}%s\n",
+               r.name.c_str(), r.ops, r.batch_ops, r.ns_per_op, r.allocations_per_op, r.p50, r.p90, r.p99, r.max,
+               i + 1 < results.size() ? "," : "");
+    }
+    printf("  ]\n}\n");
+
+    unlink(catalog.c_str());
+    unlink((catalog + ".snapshot").c_str());
+    unlink(input.c_str());
+    unlink(output.c_str());
+    return 0;
+}
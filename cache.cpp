@@ -0,0 +1,231 @@
+/**
+ * This file contains the following function definitions for the result cache:
+ * - MakeCacheKey
+ * - LookupResult
+ * - StoreResult
+ * - LoadResultCache
+ * - SaveResultCache
+ * - ResultCacheStats
+ *
+ * Most jobs repeat the same few materials, diameters and flutes. Once a job is cleaned and matched, its
+ * normalized parameters (CacheKey) decide everything from the table search to the feedrate conversion, so
+ * SolveJob keeps those results (CachedResult) in a bounded LRU cache. The key holds the hash of the table
+ * contents and of the machine limits, so a reloaded or edited table, or another machine, simply misses and
+ * its entries age out. The cache is split in shards with a lock each, for the batch threads.
+ *
+ * With --cache <file> the cache is loaded at startup and saved on exit, later runs start with it warm.
+ * The file is a header followed by the (CacheKey, CachedResult) records, from the least to the most recently used.
+ */
+
+// Include headers & libraries
+#include <atomic>       // for the hit and miss counters
+#include <cstdio>       // for standard input/output operations
+#include <cstring>      // for memcmp, memcpy and strncpy
+#include <list>         // for std::list
+#include <mutex>        // for std::mutex
+#include <string>       // for std::string
+#include <unordered_map> // for std::unordered_map
+#include <vector>       // for std::vector
+#include "chipload.h"   // for external user defined functions
+
+// Constant Expressions
+#define CACHE_SHARDS 16
+#define CACHE_MAGIC "CNCCACH"   // 8 bytes with the '\0'
+#define CACHE_VERSION 4          // 2: the diameters are interpolated, 3: the engagement is in the key, 4: power overruns
+
+// Represents the header of a cache file
+struct CacheFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;       // sizeof(CacheKey) + sizeof(CachedResult), a build with other layouts skips the file
+    uint64_t count;
+};
+
+struct CacheKeyHash {
+    size_t operator()(const CacheKey &key) const { return HashBytes(&key, sizeof(key)); }
+};
+
+struct CacheKeyEqual {
+    bool operator()(const CacheKey &a, const CacheKey &b) const { return memcmp(&a, &b, sizeof(CacheKey)) == 0; }
+};
+
+// Represents a shard of the cache: the entries from the most to the least recently used and an index over them
+struct CacheShard {
+    std::mutex lock;
+    std::list<std::pair<CacheKey, CachedResult>> entries;
+    std::unordered_map<CacheKey, std::list<std::pair<CacheKey, CachedResult>>::iterator, CacheKeyHash, CacheKeyEqual> index;
+};
+
+static CacheShard shards[CACHE_SHARDS];
+static std::atomic<uint64_t> hits{0};
+static std::atomic<uint64_t> misses{0};
+
+static CacheShard &ShardOf(const CacheKey &key) {
+    return shards[CacheKeyHash()(key) % CACHE_SHARDS];
+}
+
+/**
+ * Function: builds the key of a job from its normalized parameters.
+ *
+ * Parameters:
+ * @param material: The matched material.
+ * @param diameter: The tool diameter in mm.
+ * @param flutes: The number of flutes, after the default for a bad one.
+ * @param quality: The job quality, 6 in beginner mode.
+ * @param out_unit: The matched output unit (a FeedUnit), -1 if it didn't match.
+ * @param stepover: The radial engagement in mm.
+ * @param depth: The axial depth of cut in mm.
+ * @param ball_nose: true for a ball nose tool.
+ * @param machine: The machine profile the job is solved for.
+ *
+ * Returns:
+ * @return The key, for the chipload table the calling thread reads.
+ */
+CacheKey MakeCacheKey(const std::string &material, float diameter, float flutes, float quality, int out_unit, float stepover, float depth, bool ball_nose, const Machine &machine) {
+    CacheKey key;
+    memset(&key, 0, sizeof(key)); // the padding is hashed and compared too
+    strncpy(key.material, material.c_str(), MAX_WORD_LENGTH); // the table loader rejects longer names, none is cut
+    key.diameter = diameter;
+    key.flutes = flutes;
+    key.quality = quality;
+    key.out_unit = out_unit;
+    key.stepover = stepover;
+    key.depth = depth;
+    key.ball_nose = ball_nose;
+    key.table = ActiveTableHash();
+
+    // Every limit that changes a result
+    float limits[] = {machine.power, (float)machine.max_feed, (float)machine.min_speed, (float)machine.max_speed, machine.max_deviation};
+    key.machine = HashBytes(limits, sizeof(limits));
+    key.machine = HashBytes(machine.spindle_curve.data(), machine.spindle_curve.size() * sizeof(SpindlePoint), key.machine);
+    key.machine = HashBytes(&grid_simplex, sizeof(grid_simplex), key.machine);
+    return key;
+}
+
+/**
+ * Function: looks up the results of a job, a hit becomes the most recently used entry.
+ *
+ * Parameters:
+ * @param key: The key of the job.
+ * @param cached: The results, set on a hit.
+ *
+ * Returns:
+ * @return true on a hit, false on a miss.
+ */
+bool LookupResult(const CacheKey &key, CachedResult &cached) {
+    CacheShard &shard = ShardOf(key);
+    {
+        std::lock_guard<std::mutex> guard(shard.lock);
+        auto found = shard.index.find(key);
+        if (found != shard.index.end()) {
+            shard.entries.splice(shard.entries.begin(), shard.entries, found->second);
+            cached = found->second->second;
+            hits++;
+            CountMetric(METRIC_CACHE_HITS);
+            return true;
+        }
+    }
+    misses++;
+    CountMetric(METRIC_CACHE_MISSES);
+    return false;
+}
+
+/**
+ * Function: stores the results of a job, evicting the least recently used entry of its shard when it's full.
+ *
+ * Parameters:
+ * @param key: The key of the job.
+ * @param cached: The results.
+ */
+void StoreResult(const CacheKey &key, const CachedResult &cached) {
+    CacheShard &shard = ShardOf(key);
+    std::lock_guard<std::mutex> guard(shard.lock);
+    auto found = shard.index.find(key);
+    if (found != shard.index.end()) {
+        found->second->second = cached;
+        shard.entries.splice(shard.entries.begin(), shard.entries, found->second);
+        return;
+    }
+    shard.entries.emplace_front(key, cached);
+    shard.index[key] = shard.entries.begin();
+    if (shard.entries.size() > RESULT_CACHE_ENTRIES / CACHE_SHARDS) {
+        shard.index.erase(shard.entries.back().first);
+        shard.entries.pop_back();
+    }
+}
+
+/**
+ * Function: loads the entries of a cache file into the cache.
+ *
+ * Parameters:
+ * @param filename: The cache file.
+ *
+ * Returns:
+ * @return true if the file was loaded, false if it's missing or not a cache file of this build.
+ */
+bool LoadResultCache(const std::string &filename) {
+    FILE *file = fopen(filename.c_str(), "rb");
+    if (file == nullptr) {
+        return false;
+    }
+    CacheFileHeader header;
+    bool valid = fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.magic, CACHE_MAGIC, 8) == 0 &&
+                 header.version == CACHE_VERSION && header.record_size == sizeof(CacheKey) + sizeof(CachedResult);
+    for (uint64_t i = 0; valid && i < header.count; i++) {
+        CacheKey key;
+        CachedResult cached;
+        if (fread(&key, sizeof(key), 1, file) != 1 || fread(&cached, sizeof(cached), 1, file) != 1) {
+            valid = false; // a truncated file, keep the entries read so far
+            break;
+        }
+        key.material[MAX_WORD_LENGTH] = '\0';
+        StoreResult(key, cached);
+    }
+    fclose(file);
+    return valid;
+}
+
+/**
+ * Function: saves the cache to a file, written to a temporary file first and renamed over the old one.
+ *
+ * Parameters:
+ * @param filename: The cache file.
+ *
+ * Returns:
+ * @return true if the file was written, false otherwise.
+ */
+bool SaveResultCache(const std::string &filename) {
+    std::string temporary = filename + ".tmp";
+    FILE *file = fopen(temporary.c_str(), "wb");
+    if (file == nullptr) {
+        std::cerr << "Error opening file " << temporary << std::endl;
+        return false;
+    }
+    CacheFileHeader header = {CACHE_MAGIC, CACHE_VERSION, sizeof(CacheKey) + sizeof(CachedResult), 0};
+    for (CacheShard &shard : shards) {
+        std::lock_guard<std::mutex> guard(shard.lock);
+        header.count += shard.entries.size();
+    }
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+    for (CacheShard &shard : shards) {
+        std::lock_guard<std::mutex> guard(shard.lock);
+        for (auto entry = shard.entries.rbegin(); written && entry != shard.entries.rend(); ++entry) {
+            written = fwrite(&entry->first, sizeof(CacheKey), 1, file) == 1 && fwrite(&entry->second, sizeof(CachedResult), 1, file) == 1;
+        }
+    }
+    written = fclose(file) == 0 && written;
+    if (!written || rename(temporary.c_str(), filename.c_str()) != 0) {
+        std::cerr << "Error writing file " << filename << std::endl;
+        remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Function: returns the hits and misses of the cache since the program started.
+ */
+void ResultCacheStats(uint64_t &hits_count, uint64_t &misses_count) {
+    hits_count = hits.load();
+    misses_count = misses.load();
+}
@@ -5,28 +5,127 @@
 // Header files
 #include <iostream>     // for standard C++ library for input and output
 #include <string>      // for std::string
+#include <string_view> // for std::string_view
 #include <vector>      // for std::vector
+#include <functional>  // for std::function
+#include <climits>     // for INT_MAX
+#include <chrono>      // for std::chrono::steady_clock
+#include <cstdint>     // for uint64_t
+#include <cstdio>      // for FILE
 
-// Constant Expressions for CNC LIMITS
+// Constant Expressions for CNC LIMITS, the built-in machine profile (see machine.cpp)
 #define CNCPOWER 3000       // CNC max power in watts
 #define CNCMAXFEED 4080     // CNC max feedrate in mm/m
 #define MIN_Y 0             // CNC minimum feedrate, it's zero but could be later incorpored in the Simplex and Midpoint function as CNCMINFEED
 #define CNCMINSPEED 10000   // CNC min rotational speed in rpm
 #define CNCMAXSPEED 24000   // CNC max rotational speed in rpm
 #define MAXDEV 0.01         // Max deviation allowed for chipload
+#define CNCACCEL 500        // CNC acceleration in mm/s2
 
 // Constant Expressions
 #define MAX_LINE_LENGTH 256 //defines max string lenght for reading
 #define MAX_WORD_LENGTH 45  // max word length
-#define N_BUCKETS 26        // Number of buckets in Hash table
+#define MAX_UNIT_DISTANCE 3         // max Levenshtein distance for a unit match
+#define MAX_MATERIAL_DISTANCE 6     // max Levenshtein distance for a material match
+#define N_SUGGESTIONS 3             // number of "did you mean" materials in the report
+#define CHIPLOAD_SOCKET "/tmp/chipload.sock" // default Unix domain socket of the daemon
+#define MAX_GCODE_WORDS 32          // words of a G-code line looked at, the rest are copied as they are
+#define MAP_COLUMNS 1000            // default rpm steps of a feasible region map
+#define MAP_ROWS 1000               // default feedrate steps of a feasible region map
+#define JUNCTION_DEVIATION 0.01     // mm, how far the path may round a corner, bounds the cornering speed
+#define PLANNER_BLOCKS 256          // moves looked ahead by the planner of the cycle-time estimator (power of 2)
+#define MOVE_CHUNK 65536            // moves handed from the G-code parser to the planners at once
 
-// Represents a node in a Hash table
-struct Node {
-    std::string material;  // Changed from char[] to std::string
+// Classes of the cells of a feasible region map, see heatmap.cpp
+#define CELL_FEASIBLE 0
+#define CELL_RUBBING 1              // chipload under the lower bound
+#define CELL_OVERLOADING 2          // chipload over the upper bound
+#define CELL_OVER_LIMIT 3           // feedrate over the machine limit
+
+// Constraints of the feasible region, a bit each so the ones active at the feeds can be combined, see power.cpp
+#define CONSTRAINT_MIN_SPEED 1      // x >= min speed
+#define CONSTRAINT_MAX_SPEED 2      // x <= max speed
+#define CONSTRAINT_MAX_FEED 4       // y <= max feed
+#define CONSTRAINT_MAX_CHIPLOAD 8   // y <= upper_bound * x
+#define CONSTRAINT_MIN_CHIPLOAD 16  // y >= lower_bound * x
+#define CONSTRAINT_POWER 32         // cutting power <= spindle power at x
+#define MAX_SPINDLE_POINTS 8        // points of a spindle power curve
+#define MAX_TABLE_READERS 1024      // threads that can pin a chipload table at once, see reload.cpp
+#define RESULT_CACHE_ENTRIES 4096   // results kept by the result cache, see cache.cpp
+#define ARENA_SIZE 4096             // bytes of scratch memory of a request, see Arena
+#define MAX_CHIP_THINNING 4.0f      // cap of the chip-thinning factor, very light cuts would ask for absurd chiploads
+#define SWEEP_STEPOVERS "5:50:5"    // default stepovers of a sweep, from:to:step in % of the tool diameter
+#define SWEEP_DEPTHS "10:100:10"    // default depths of cut of a sweep, from:to:step in % of the tool diameter
+#define GCODE_BUFFER (1 << 20)      // bytes of rewritten G-code collected before writing them
+#define STOCK_RESOLUTION 0.1f       // default size of a cell of the stock heightmap in mm, see simulate.cpp
+#define STOCK_MAX_CELLS (1 << 25)   // cells of the stock heightmap, a larger area is simulated coarser
+#define STOCK_TILE 64               // cells along the side of a tile of the heightmap, tiles are cut in parallel
+#define STOCK_BATCH 65536           // segments binned into the tiles at once
+#define MAX_ARC_CHORDS 1024         // chords an arc is cut in for the simulation
+#define ENGAGEMENT_BINS 10          // bins of the radial engagement histogram
+#define PARETO_SAMPLES 32           // default rpm and feedrate steps of a Pareto exploration, see pareto.cpp
+#define TAYLOR_N 0.25f              // speed exponent of the extended Taylor tool life equation, carbide
+#define TAYLOR_FEED 0.5f            // feed per tooth exponent of the extended Taylor tool life equation
+
+// Represents a row of the chipload table as read from the .csv file
+struct TableRow {
+    std::string material;
     float diameter;
     float chipload;
     float factor;
-    Node* next;
+};
+
+// Represents the chipload table (read only): materials are interned to ids when loaded, the rows of each material
+// are stored contiguously and sorted by diameter (structure of arrays) and an open addressing index maps names to ids.
+// It only points to the arrays, which live in .rodata for the embedded table or in a TableData for a loaded one
+struct ChiploadTable {
+    unsigned int material_count;
+    unsigned int row_count;
+    unsigned int slot_count;            // size of the index, a power of two
+    const char *names;                  // material names, each one terminated by '\0'
+    const unsigned int *name_offsets;   // name of material id starts at names + name_offsets[id]
+    const unsigned int *offsets;        // rows of material id span [offsets[id], offsets[id + 1])
+    const float *diameters;             // sorted ascending within each material
+    const float *chiploads;
+    const float *factors;
+    const int *slots;                   // open addressing index, material id or -1 if empty
+};
+
+// How SearchDiameters resolved a diameter, between the rows of the material or outside of them
+enum DiameterMatch {
+    DIAMETER_MISSING,       // the material isn't in the table
+    DIAMETER_EXACT,         // a row of the table
+    DIAMETER_INTERPOLATED,  // between the two rows around it, linearly
+    DIAMETER_CLAMPED        // smaller or larger than every row, the nearest row (warning 16)
+};
+
+// Represents the arrays of a chipload table built at runtime
+struct TableData {
+    std::string names;
+    std::vector<unsigned int> name_offsets;
+    std::vector<unsigned int> offsets;
+    std::vector<float> diameters;
+    std::vector<float> chiploads;
+    std::vector<float> factors;
+    std::vector<int> slots;
+};
+
+// Represents the limits of a machine, loaded from the profiles file (Machines.csv)
+// Represents a point of the spindle power curve of a machine
+struct SpindlePoint {
+    float rpm;
+    float power;            // W available at rpm
+};
+
+struct Machine {
+    std::string name;
+    float power;            // max power in watts
+    int max_feed;           // max feedrate in mm/m
+    int min_speed;          // min rotational speed in rpm
+    int max_speed;          // max rotational speed in rpm
+    float max_deviation;    // max deviation allowed for chipload
+    float acceleration;     // acceleration of the axes in mm/s2
+    std::vector<SpindlePoint> spindle_curve; // spindle power by rpm, power is the only limit if it's empty
 };
 
 // Represents a point with x and y coordinates
@@ -35,27 +134,437 @@ struct Point {
     int y;
 };
 
+// Represents a node of the fuzzy index (BK-tree)
+struct FuzzyNode {
+    int word;                                   // index of the word in the dictionary
+    std::vector<std::pair<int, int>> children;  // (distance to this word, child node)
+};
+
+// Represents a fuzzy index over a dictionary, see fuzzy.cpp
+struct FuzzyIndex {
+    std::vector<std::string> words;   // the dictionary
+    std::vector<FuzzyNode> nodes;     // nodes[0] is the root
+};
+
+// Represents a chipload table published by the hot reload (see reload.cpp), immutable once published
+struct TableSnapshot {
+    uint64_t generation;            // 1 for the table loaded at startup, +1 per reload
+    TableData data;                 // arrays of the table
+    ChiploadTable view;             // points into data
+    uint64_t hash;                  // HashTable of the view
+    FuzzyIndex material_index;      // fuzzy index over the materials of the table
+};
+
+// Pins the current chipload table for the calling thread while it's in scope, Search and FindMaterial use it.
+// Pinning is lock-free: the thread announces the reload epoch it read the table in, a replaced table is only
+// freed once no thread announces an older epoch. Guards nest, the outermost one pins.
+struct TableReadGuard {
+    const TableSnapshot *snapshot;  // nullptr when the table isn't watched, the global table is used then
+
+    TableReadGuard();
+    ~TableReadGuard();
+    TableReadGuard(const TableReadGuard &) = delete;
+    TableReadGuard &operator=(const TableReadGuard &) = delete;
+};
+
+// Represents the scratch memory of a request: a fixed block handed out front to back, Reset frees all of it at once.
+// The cleaned fields of a job are views into it, so normalizing a job doesn't touch the heap
+struct Arena {
+    char buffer[ARENA_SIZE];
+    size_t used = 0;
+
+    char *Allocate(size_t &size);
+    void Reset();
+};
+
+// Represents a fuzzy match
+struct Match {
+    int index;      // index of the word in the dictionary
+    int distance;   // Levenshtein distance to the query
+};
+
+// Represents the solution of a linear program over the feasible region
+struct Solution {
+    float x;        // rpm
+    float y;        // feedrate in mm/m
+    bool feasible;  // false if the feasible region is empty
+};
+
+// Represents the half-plane n_x * x + n_y * y <= c of a constraint
+struct HalfPlane {
+    double n_x;
+    double n_y;
+    double c;
+    int constraint;         // CONSTRAINT_ bit
+};
+
+// Represents a word of a line of G-code, ex.: "F1200" (letter 'F', value 1200)
+struct GcodeWord {
+    char letter;        // upper case
+    const char *begin;  // the word in the line, from the letter to the end of the number
+    const char *end;
+    double value;
+};
+
+// Represents the modal state of a G-code program while it's read, see ReadGcodeState
+struct GcodeState {
+    double position[3] = {0, 0, 0};   // mm
+    int motion = 0;                   // G0, G1, G2 or G3
+    bool inches = false;              // G20
+    bool relative = false;            // G91
+    double feed = 0;                  // mm/m, of the last F word
+    long next_tool = -1;              // selected by the last T word
+};
+
+// Represents what a line of G-code does besides its motion, see ReadGcodeState
+struct GcodeLine {
+    bool tool_change;           // M6, loads state.next_tool
+    bool moves;                 // has an X, Y or Z word
+    bool moves_xy;              // has an X or Y word
+    const GcodeWord *feed;      // first F word, nullptr if it has none
+};
+
+// Represents the motion of a line, a straight along X, Y and Z or an arc in the XY plane with a helix along Z
+struct GcodePath {
+    double start[3];            // mm
+    double target[3];           // mm
+    bool arc;
+    double center[2];           // mm, of the arc
+    double radius;              // mm, of the arc
+    double start_angle;         // radians, of the start around the center
+    double sweep;               // radians, negative clockwise
+    double length;              // mm, along the path
+    double length_xy;           // mm, in the XY plane
+};
+
+// Represents a move of a G-code program for the cycle-time estimator, a move of length 0 stops the machine
+struct Move {
+    float length;           // mm, along the path
+    float start[3];         // unit tangent at the start
+    float end[3];           // unit tangent at the end
+    float program_feed;     // mm/s, feed of the program
+    float computed_feed;    // mm/s, feed computed for the tool
+    float max_speed;        // mm/s, centripetal limit of an arc
+    int tool;               // index of the tool in the program
+};
+
+// Units of length and of feedrate, see units.cpp
+enum LengthUnit {
+    UNIT_MM,
+    UNIT_IN,
+    N_LENGTH_UNITS
+};
+
+enum FeedUnit {
+    UNIT_MM_S,
+    UNIT_MM_M,
+    UNIT_M_M,
+    UNIT_IN_S,
+    UNIT_IN_M,
+    UNIT_FT_M,
+    N_FEED_UNITS
+};
+
+// Represents a length (ex.: a tool diameter) and a feedrate, separate types so one can't be converted as the other
+struct Length {
+    float value;
+    LengthUnit unit;
+};
+
+struct FeedRate {
+    float value;
+    FeedUnit unit;
+};
+
+// Represents one feeds and speeds job, raw user input as read from a file
+struct Job {
+    bool beginner = false;
+    std::string material;
+    std::string tool;           // tool diameter and its unit, ex.: "1/4 inches"
+    std::string tool_teeth;
+    std::string job_quality;
+    std::string out_unit;
+    bool checklist = false;
+    bool supported_materials_list = false;
+    std::string stepover;       // radial engagement in the tool unit or in % of the diameter, empty for a full slot
+    std::string depth;          // axial depth of cut in the tool unit or in % of the diameter, empty for half the diameter
+    bool ball_nose = false;
+};
+
+// Represents the outcome of a job, error and warning codes match ErrorMessage and WarningMessage
+struct JobResult {
+    int error = 0;              // 0 if the job succeeded
+    std::vector<int> warnings;  // warnings raised while the job resumed with defaults
+    std::string material;       // best matching material
+    std::vector<Match> suggestions; // closest materials, the first one is the match
+    float tool_diameter = 0;    // tool diameter in tool_unit
+    std::string tool_unit;      // best matching tool unit
+    float diameter = 0;         // tool diameter in mm
+    int tool_teeth = 0;
+    float speed = 0;            // job quality
+    float chipload = 0;         // chipload of the table, before the chip-thinning correction
+    float rpm_factor = 0;
+    float stepover = 0;         // radial engagement in mm
+    float depth = 0;            // axial depth of cut in mm
+    float effective_diameter = 0; // diameter cutting at that depth in mm, smaller than diameter for a shallow ball nose
+    float thinning = 1;         // chip-thinning factor the chipload was multiplied by
+    float upper_bound = 0;      // slopes of the chipload straights bounding the feasible region, in mm/m per rpm
+    float lower_bound = 0;
+    float specific_energy = 0;  // J/mm3 to cut the material, 0 if it isn't known (no power constraint)
+    float power_per_feed = 0;   // cutting power in W per mm/m of feed, for a slot of depth D/2
+    float power = 0;            // cutting power at the feeds in W
+    float spindle_power = 0;    // power of the spindle at the rpm of the feeds in W
+    int binding = 0;            // CONSTRAINT_ bits of the constraints active at the feeds
+    Point feeds = {0, 0};       // x in rpm, y in mm/m
+    float feed_rate = 0;        // feedrate in out_unit
+    std::string out_unit;       // best matching output unit
+};
+
+// Represents the normalized parameters of a job, the key of the result cache (see cache.cpp).
+// It's compared and hashed as bytes, MakeCacheKey zeroes it first.
+struct CacheKey {
+    char material[MAX_WORD_LENGTH + 1];     // matched material
+    float diameter;                         // mm
+    float flutes;
+    float quality;                          // 6 in beginner mode
+    int out_unit;                           // FeedUnit, -1 if it didn't match
+    float stepover;                         // mm
+    float depth;                            // mm
+    int ball_nose;
+    uint64_t table;                         // ActiveTableHash, a changed table misses
+    uint64_t machine;                       // hash of the machine limits, a changed machine misses
+};
+
+// Represents the part of a JobResult the result cache keeps, from the search to the conversion
+struct CachedResult {
+    int error;                              // 0 or 13 (material not in the table)
+    bool feasible;                          // false raises warning 15, or 18 when it's the spindle power
+    bool power_exceeded;                    // the cut needs more power than the spindle gives, raises warning 18
+    int diameter_match;                     // DiameterMatch, DIAMETER_CLAMPED raises warning 16
+    float chipload;
+    float rpm_factor;
+    float upper_bound;
+    float lower_bound;
+    float specific_energy;
+    float power_per_feed;
+    float power;
+    float spindle_power;
+    int binding;
+    Point feeds;
+    float feed_rate;
+};
+
+// Formats of a report, see write.cpp
+enum ReportFormat {
+    REPORT_TEXT,    // human readable, the MyTools.txt layout
+    REPORT_CSV,     // one row per error, warning, result or suggestion
+    REPORT_JSON     // JSON lines, one object per error, warning, result or suggestion
+};
+
+// Represents an output file opened once, what is written is collected in buffer and written in large blocks
+struct Report {
+    FILE *file = nullptr;
+    std::string filename;
+    ReportFormat format = REPORT_TEXT;
+    std::string buffer;
+    size_t written = 0;             // bytes already written to the file
+    unsigned int job = 0;           // job the next rows belong to (CSV and JSON lines), 0 for the whole run
+    unsigned int errors = 0;
+    unsigned int warnings = 0;
+
+    ~Report();
+};
+
+// Pipeline stages with a latency histogram, see metrics.cpp
+enum Stage {
+    STAGE_LOAD,
+    STAGE_READ,
+    STAGE_CLEAN,
+    STAGE_MATCH,
+    STAGE_SEARCH,
+    STAGE_SOLVE,
+    STAGE_CONVERT,
+    STAGE_WRITE,
+    N_STAGES
+};
+
+// Counters, see metrics.cpp
+enum Metric {
+    METRIC_SEARCH_CALLS,
+    METRIC_SEARCH_PROBES,
+    METRIC_LEVENSHTEIN_CALLS,
+    METRIC_SOLVER_ITERATIONS,
+    METRIC_BYTES_WRITTEN,
+    METRIC_TABLE_RELOADS,
+    METRIC_CACHE_HITS,
+    METRIC_CACHE_MISSES,
+    N_METRICS
+};
+
+// Times a stage until it goes out of scope, Next records it and starts timing the following stage
+struct StageTimer {
+    Stage stage;
+    std::chrono::steady_clock::time_point start;
+
+    explicit StageTimer(Stage stage);
+    void Next(Stage next);
+    ~StageTimer();
+};
+
+// Represents a tool of the tool map used to rewrite G-code, solved the first time it's loaded
+struct Tool {
+    long number;            // T number
+    Job job;                // the tool as a job, with the feedrate in mm/m
+    bool solved = false;
+    int error = 0;          // SolveJob error, the F and S words of the tool are kept if it failed
+    JobResult result;
+};
+
+// Represents a sample of the feasible region scored for the Pareto front, see pareto.cpp
+struct ParetoPoint {
+    int rpm;
+    float feed;                 // mm/m
+    float feed_per_tooth;       // mm
+    float removal;              // material removal rate in cm3/min
+    float roughness;            // peak to valley height of the feed marks in um
+    float tool_life;            // relative to the slowest rpm at the lower chipload straight
+    float power;                // cutting power in W
+};
+
+// Output of the G-code rewriters, written to the file in large blocks
+struct GcodeOutput {
+    FILE *file;
+    std::string buffer;
+    bool failed = false;
+
+    void Append(const char *begin, const char *end) {
+        buffer.append(begin, end);
+        if (buffer.size() >= GCODE_BUFFER) Flush();
+    }
+    void Flush() {
+        failed |= fwrite(buffer.data(), 1, buffer.size(), file) != buffer.size();
+        buffer.clear();
+    }
+};
+
+// Modal F of a program whose feeds are replaced, see ReplaceFeed
+struct ModalFeed {
+    std::string program;    // last F word of the program
+    std::string current;    // F word in effect in the rewritten program
+};
+
 // Declaration of external variables
-extern Node* table[N_BUCKETS];          // Changed from array to vector
+extern ChiploadTable table;
+extern thread_local const ChiploadTable* pinned_table;   // table pinned by a TableReadGuard, see reload.cpp
+extern thread_local uint64_t pinned_table_hash;
+extern const ChiploadTable default_table;   // embedded at build time from ChiploadTable.csv, see embed.cpp
 extern unsigned int unique_materials;  // Changed from array to vector
 extern unsigned int unique_materials_count;
+extern bool grid_simplex;
+extern Machine machine;                     // profile jobs are solved for, see machine.cpp
+extern const std::vector<std::string> length_unit_names;    // spellings of the length units, for BestMatch
+extern const std::vector<std::string> feed_unit_names;      // spellings of the feedrate units, for BestMatch
 
 
 // Function Prototypes
 bool UniqueElements(std::vector<std::string>& unique_materials, unsigned int* material_counter);
-bool ReadFromFile(const std::string& filename, bool& beginner, std::string& material, std::string& tool_diam, std::string& tool_z, std::string& job_quality, std::string& out_units, bool& checklist, bool& supported_materials_list);
-void CleanString(std::string& source);
-float CleanNumber(const std::string& source);
-std::string BestMatch(const std::string& source, const std::vector<std::string>& dictionary, int max_distance);
+int LoadMaterialIndex(const std::string& file_chipload, FuzzyIndex& material_index);
+bool ReadFromFile(const std::string& filename, Job& job);
+bool ReadJobsFromFile(const std::string& filename, std::vector<Job>& jobs);
+int LoadTableAndJobs(const std::string& file_chipload, const std::string& file_jobs, FuzzyIndex& material_index, std::vector<Job>& jobs);
+std::string_view CleanString(std::string_view source, Arena& arena);
+float CleanNumber(std::string_view source);
+size_t SplitFields(std::string_view line, char separator, std::string_view fields[], size_t max_fields);
+std::string_view TrimBlanks(std::string_view field);
+int LevenshteinDistance(std::string_view string1, std::string_view string2, int max_distance = INT_MAX);
+void BuildFuzzyIndex(const std::vector<std::string>& dictionary, FuzzyIndex& index);
+std::vector<Match> FuzzyMatches(const FuzzyIndex& index, std::string_view query, int max_distance, size_t k);
+int BestMatch(std::string_view source, const std::vector<std::string>& dictionary, int max_distance);
 bool Load(const std::string& filename);
-bool Search(const std::string& material, float diameter, float& chipload, float& rpm_factor);
+bool ReadTableRows(const std::string& filename, std::vector<TableRow>& rows);
+bool BuildTable(const std::vector<TableRow>& rows, TableData& built);
+ChiploadTable TableView(const TableData& built);
+void TableRows(const ChiploadTable& view, std::vector<TableRow>& rows);
+int FindMaterial(const std::string& material);
+bool Search(const std::string& material, float diameter, float& chipload, float& rpm_factor, DiameterMatch* match = nullptr);
+bool SearchDiameters(const std::string& material, const float diameters[], size_t count, float chiploads[], float rpm_factors[], DiameterMatch matches[]);
 bool Unload();
+bool WriteSnapshot(const std::string& filename, const ChiploadTable& view);
+bool LoadSnapshot(const std::string& filename, ChiploadTable& view);
+uint64_t HashBytes(const void* data, size_t size, uint64_t hash_value = 14695981039346656037ull);
+uint64_t HashTable(const ChiploadTable& view);
+void UnmapSnapshot();
 void PrintTable();
-Point Simplex(int x_min, int x_max, int y_max, float a, float b, bool maximize_y);
-Point Midpoint(int x_min, int x_max, int y_max, float c);
-bool WriteResultsToFile(const std::string& filename, const std::string& material, float tool_diameter, const std::string& tool_unit, int tool_teeth, float speed, Point results, float feed_rate, const std::string& out_unit, const std::vector<std::string>& materials_list, bool checklist, bool supported_materials_list);
-float Convert(float value, const std::string& from, const std::string& to);
-void ErrorMessage(const std::string& filename, int error);
-void WarningMessage(const std::string& filename, int warning);
+Solution SolveLP(int x_min, int x_max, int y_max, float a, float b, float c_x, float c_y, const HalfPlane extra[] = nullptr, int n_extra = 0, int* binding = nullptr);
+bool Simplex(const Machine& machine, float a, float b, float power_per_feed, bool maximize_y, Point& optimum, int* binding = nullptr);
+Point GridSimplex(int x_min, int x_max, int y_max, float a, float b, bool maximize_y);
+Point Midpoint(const Machine& machine, float c, float power_per_feed = 0, int* binding = nullptr);
+float SpecificCuttingEnergy(const std::string& material);
+bool ParseSpindleCurve(const std::string& text, std::vector<SpindlePoint>& curve);
+float SpindlePower(const Machine& machine, float rpm);
+int PowerConstraints(const Machine& machine, float power_per_feed, HalfPlane planes[]);
+std::string DescribeLimits(const JobResult& result);
+bool OpenReport(Report& report, const std::string& filename);
+bool FlushReport(Report& report);
+bool CloseReport(Report& report);
+bool WriteResultsToFile(Report& report, const std::string& material, float tool_diameter, const std::string& tool_unit, int tool_teeth, float speed, Point results, float feed_rate, const std::string& out_unit, const std::string& limits, const std::vector<std::string>& materials_list, bool checklist, bool supported_materials_list);
+bool ParseLengthUnit(const std::string& name, LengthUnit& unit);
+bool ParseFeedUnit(const std::string& name, FeedUnit& unit);
+const char* UnitName(LengthUnit unit);
+const char* UnitName(FeedUnit unit);
+Length Convert(Length length, LengthUnit to);
+FeedRate Convert(FeedRate feed_rate, FeedUnit to);
+void ConvertFeedRates(const float* values, float* converted, size_t count, FeedUnit from, FeedUnit to);
+void ConvertResultFeedRates(std::vector<JobResult>& results);
+void ErrorMessage(Report& report, int error);
+void WarningMessage(Report& report, int warning);
+void WriteSuggestions(Report& report, const std::string& material, const JobResult& result, const std::vector<std::string>& materials_list);
+int SolveJob(const Job& job, const FuzzyIndex& material_index, const Machine& machine, JobResult& result);
+bool SolveFeeds(const Machine& machine, float chipload, float tool_z, float speed, float power_per_feed, CachedResult& cached);
+void ParallelFor(size_t count, const std::function<void(size_t)>& body);
+int RunServer(const std::string& file_chipload, const std::string& socket_path, bool watch);
+void RecordLatency(Stage stage, uint64_t nanoseconds);
+void CountMetric(Metric metric, uint64_t n = 1);
+std::string MetricsText();
+std::string MetricsJson();
+bool WriteMetrics(const std::string& filename);
+void ClassifyRow(float feed, const float* upper, const float* lower, int count, float y_max, unsigned char* cells);
+bool WriteFeasibleMap(const std::string& filename, const JobResult& result, const Machine& machine, int columns, int rows);
+int RunMap(const std::string& file_chipload, const std::string& file_jobs, const std::string& file_output, int columns, int rows);
+bool LoadMachines(const std::string& filename, std::vector<Machine>& machines);
+const Machine* FindMachine(const std::vector<Machine>& machines, const std::string& name);
+int RunCompare(const std::string& file_chipload, const std::string& file_jobs, const std::vector<Machine>& machines, const std::string& file_output);
+const char* MapFile(const std::string& filename, size_t& size);
+void UnmapFile(const char* data, size_t size);
+int ParseGcodeLine(const char* begin, const char* end, GcodeWord words[]);
+GcodeLine ReadGcodeState(GcodeState& state, const GcodeWord words[], int count);
+bool ParseGcodePath(GcodeState& state, const GcodeWord words[], int count, GcodePath& path);
+bool LoadToolMap(const std::string& filename, std::vector<Tool>& tools);
+int LoadTableAndTools(const std::string& file_chipload, const std::string& file_tools, FuzzyIndex& material_index, std::vector<Tool>& tools);
+bool RunsAtToolFeed(int motion, bool moves_xy, const Tool* active);
+const char* ReplaceFeed(ModalFeed& modal, const char* tool_word, bool moves, const GcodeWord* feed);
+bool CopyGcodeLine(GcodeOutput& output, const char* line, const char* next_line, const GcodeWord words[], int count, const char* f_word, const char* s_word);
+int RewriteGcode(const std::string& file_input, const std::string& file_output, std::vector<Tool>& tools, const FuzzyIndex& material_index, const Machine& machine);
+int RunRewrite(const std::string& file_chipload, const std::string& file_tools, const std::string& file_input, const std::string& file_output);
+int EstimateCycleTime(const std::string& file_input, std::vector<Tool>& tools, const FuzzyIndex& material_index, const Machine& machine);
+int RunCycleTime(const std::string& file_chipload, const std::string& file_tools, const std::string& file_input);
+bool WatchTable(const std::string& filename);
+const ChiploadTable& ActiveTable();
+uint64_t ActiveTableHash();
+uint64_t TableGeneration();
+CacheKey MakeCacheKey(const std::string& material, float diameter, float flutes, float quality, int out_unit, float stepover, float depth, bool ball_nose, const Machine& machine);
+bool LookupResult(const CacheKey& key, CachedResult& cached);
+void StoreResult(const CacheKey& key, const CachedResult& cached);
+bool LoadResultCache(const std::string& filename);
+bool SaveResultCache(const std::string& filename);
+void ResultCacheStats(uint64_t& hits, uint64_t& misses);
+int RunBatch(const std::string& file_chipload, const std::string& file_jobs, const std::string& file_output);
+void EngagementFactors(float diameter, bool ball_nose, const float stepover[], const float depth[], size_t count, float thinning[], float effective_diameter[]);
+float ParseEngagement(std::string_view field, float diameter, LengthUnit unit);
+int RunSweep(const std::string& file_chipload, const std::string& file_tools, const std::string& file_output, const std::string& stepovers, const std::string& depths);
+int SimulateGcode(const std::string& file_input, const std::string& file_output, std::vector<Tool>& tools, const FuzzyIndex& material_index, const Machine& machine, float resolution);
+int RunSimulate(const std::string& file_chipload, const std::string& file_tools, const std::string& file_input, const std::string& file_output, float resolution);
+size_t ParetoFront(const JobResult& result, const Machine& machine, int samples, std::vector<ParetoPoint>& front);
+int RunPareto(const std::string& file_chipload, const std::string& file_jobs, const std::string& file_output, int samples);
 
 #endif
\ No newline at end of file
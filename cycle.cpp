@@ -0,0 +1,387 @@
+/**
+ * This file contains the following function definitions for estimating the cycle time of a G-code program:
+ * - EstimateCycleTime
+ * - RunCycleTime
+ *
+ * The feedrate of a program is a nominal value, on short moves and around corners the machine never reaches it.
+ * The estimator plans the program the way a motion controller does:
+ * - every move accelerates and decelerates at the machine acceleration (a trapezoidal speed profile)
+ * - a corner is taken at the speed that keeps the path within JUNCTION_DEVIATION of the corner
+ * - an arc is taken at the speed that keeps the centripetal acceleration within the machine acceleration
+ * - the planner looks PLANNER_BLOCKS moves ahead, so it always plans to be able to stop at the end of its buffer
+ *
+ * The program is planned twice, with the feeds of the program and with the feeds computed for each tool of the
+ * tool map, given to the moves by the feed policy of RewriteGcode (RunsAtToolFeed). A cutting move without a
+ * feed (before any F word) can't be timed, it's left out of the plan and counted in the report. One thread parses the program into chunks of moves,
+ * one thread plans each set of feeds, and the chunks go through bounded queues, so memory use doesn't depend on
+ * the size of the program.
+ */
+
+// Include headers & libraries
+#include <algorithm>            // for std::min and std::find_if
+#include <chrono>               // for timing the run
+#include <cmath>                // for sqrt, atan2, ...
+#include <condition_variable>   // for the move queues
+#include <cstdio>               // for standard input/output operations
+#include <cstring>              // for memchr
+#include <deque>                // for std::deque
+#include <limits>               // for std::numeric_limits
+#include <memory>               // for std::shared_ptr
+#include <mutex>                // for std::mutex
+#include <string>               // for std::string
+#include <thread>               // for std::thread
+#include <vector>               // for std::vector
+#include "chipload.h"           // for external user defined functions
+
+#define MOVE_QUEUE_CHUNKS 8     // chunks of moves waiting for a planner, the parser waits when it's ahead by more
+
+typedef std::shared_ptr<const std::vector<Move>> MoveChunk;
+
+// Chunks of moves from the parser to a planner, the parser blocks while the queue is full
+struct MoveQueue {
+    std::mutex lock;
+    std::condition_variable changed;
+    std::deque<MoveChunk> chunks;
+    bool closed = false;
+
+    void Push(MoveChunk chunk) {
+        std::unique_lock<std::mutex> guard(lock);
+        changed.wait(guard, [&] { return chunks.size() < MOVE_QUEUE_CHUNKS; });
+        chunks.push_back(std::move(chunk));
+        changed.notify_all();
+    }
+    void Close() {
+        std::lock_guard<std::mutex> guard(lock);
+        closed = true;
+        changed.notify_all();
+    }
+    // Returns false once the queue is closed and empty
+    bool Pop(MoveChunk &chunk) {
+        std::unique_lock<std::mutex> guard(lock);
+        changed.wait(guard, [&] { return !chunks.empty() || closed; });
+        if (chunks.empty()) return false;
+        chunk = std::move(chunks.front());
+        chunks.pop_front();
+        changed.notify_all();
+        return true;
+    }
+};
+
+// A move in the planner buffer, speeds in mm/s
+struct PlannerBlock {
+    float length;
+    float nominal;          // cruise speed
+    float max_entry;        // corner and cruise speed limit at the start
+    float entry;            // entry speed, so the machine can still stop at the end of the buffer
+    int tool;
+};
+
+/**
+ * Function: computes the time of a trapezoidal (or triangular) speed profile.
+ *
+ * Parameters:
+ * @param length: The length of the move in mm.
+ * @param entry: The speed at the start in mm/s.
+ * @param cruise: The speed to reach in mm/s.
+ * @param exit: The speed at the end in mm/s.
+ * @param acceleration: The acceleration in mm/s2.
+ *
+ * Returns:
+ * @return The time of the move in seconds.
+ */
+static double TrapezoidTime(double length, double entry, double cruise, double exit, double acceleration) {
+    double accelerating = (cruise * cruise - entry * entry) / (2 * acceleration);
+    double decelerating = (cruise * cruise - exit * exit) / (2 * acceleration);
+    if (accelerating + decelerating <= length) {
+        return (cruise - entry) / acceleration + (cruise - exit) / acceleration + (length - accelerating - decelerating) / cruise;
+    }
+    // The move is too short to reach the cruise speed, it peaks where acceleration and deceleration meet
+    double peak = sqrt(std::max((2 * acceleration * length + entry * entry + exit * exit) / 2, std::max(entry * entry, exit * exit)));
+    return (peak - entry) / acceleration + (peak - exit) / acceleration;
+}
+
+// Lookahead planner for one set of feeds, it runs the moves through a ring of PLANNER_BLOCKS blocks
+struct Planner {
+    bool computed;                  // plan the computed feeds, otherwise the feeds of the program
+    float acceleration;             // mm/s2
+    float max_feed;                 // mm/s
+    PlannerBlock blocks[PLANNER_BLOCKS];
+    size_t head = 0, count = 0;     // oldest block and number of blocks in the ring
+    bool moving = false;            // a previous move can be joined to the next one
+    float last_nominal = 0;         // cruise speed and exit tangent of the last move added
+    float last_direction[3] = {0, 0, 0};
+    float exit_speed = 0;           // speed at the end of the last move executed
+    std::vector<double> planned;    // planned time of each tool of the program
+    std::vector<double> nominal;    // time at the nominal feed, without acceleration
+
+    PlannerBlock &Block(size_t i) { return blocks[(head + i) & (PLANNER_BLOCKS - 1)]; }
+
+    // Executes the oldest block: its entry speed is the exit speed of the previous one
+    void Execute() {
+        PlannerBlock &block = Block(0);
+        float next_entry = count > 1 ? Block(1).entry : 0;
+        float entry = exit_speed;
+        float exit = std::min(next_entry, sqrtf(entry * entry + 2 * acceleration * block.length));
+        if ((size_t)block.tool >= planned.size()) {
+            planned.resize(block.tool + 1, 0.0);
+            nominal.resize(block.tool + 1, 0.0);
+        }
+        planned[block.tool] += TrapezoidTime(block.length, entry, std::max(block.nominal, std::max(entry, exit)), exit, acceleration);
+        nominal[block.tool] += block.length / block.nominal;
+        exit_speed = exit;
+        head = (head + 1) & (PLANNER_BLOCKS - 1);
+        count--;
+    }
+
+    // Runs every block in the buffer down to a stop
+    void Stop() {
+        while (count > 0) Execute();
+        moving = false;
+        exit_speed = 0;
+    }
+
+    void Add(const Move &move) {
+        if (move.length <= 0) {
+            Stop();
+            return;
+        }
+        float cruise = std::min({computed ? move.computed_feed : move.program_feed, move.max_speed, max_feed});
+        if (cruise <= 0) return; // no feed, the machine wouldn't move
+
+        // Corner speed between the last move and this one, from the angle between their tangents
+        float max_entry = 0;
+        if (moving) {
+            float cos_theta = -(last_direction[0] * move.start[0] + last_direction[1] * move.start[1] + last_direction[2] * move.start[2]);
+            float junction;
+            if (cos_theta > 0.999999f) {
+                junction = 0;                                       // the path turns back on itself
+            } else if (cos_theta < -0.999999f) {
+                junction = std::numeric_limits<float>::infinity();  // straight through
+            } else {
+                float sin_half = sqrtf(0.5f * (1 - cos_theta));
+                junction = sqrtf(acceleration * JUNCTION_DEVIATION * sin_half / (1 - sin_half));
+            }
+            max_entry = std::min({junction, cruise, last_nominal});
+        }
+
+        if (count == PLANNER_BLOCKS) Execute();
+        Block(count++) = {move.length, cruise, max_entry, 0, move.tool};
+        moving = true;
+        last_nominal = cruise;
+        std::copy(move.end, move.end + 3, last_direction);
+
+        // Backward pass from the new block, which must be able to stop at its end. The entry speeds only
+        // grow as blocks are added, the pass stops at the first block whose entry speed didn't change.
+        float next_entry = 0;
+        for (size_t i = count; i-- > 0;) {
+            PlannerBlock &block = Block(i);
+            float entry = std::min(block.max_entry, sqrtf(next_entry * next_entry + 2 * acceleration * block.length));
+            if (i + 1 < count && entry == block.entry) break;
+            block.entry = entry;
+            next_entry = entry;
+        }
+    }
+};
+
+/**
+ * Function: fills the length, tangents and speed limit of a move from the path of its line (see ParseGcodePath).
+ *
+ * Parameters:
+ * @param path: The path, a straight or an arc in the XY plane with a helix along Z.
+ * @param acceleration: The machine acceleration in mm/s2, it limits the speed along arcs.
+ * @param move: The move, without its feeds and tool.
+ */
+static void PathToMove(const GcodePath &path, float acceleration, Move &move) {
+    double delta[3] = {path.target[0] - path.start[0], path.target[1] - path.start[1], path.target[2] - path.start[2]};
+    move.length = path.length;
+    move.max_speed = std::numeric_limits<float>::infinity();
+    if (path.arc) {
+        double side = path.sweep < 0 ? -1 : 1;
+        double end_angle = path.start_angle + path.sweep;
+        move.start[0] = -side * sin(path.start_angle) * path.length_xy / path.length;
+        move.start[1] = side * cos(path.start_angle) * path.length_xy / path.length;
+        move.start[2] = delta[2] / path.length;
+        move.end[0] = -side * sin(end_angle) * path.length_xy / path.length;
+        move.end[1] = side * cos(end_angle) * path.length_xy / path.length;
+        move.end[2] = delta[2] / path.length;
+        move.max_speed = sqrt(acceleration * path.radius);
+    } else {
+        for (int axis = 0; axis < 3; axis++) {
+            move.start[axis] = move.end[axis] = delta[axis] / path.length;
+        }
+    }
+}
+
+// Formats a time in seconds as h:mm:ss.s
+static std::string FormatTime(double seconds) {
+    char text[32];
+    long whole = (long)seconds;
+    snprintf(text, sizeof(text), "%ld:%02ld:%04.1f", whole / 3600, whole / 60 % 60, seconds - whole / 60 * 60);
+    return text;
+}
+
+/**
+ * Function: estimates the machining time of a G-code program, for the feeds of the program and for the feeds
+ * computed for each tool of a tool map, and prints them per tool.
+ *
+ * Parameters:
+ * @param file_input: The G-code program.
+ * @param tools: The tool map (see LoadToolMap), the feeds of each tool are solved when it's first loaded.
+ * @param material_index: The fuzzy index over the materials.
+ * @param machine: The machine profile, its max feed and acceleration limit the moves.
+ *
+ * Returns:
+ * @return 0 if the program was planned, 3 if it can't be read.
+ */
+int EstimateCycleTime(const std::string &file_input, std::vector<Tool> &tools, const FuzzyIndex &material_index, const Machine &machine) {
+    size_t size = 0;
+    const char *data = MapFile(file_input, size);
+    if (data == nullptr) {
+        std::cerr << "Error opening file " << file_input << std::endl;
+        return 3;
+    }
+    auto start = std::chrono::steady_clock::now();
+
+    // One planner thread per set of feeds
+    Planner planners[2];
+    MoveQueue queues[2];
+    std::vector<std::thread> threads;
+    for (int k = 0; k < 2; k++) {
+        planners[k].computed = k == 1;
+        planners[k].acceleration = machine.acceleration;
+        planners[k].max_feed = machine.max_feed / 60.0f;
+        threads.emplace_back([&, k] {
+            MoveChunk chunk;
+            while (queues[k].Pop(chunk)) {
+                for (const Move &move : *chunk) planners[k].Add(move);
+            }
+            planners[k].Stop();
+        });
+    }
+
+    // Parse the program on this thread, tool 0 is the spindle before the first tool change
+    std::vector<long> program_tools = {-1};
+    std::vector<size_t> moves_of_tool = {0};
+    std::vector<double> length_of_tool = {0};
+    GcodeState state;
+    int tool = 0;
+    const Tool *active = nullptr;
+    size_t lines = 0, moves = 0;
+    size_t unfed[2] = {0, 0};       // moves without a feed, in the program and in the computed plan
+    GcodeWord words[MAX_GCODE_WORDS];
+    auto chunk = std::make_shared<std::vector<Move>>();
+    chunk->reserve(MOVE_CHUNK);
+    auto hand_over = [&] {
+        MoveChunk shared = chunk;
+        for (MoveQueue &queue : queues) queue.Push(shared);
+        chunk = std::make_shared<std::vector<Move>>();
+        chunk->reserve(MOVE_CHUNK);
+    };
+
+    const char *end = data + size;
+    for (const char *line = data; line < end;) {
+        const char *newline = static_cast<const char *>(memchr(line, '\n', end - line));
+        const char *line_end = newline ? newline : end;
+        int count = ParseGcodeLine(line, line_end, words);
+        line = newline ? newline + 1 : end;
+        lines++;
+
+        GcodeLine parsed = ReadGcodeState(state, words, count);
+        long next_tool = state.next_tool;
+        if (parsed.tool_change) {
+            auto found = std::find_if(tools.begin(), tools.end(), [&](const Tool &entry) { return entry.number == next_tool; });
+            active = found == tools.end() ? nullptr : &*found;
+            if (active != nullptr && !found->solved) {
+                found->error = SolveJob(found->job, material_index, machine, found->result);
+                found->solved = true;
+            }
+            auto known = std::find(program_tools.begin(), program_tools.end(), next_tool);
+            tool = known - program_tools.begin();
+            if (known == program_tools.end()) {
+                program_tools.push_back(next_tool);
+                moves_of_tool.push_back(0);
+                length_of_tool.push_back(0);
+            }
+            chunk->push_back(Move{}); // the machine stops to change the tool
+        }
+
+        GcodePath path;
+        if (ParseGcodePath(state, words, count, path)) {
+            Move move;
+            PathToMove(path, machine.acceleration, move);
+            bool rapid = state.motion == 0;
+            move.program_feed = rapid ? machine.max_feed / 60.0f : (float)(state.feed / 60);
+            move.computed_feed = move.program_feed;
+            if (RunsAtToolFeed(state.motion, parsed.moves_xy, active)) { // plunges keep their feed
+                move.computed_feed = active->result.feeds.y / 60.0f;
+            }
+            unfed[0] += move.program_feed <= 0;
+            unfed[1] += move.computed_feed <= 0;
+            move.tool = tool;
+            chunk->push_back(move);
+            moves++;
+            moves_of_tool[tool]++;
+            length_of_tool[tool] += move.length;
+        }
+        if (chunk->size() >= MOVE_CHUNK) hand_over();
+    }
+    hand_over();
+    for (MoveQueue &queue : queues) queue.Close();
+    for (std::thread &thread : threads) thread.join();
+    UnmapFile(data, size);
+    for (Planner &planner : planners) { // tools whose moves were all skipped have no time yet
+        planner.planned.resize(std::max(planner.planned.size(), program_tools.size()), 0.0);
+        planner.nominal.resize(std::max(planner.nominal.size(), program_tools.size()), 0.0);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // Per tool report, both plans see the same tools in the same order
+    printf("%-6s %-20s %10s %12s %12s %12s %12s %12s\n", "Tool", "Material", "Moves", "Length(mm)",
+           "Program", "Planned", "Computed", "Planned");
+    double totals[4] = {0, 0, 0, 0};
+    for (size_t i = 0; i < program_tools.size(); i++) {
+        if (moves_of_tool[i] == 0) continue;
+        auto found = std::find_if(tools.begin(), tools.end(), [&](const Tool &entry) { return entry.number == program_tools[i]; });
+        std::string material = found == tools.end() ? "-" : found->error ? "error " + std::to_string(found->error) : found->result.material;
+        double times[4] = {planners[0].nominal[i], planners[0].planned[i], planners[1].nominal[i], planners[1].planned[i]};
+        std::string label = program_tools[i] < 0 ? "-" : "T" + std::to_string(program_tools[i]);
+        printf("%-6s %-20s %10zu %12.1f", label.c_str(), material.c_str(), moves_of_tool[i], length_of_tool[i]);
+        for (int k = 0; k < 4; k++) {
+            printf(" %12s", FormatTime(times[k]).c_str());
+            totals[k] += times[k];
+        }
+        printf("\n");
+    }
+    printf("%-6s %-20s %10zu %12s", "Total", "", moves, "");
+    for (int k = 0; k < 4; k++) printf(" %12s", FormatTime(totals[k]).c_str());
+    printf("\nPlanned %zu moves of %zu lines in %.3f s (%.0f MB/s), %s at %.0f mm/s2\n", moves, lines, seconds,
+           size / 1e6 / std::max(seconds, 1e-9), machine.name.c_str(), machine.acceleration);
+    if (unfed[0] > 0 || unfed[1] > 0) {
+        printf("%zu moves without a feed (before any F word) aren't timed with the program feeds, %zu with the computed feeds\n",
+               unfed[0], unfed[1]);
+    }
+    return 0;
+}
+
+/**
+ * Function: loads the chipload table and a tool map, then estimates the cycle time of a G-code program.
+ *
+ * Parameters:
+ * @param file_chipload: The chipload table .csv file.
+ * @param file_tools: The tool map .csv file.
+ * @param file_input: The G-code program.
+ *
+ * Returns:
+ * @return 0 if the program was planned, otherwise the error code (1, 2 or 3).
+ */
+int RunCycleTime(const std::string &file_chipload, const std::string &file_tools, const std::string &file_input) {
+    FuzzyIndex material_index;
+    std::vector<Tool> tools;
+    int error = LoadTableAndTools(file_chipload, file_tools, material_index, tools);
+    if (error != 0) {
+        return error;
+    }
+    error = EstimateCycleTime(file_input, tools, material_index, machine);
+    Unload();
+    return error;
+}
@@ -0,0 +1,93 @@
+/**
+ * This is the build step that embeds the default chipload table in the binary.
+ *
+ * It loads a chipload table .csv file exactly like the program does (interned materials, rows grouped
+ * per material and sorted by diameter, open addressing index) and prints the resulting arrays as a
+ * header of constexpr arrays, default_table.h, which embedded.cpp turns into default_table.
+ * The Makefile runs it whenever ChiploadTable.csv changes:
+ *
+ *     ./embed ChiploadTable.csv > default_table.h
+ */
+
+// Include headers & libraries
+#include <cstdio>       // for standard input/output operations
+#include <cstdlib>      // for strtof
+#include <string>       // for std::string
+#include <vector>       // for std::vector
+#include "chipload.h"   // for external user defined functions
+
+// The generator has no embedded table of its own
+const ChiploadTable default_table = {};
+
+/**
+ * Formats a float as the shortest literal that reads back to the same float, ex.: 0.05f or 2.0f.
+ */
+static std::string FloatLiteral(float value) {
+    char literal[32];
+    for (int precision = 1; precision <= 9; precision++) {
+        snprintf(literal, sizeof(literal), "%.*g", precision, value);
+        if (strtof(literal, nullptr) == value) break;
+    }
+    std::string result = literal;
+    if (result.find_first_of(".e") == std::string::npos) result += ".0";
+    return result + "f";
+}
+
+/**
+ * Prints a constexpr array, with a placeholder element if it's empty (C++ has no zero sized arrays).
+ */
+template <typename T, typename Format>
+static void PrintArray(const char *type, const char *name, const std::vector<T> &values, Format format) {
+    printf("constexpr %s %s[] = {", type, name);
+    if (values.empty()) {
+        printf("0");
+    }
+    for (size_t i = 0; i < values.size(); i++) {
+        printf(i % 8 == 0 ? "\n    " : " ");
+        printf("%s,", format(values[i]).c_str());
+    }
+    printf("\n};\n\n");
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s ChiploadTable.csv > default_table.h\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<TableRow> rows;
+    TableData built;
+    if (!ReadTableRows(argv[1], rows)) {
+        fprintf(stderr, "Can't open file %s\n", argv[1]);
+        return 1;
+    }
+    if (!BuildTable(rows, built)) {
+        return 2;
+    }
+
+    printf("// default_table.h, generated by embed from %s, don't edit\n\n", argv[1]);
+    printf("constexpr unsigned int default_material_count = %zu;\n", built.name_offsets.size());
+    printf("constexpr unsigned int default_row_count = %zu;\n", built.diameters.size());
+    printf("constexpr unsigned int default_slot_count = %zu;\n\n", built.slots.size());
+
+    // The names as one string literal, each name is followed by its '\0' and the literal adds the last one
+    printf("constexpr char default_names[] =");
+    for (size_t id = 0; id < built.name_offsets.size(); id++) {
+        printf("\n    \"");
+        for (const char *c = built.names.c_str() + built.name_offsets[id]; *c; c++) {
+            if (*c == '"' || *c == '\\') printf("\\");
+            printf("%c", *c);
+        }
+        printf(id + 1 < built.name_offsets.size() ? "\\0\"" : "\"");
+    }
+    printf(built.name_offsets.empty() ? " \"\";\n\n" : ";\n\n");
+
+    auto integer = [](long long value) { return std::to_string(value); };
+    PrintArray("unsigned int", "default_name_offsets", built.name_offsets, integer);
+    PrintArray("unsigned int", "default_offsets", built.offsets, integer);
+    PrintArray("float", "default_diameters", built.diameters, FloatLiteral);
+    PrintArray("float", "default_chiploads", built.chiploads, FloatLiteral);
+    PrintArray("float", "default_factors", built.factors, FloatLiteral);
+    PrintArray("int", "default_slots", built.slots, integer);
+    return 0;
+}
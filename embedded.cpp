@@ -0,0 +1,23 @@
+/**
+ * This file contains the chipload table embedded at build time (see embed.cpp).
+ *
+ * default_table points to the constexpr arrays of default_table.h, so it's constant initialized
+ * and lookups into it read straight from .rodata, without opening or parsing any file.
+ */
+
+// Include headers & libraries
+#include "chipload.h"       // for external user defined functions
+#include "default_table.h"  // generated from ChiploadTable.csv
+
+extern constexpr ChiploadTable default_table = {
+    default_material_count,
+    default_row_count,
+    default_slot_count,
+    default_names,
+    default_name_offsets,
+    default_offsets,
+    default_diameters,
+    default_chiploads,
+    default_factors,
+    default_slots,
+};
@@ -0,0 +1,258 @@
+/**
+ * This file contains the following function definitions for the engagement of the tool in the material:
+ * - EngagementFactors
+ * - ParseEngagement
+ * - RunSweep
+ *
+ * The chiploads of the table are for a full slot, where the tooth enters the material at the thickest point of
+ * its path. With a radial engagement (stepover) ae under half the diameter D the tooth only takes the thin end
+ * of the arc, the thickest chip it cuts is smaller than the feed per tooth, so the feed per tooth can grow by
+ *
+ *     thinning = 1 / (2 * sqrt(r * (1 - r)))    r = ae / D, for r < 1/2 (1 otherwise)
+ *
+ * for the same chip. A ball nose tool only cuts with the effective diameter Deff = 2 * sqrt(ap * (D - ap)) at an
+ * axial depth ap under D / 2: the stepover is measured against Deff, and the chip thins again by Deff / D, so the
+ * thinning is also multiplied by D / Deff. The factor is capped at MAX_CHIP_THINNING.
+ *
+ * A sweep solves every tool of a tool map over a grid of stepovers and depths of cut. The grid is laid out as
+ * arrays (stepover, depth, thinning, effective diameter, chipload, cutting power), the engagement math runs over
+ * whole arrays, eight points at a time with AVX2 when the CPU has it, then each point is solved for its feeds.
+ */
+
+// Include headers & libraries
+#include <algorithm>    // for std::min
+#include <chrono>       // for timing the run
+#include <cmath>        // for sqrt
+#include <cstdio>       // for standard input/output operations
+#include <string>       // for std::string
+#include <string_view>  // for std::string_view
+#include <vector>       // for std::vector
+#include "chipload.h"   // for external user defined functions
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>  // for the AVX2 intrinsics
+#define HAVE_AVX2_KERNEL 1
+#endif
+
+/**
+ * Function: computes the chip-thinning factor and the effective diameter of each engagement.
+ *
+ * Parameters:
+ * @param diameter: The tool diameter in mm.
+ * @param ball_nose: true for a ball nose tool.
+ * @param stepover: The radial engagement of each point in mm.
+ * @param depth: The axial depth of cut of each point in mm.
+ * @param count: The number of points.
+ * @param thinning: The chip-thinning factor of each point.
+ * @param effective_diameter: The effective diameter of each point in mm.
+ */
+static void EngagementFactorsScalar(float diameter, bool ball_nose, const float *stepover, const float *depth, size_t count, float *thinning, float *effective_diameter) {
+    for (size_t i = 0; i < count; i++) {
+        float cutting = diameter;
+        if (ball_nose && depth[i] < diameter / 2) {
+            cutting = 2 * std::sqrt(depth[i] * (diameter - depth[i]));
+        }
+        float r = stepover[i] / cutting;
+        float factor = r < 0.5f ? 1 / (2 * std::sqrt(r * (1 - r))) : 1.0f;
+        factor *= diameter / cutting;
+        thinning[i] = std::min(factor, MAX_CHIP_THINNING); // a stepover of 0 gives an infinite factor, capped too
+        effective_diameter[i] = cutting;
+    }
+}
+
+#ifdef HAVE_AVX2_KERNEL
+__attribute__((target("avx2")))
+static void EngagementFactorsAvx2(float diameter, bool ball_nose, const float *stepover, const float *depth, size_t count, float *thinning, float *effective_diameter) {
+    const __m256 d = _mm256_set1_ps(diameter);
+    const __m256 half_d = _mm256_set1_ps(diameter / 2);
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 two = _mm256_set1_ps(2.0f);
+    const __m256 cap = _mm256_set1_ps(MAX_CHIP_THINNING);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 ap = _mm256_loadu_ps(depth + i);
+        __m256 cutting = d;
+        if (ball_nose) {
+            __m256 ball = _mm256_mul_ps(two, _mm256_sqrt_ps(_mm256_mul_ps(ap, _mm256_sub_ps(d, ap))));
+            cutting = _mm256_blendv_ps(d, ball, _mm256_cmp_ps(ap, half_d, _CMP_LT_OQ));
+        }
+        __m256 r = _mm256_div_ps(_mm256_loadu_ps(stepover + i), cutting);
+        __m256 radial = _mm256_div_ps(one, _mm256_mul_ps(two, _mm256_sqrt_ps(_mm256_mul_ps(r, _mm256_sub_ps(one, r)))));
+        __m256 factor = _mm256_blendv_ps(one, radial, _mm256_cmp_ps(r, half, _CMP_LT_OQ));
+        factor = _mm256_mul_ps(factor, _mm256_div_ps(d, cutting));
+        _mm256_storeu_ps(thinning + i, _mm256_min_ps(factor, cap));
+        _mm256_storeu_ps(effective_diameter + i, cutting);
+    }
+    EngagementFactorsScalar(diameter, ball_nose, stepover + i, depth + i, count - i, thinning + i, effective_diameter + i);
+}
+#endif
+
+/**
+ * Function: computes the chip-thinning factor and the effective diameter of each engagement, with AVX2 if the CPU supports it.
+ *
+ * Parameters:
+ * @param diameter: The tool diameter in mm.
+ * @param ball_nose: true for a ball nose tool.
+ * @param stepover: The radial engagement of each point in mm, over 0.
+ * @param depth: The axial depth of cut of each point in mm, over 0.
+ * @param count: The number of points.
+ * @param thinning: The chip-thinning factor of each point, the table chipload is multiplied by it.
+ * @param effective_diameter: The effective diameter of each point in mm.
+ */
+void EngagementFactors(float diameter, bool ball_nose, const float stepover[], const float depth[], size_t count, float thinning[], float effective_diameter[]) {
+#ifdef HAVE_AVX2_KERNEL
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    if (avx2) {
+        EngagementFactorsAvx2(diameter, ball_nose, stepover, depth, count, thinning, effective_diameter);
+        return;
+    }
+#endif
+    EngagementFactorsScalar(diameter, ball_nose, stepover, depth, count, thinning, effective_diameter);
+}
+
+/**
+ * Function: parses a stepover or a depth of cut, ex.: "10%" (of the tool diameter), "0.5" (in the tool unit).
+ *
+ * Parameters:
+ * @param field: The raw user input.
+ * @param diameter: The tool diameter in mm.
+ * @param unit: The unit of the tool diameter.
+ *
+ * Returns:
+ * @return The engagement in mm, 0 if the field holds no number.
+ */
+float ParseEngagement(std::string_view field, float diameter, LengthUnit unit) {
+    float value = CleanNumber(field);
+    if (field.find('%') != std::string_view::npos) {
+        return value / 100 * diameter;
+    }
+    return Convert(Length{value, unit}, UNIT_MM).value;
+}
+
+/**
+ * Function: parses a range of percentages written from:to:step, ex.: "5:50:5".
+ *
+ * Returns:
+ * @return true if the range has at least one value, false otherwise.
+ */
+static bool ParseRange(const std::string &text, std::vector<float> &values) {
+    float from, to, step;
+    if (sscanf(text.c_str(), "%f:%f:%f", &from, &to, &step) != 3 || from <= 0 || step <= 0 || to < from) {
+        return false;
+    }
+    values.clear();
+    for (int i = 0; from + i * step <= to + step / 1000; i++) {
+        values.push_back(from + i * step);
+    }
+    return true;
+}
+
+// Represents a point of a sweep, the feeds of a tool at one stepover and depth of cut
+struct SweepPoint {
+    size_t tool;            // index in the tool map
+    float stepover;         // % of the diameter
+    float depth;            // % of the diameter
+    float effective_diameter;
+    float thinning;
+    float chipload;         // after the chip-thinning correction
+    float power_per_feed;
+    CachedResult feeds;
+};
+
+/**
+ * Function: loads the chipload table and a tool map, then solves every tool over a grid of stepovers and depths of
+ * cut and writes the feeds of each point to a .csv file.
+ *
+ * Parameters:
+ * @param file_chipload: The chipload table .csv file.
+ * @param file_tools: The tool map .csv file (see LoadToolMap).
+ * @param file_output: The .csv file written, one row per tool, stepover and depth.
+ * @param stepovers: The stepovers, from:to:step in % of the tool diameter.
+ * @param depths: The depths of cut, from:to:step in % of the tool diameter.
+ *
+ * Returns:
+ * @return 0 if the sweep was written, otherwise the error code (1, 2, 3, 15 or 16 for a bad range).
+ */
+int RunSweep(const std::string &file_chipload, const std::string &file_tools, const std::string &file_output, const std::string &stepovers, const std::string &depths) {
+    std::vector<float> stepover_percent, depth_percent;
+    if (!ParseRange(stepovers, stepover_percent) || !ParseRange(depths, depth_percent)) {
+        printf("A range is from:to:step in %% of the tool diameter, ex.: %s\n", SWEEP_STEPOVERS);
+        return 16;
+    }
+    FuzzyIndex material_index;
+    std::vector<Tool> tools;
+    int error = LoadTableAndTools(file_chipload, file_tools, material_index, tools);
+    if (error != 0) {
+        return error;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    size_t grid = stepover_percent.size() * depth_percent.size();
+    std::vector<float> stepover(grid), depth(grid), thinning(grid), effective_diameter(grid), chipload(grid), power_per_feed(grid);
+    std::vector<SweepPoint> points;
+    points.reserve(tools.size() * grid);
+    for (size_t t = 0; t < tools.size(); t++) {
+        Tool &tool = tools[t];
+        tool.error = SolveJob(tool.job, material_index, machine, tool.result);
+        tool.solved = true;
+        if (tool.error != 0) {
+            fprintf(stderr, "%s: tool %ld can't be solved (error %d), skipped\n", file_tools.c_str(), tool.number, tool.error);
+            continue;
+        }
+        if (tool.result.specific_energy <= 0) {
+            fprintf(stderr, "%s: tool %ld, no cutting energy for %s, the spindle power isn't checked\n", file_tools.c_str(), tool.number, tool.result.material.c_str());
+        }
+
+        // The grid of the tool as arrays, in mm
+        const JobResult &base = tool.result;
+        for (size_t s = 0; s < stepover_percent.size(); s++) {
+            for (size_t d = 0; d < depth_percent.size(); d++) {
+                stepover[s * depth_percent.size() + d] = stepover_percent[s] / 100 * base.diameter;
+                depth[s * depth_percent.size() + d] = depth_percent[d] / 100 * base.diameter;
+            }
+        }
+        EngagementFactors(base.diameter, tool.job.ball_nose, stepover.data(), depth.data(), grid, thinning.data(), effective_diameter.data());
+        for (size_t i = 0; i < grid; i++) {
+            chipload[i] = base.chipload * thinning[i];
+            power_per_feed[i] = base.specific_energy * depth[i] * stepover[i] / 60;
+        }
+        for (size_t i = 0; i < grid; i++) {
+            points.push_back({t, stepover_percent[i / depth_percent.size()], depth_percent[i % depth_percent.size()],
+                              effective_diameter[i], thinning[i], chipload[i], power_per_feed[i], CachedResult{}});
+        }
+    }
+
+    // Solve the points, each one only writes its own slot
+    ParallelFor(points.size(), [&](size_t i) {
+        SweepPoint &point = points[i];
+        const JobResult &base = tools[point.tool].result;
+        SolveFeeds(machine, point.chipload, base.tool_teeth, base.speed, point.power_per_feed, point.feeds);
+    });
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    FILE *file = fopen(file_output.c_str(), "w");
+    if (file == nullptr) {
+        std::cerr << "Error opening file " << file_output << std::endl;
+        Unload();
+        return 15;
+    }
+    fprintf(file, "tool,material,diameter_mm,ball_nose,stepover_pct,depth_pct,effective_diameter_mm,thinning,chipload,rpm,feed_mm_per_min,power_w,mrr_cm3_per_min,feasible,limits\n");
+    for (const SweepPoint &point : points) {
+        const Tool &tool = tools[point.tool];
+        JobResult limits;
+        limits.binding = point.feeds.binding;
+        limits.power = point.feeds.power;
+        limits.spindle_power = point.feeds.spindle_power;
+        float removal = point.stepover / 100 * tool.result.diameter * point.depth / 100 * tool.result.diameter * point.feeds.feeds.y / 1000;
+        fprintf(file, "%ld,%s,%.3f,%s,%g,%g,%.3f,%.3f,%.4f,%d,%d,%.0f,%.2f,%s,%s\n", tool.number, tool.result.material.c_str(),
+                tool.result.diameter, tool.job.ball_nose ? "yes" : "no", point.stepover, point.depth, point.effective_diameter,
+                point.thinning, point.chipload, point.feeds.feeds.x, point.feeds.feeds.y, point.feeds.power, removal,
+                point.feeds.feasible ? "yes" : "no", DescribeLimits(limits).c_str());
+    }
+    bool written = fclose(file) == 0;
+    printf("Swept %zu tools over %zu stepovers and %zu depths (%zu points) in %.3f s\n", tools.size(), stepover_percent.size(),
+           depth_percent.size(), points.size(), seconds);
+    Unload();
+    return written ? 0 : 15;
+}
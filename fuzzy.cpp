@@ -0,0 +1,101 @@
+/**
+ * This file contains the following function definitions for fuzzy matching against a large dictionary:
+ * - BuildFuzzyIndex
+ * - FuzzyMatches
+ *
+ * The index is a BK-tree: every child of a node is stored under its Levenshtein distance to the node.
+ * Since the Levenshtein distance is a metric, when the query is at distance d of a node, an entry within
+ * distance r of the query can only sit under a child whose edge distance is in [d - r, d + r], the other
+ * subtrees are pruned without computing any distance.
+ */
+
+// Include headers & libraries
+#include <algorithm>    // for std::sort
+#include <string>       // for std::string
+#include <string_view>  // for std::string_view
+#include <vector>       // for std::vector
+#include "chipload.h"   // for external user defined functions
+
+/**
+ * Function: builds the BK-tree over a dictionary.
+ *
+ * Parameters:
+ * @param dictionary: The words to index, a match refers to a word by its index in this vector.
+ * @param index: The fuzzy index to build.
+ */
+void BuildFuzzyIndex(const std::vector<std::string> &dictionary, FuzzyIndex &index) {
+    index.words = dictionary;
+    index.nodes.clear();
+    index.nodes.reserve(dictionary.size());
+
+    for (size_t i = 0; i < dictionary.size(); i++) {
+        index.nodes.push_back({(int)i, {}});
+        if (i == 0) continue;
+
+        // Walk down from the root following the edge with the distance to each node
+        size_t node = 0;
+        while (true) {
+            int distance = LevenshteinDistance(dictionary[i], index.words[index.nodes[node].word]);
+            bool descended = false;
+            for (const auto &child : index.nodes[node].children) {
+                if (child.first == distance) {
+                    node = child.second;
+                    descended = true;
+                    break;
+                }
+            }
+            if (!descended) {
+                index.nodes[node].children.emplace_back(distance, (int)i);
+                break;
+            }
+        }
+    }
+}
+
+/**
+ * Function: finds the k words of the index closest to a query.
+ *
+ * Parameters:
+ * @param index: The fuzzy index to search.
+ * @param query: The word to match.
+ * @param max_distance: The maximum allowed Levenshtein distance for a match.
+ * @param k: The maximum number of matches.
+ *
+ * Returns:
+ * @return The matches sorted by distance, then by dictionary order (so the first one is what BestMatch would return).
+ */
+std::vector<Match> FuzzyMatches(const FuzzyIndex &index, std::string_view query, int max_distance, size_t k) {
+    std::vector<Match> matches;
+    if (index.nodes.empty() || k == 0) return matches;
+    matches.reserve(k + 1);
+
+    auto worse = [](const Match &a, const Match &b) {
+        return a.distance != b.distance ? a.distance < b.distance : a.index < b.index;
+    };
+
+    int radius = max_distance; // shrinks to the k-th best distance once k matches were found
+    thread_local std::vector<int> stack; // nodes left to visit, reused by the following queries of the thread
+    stack.assign(1, 0);
+    while (!stack.empty()) {
+        const FuzzyNode &node = index.nodes[stack.back()];
+        stack.pop_back();
+
+        // Above radius + the largest edge no child can hold a match, so the exact distance isn't needed
+        int largest_edge = 0;
+        for (const auto &child : node.children) largest_edge = std::max(largest_edge, child.first);
+        int distance = LevenshteinDistance(query, index.words[node.word], radius + largest_edge);
+        if (distance <= radius) {
+            matches.push_back({node.word, distance});
+            std::sort(matches.begin(), matches.end(), worse);
+            if (matches.size() > k) matches.pop_back();
+            if (matches.size() == k) radius = matches.back().distance;
+        }
+
+        for (const auto &child : node.children) {
+            if (child.first >= distance - radius && child.first <= distance + radius) {
+                stack.push_back(child.second);
+            }
+        }
+    }
+    return matches;
+}
@@ -0,0 +1,500 @@
+/**
+ * This file contains the following function definitions for processing G-code programs:
+ * - MapFile
+ * - UnmapFile
+ * - ParseGcodeLine
+ * - ReadGcodeState
+ * - ParseGcodePath
+ * - LoadToolMap
+ * - LoadTableAndTools
+ * - RunsAtToolFeed
+ * - ReplaceFeed
+ * - CopyGcodeLine
+ * - RewriteGcode
+ * - RunRewrite
+ *
+ * The rewriter streams a G-code program and replaces the F and S words with the feeds and speeds computed for
+ * the active tool. Tools come from a tool map (ToolMap.csv), one tool per line after a header line:
+ *
+ *     Tool, Material, Tool Diameter, Flutes, Job Quality, Stepover, Depth, Ball Nose
+ *     1, Soft Wood, 1/4 inches, 2, 3
+ *     3, Aluminium, 6 mm, 3, 3, 10%, 6, no
+ *
+ * The last three columns are optional, they describe the engagement of the tool (see engagement.cpp).
+ *
+ * A T word selects the next tool and M6 loads it (T and M6 may share the line). The feeds of a tool are solved
+ * the first time it's loaded. After a tool change every S word becomes its rpm, and every cutting move along X or
+ * Y runs at its feedrate in the current unit (mm/m after G21, inch/m after G20). F is modal, so the feedrate is
+ * written on the first such move after the program's feed was in effect (an F on its own line, or a plunge),
+ * and the program's last F is written back on the next other move, so plunges keep the plunge feed of the
+ * program. The cycle-time estimator plans with the same policy. Comments, in parentheses or after ';', are
+ * copied as they are.
+ *
+ * The rewriters, the cycle-time estimator and the stock simulator read a program with the same interpreter:
+ * ReadGcodeState for the modal words and tool changes, and ParseGcodePath for the straight or arc of each line.
+ *
+ * The input is memory mapped and read once from start to end, the output is collected in a buffer written in
+ * large blocks, so memory use doesn't depend on the size of the program.
+ */
+
+// Include headers & libraries
+#include <algorithm>    // for std::find_if, std::copy and std::max
+#include <cctype>       // for character handling functions
+#include <charconv>     // for std::from_chars
+#include <chrono>       // for timing the run
+#include <cmath>        // for sqrt, atan2 and fabs
+#include <cstdio>       // for standard input/output operations
+#include <cstdlib>      // for strtol
+#include <cstring>      // for memchr
+#include <fstream>      // for reading the tool map
+#include <string>       // for std::string
+#include <vector>       // for std::vector
+#include <fcntl.h>      // for open
+#include <sys/mman.h>   // for mmap
+#include <sys/stat.h>   // for fstat
+#include <unistd.h>     // for close
+#include "chipload.h"   // for external user defined functions
+
+#define TOOL_MAP_FIELDS 8   // tool number, material, diameter, flutes, job quality, stepover, depth, ball nose
+
+/**
+ * Function: maps a whole file read only, for reading it once from start to end.
+ *
+ * Parameters:
+ * @param filename: The file to map.
+ * @param size: The size of the file.
+ *
+ * Returns:
+ * @return The contents of the file, or nullptr if it can't be opened or is empty.
+ */
+const char *MapFile(const std::string &filename, size_t &size) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return nullptr;
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0) {
+        close(fd);
+        return nullptr;
+    }
+    size = file_stat.st_size;
+    void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        return nullptr;
+    }
+    madvise(mapped, size, MADV_SEQUENTIAL);
+    return static_cast<const char *>(mapped);
+}
+
+void UnmapFile(const char *data, size_t size) {
+    munmap(const_cast<char *>(data), size);
+}
+
+/**
+ * Function: splits a line of G-code in words (a letter and a number), skipping comments.
+ *
+ * Parameters:
+ * @param begin: The start of the line.
+ * @param end: The end of the line, without the newline.
+ * @param words: The words found, in order (at most MAX_GCODE_WORDS).
+ *
+ * Returns:
+ * @return The number of words found.
+ */
+int ParseGcodeLine(const char *begin, const char *end, GcodeWord words[]) {
+    int count = 0;
+    const char *p = begin;
+    while (p < end) {
+        char c = *p;
+        if (c == '(') {                     // comment up to the closing parenthesis
+            const char *close = static_cast<const char *>(memchr(p, ')', end - p));
+            p = close ? close + 1 : end;
+            continue;
+        }
+        if (c == ';') {                     // comment up to the end of the line
+            break;
+        }
+        if (!isalpha(static_cast<unsigned char>(c))) {
+            p++;
+            continue;
+        }
+        const char *number = p + 1;
+        while (number < end && (*number == ' ' || *number == '\t')) number++;
+        if (number < end && *number == '+') number++;      // from_chars doesn't take the plus sign
+        double value;
+        auto [number_end, error] = std::from_chars(number, end, value, std::chars_format::fixed); // no exponent, E is a word
+        if (error != std::errc()) {
+            p++;
+            continue;
+        }
+        if (count < MAX_GCODE_WORDS) {
+            words[count++] = {static_cast<char>(toupper(static_cast<unsigned char>(c))), p, number_end, value};
+        }
+        p = number_end;
+    }
+    return count;
+}
+
+/**
+ * Function: applies the modal words of a line (G0 to G3, G20, G21, G90, G91, T and F) to the state of the program,
+ * the interpreter shared by the rewriters and the cycle-time estimator.
+ *
+ * Parameters:
+ * @param state: The modal state, updated except for the position (see ParseGcodePath).
+ * @param words: The words of the line.
+ * @param count: The number of words.
+ *
+ * Returns:
+ * @return What the line does besides its motion: tool change, axes and F word.
+ */
+GcodeLine ReadGcodeState(GcodeState &state, const GcodeWord words[], int count) {
+    GcodeLine line = {false, false, false, nullptr};
+    for (int i = 0; i < count; i++) {
+        char letter = words[i].letter;
+        double value = words[i].value;
+        switch (letter) {
+            case 'G':
+                if (value == 0 || value == 1 || value == 2 || value == 3) state.motion = (int)value;
+                if (value == 20) state.inches = true;
+                if (value == 21) state.inches = false;
+                if (value == 90) state.relative = false;
+                if (value == 91) state.relative = true;
+                break;
+            case 'M':
+                if (value == 6) line.tool_change = true;
+                break;
+            case 'T':
+                state.next_tool = (long)value;
+                break;
+            case 'F':
+                if (line.feed == nullptr) line.feed = &words[i];
+                break;
+        }
+        if (letter == 'X' || letter == 'Y') line.moves_xy = true;
+        if (letter >= 'X' && letter <= 'Z') line.moves = true;
+    }
+    // A G20 or G21 on the line of the F word applies to it
+    if (line.feed != nullptr) state.feed = line.feed->value * (state.inches ? 25.4 : 1.0);
+    return line;
+}
+
+/**
+ * Function: turns the motion of a line into a path, a straight along X, Y and Z or an arc in the XY plane
+ * around start + (I, J) with a helix along Z. The cycle-time estimator takes its tangents, the stock simulator
+ * cuts it in chords.
+ *
+ * Parameters:
+ * @param state: The modal state (see ReadGcodeState), its position moves to the target.
+ * @param words: The words of the line.
+ * @param count: The number of words.
+ * @param path: The path of the line.
+ *
+ * Returns:
+ * @return true if the line moves the machine, false otherwise.
+ */
+bool ParseGcodePath(GcodeState &state, const GcodeWord words[], int count, GcodePath &path) {
+    double scale = state.inches ? 25.4 : 1.0;
+    double target[3] = {state.position[0], state.position[1], state.position[2]};
+    double offset[2] = {0, 0};
+    bool moves = false;
+    for (int i = 0; i < count; i++) {
+        int axis = words[i].letter - 'X';
+        if (axis >= 0 && axis < 3) {
+            target[axis] = (state.relative ? target[axis] : 0) + words[i].value * scale;
+            moves = true;
+        }
+        if (words[i].letter == 'I') offset[0] = words[i].value * scale;
+        if (words[i].letter == 'J') offset[1] = words[i].value * scale;
+    }
+    if (!moves) return false;
+
+    const double *start = state.position;
+    double delta[3] = {target[0] - start[0], target[1] - start[1], target[2] - start[2]};
+    std::copy(start, start + 3, path.start);
+    std::copy(target, target + 3, path.target);
+    path.radius = sqrt(offset[0] * offset[0] + offset[1] * offset[1]);
+    path.arc = (state.motion == 2 || state.motion == 3) && path.radius > 1e-6;
+    if (path.arc) {
+        bool clockwise = state.motion == 2;
+        path.center[0] = start[0] + offset[0];
+        path.center[1] = start[1] + offset[1];
+        path.start_angle = atan2(start[1] - path.center[1], start[0] - path.center[0]);
+        path.sweep = atan2(target[1] - path.center[1], target[0] - path.center[0]) - path.start_angle;
+        if (clockwise && path.sweep >= 0) path.sweep -= 2 * M_PI;
+        if (!clockwise && path.sweep <= 0) path.sweep += 2 * M_PI;
+        path.length_xy = path.radius * fabs(path.sweep);
+        path.length = sqrt(path.length_xy * path.length_xy + delta[2] * delta[2]);
+    } else {
+        path.length_xy = sqrt(delta[0] * delta[0] + delta[1] * delta[1]);
+        path.length = sqrt(delta[0] * delta[0] + delta[1] * delta[1] + delta[2] * delta[2]);
+        if (path.length < 1e-9) return false;
+    }
+    std::copy(target, target + 3, state.position);
+    return true;
+}
+
+/**
+ * Function: loads a tool map, rows that don't make sense are skipped with a message.
+ *
+ * Parameters:
+ * @param filename: The tool map .csv file.
+ * @param tools: The tools, in file order.
+ *
+ * Returns:
+ * @return true if the file was read, false if it can't be opened.
+ */
+bool LoadToolMap(const std::string &filename, std::vector<Tool> &tools) {
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    std::string line;
+    std::getline(file, line); // Skip the header line
+    for (int line_number = 2; std::getline(file, line); line_number++) {
+        if (line.find_first_not_of(" \t\r,") == std::string::npos) continue; // Skip empty lines
+        std::string_view views[TOOL_MAP_FIELDS] = {};
+        size_t count = SplitFields(line, ',', views, TOOL_MAP_FIELDS);
+        std::string fields[TOOL_MAP_FIELDS];
+        for (size_t i = 0; i < TOOL_MAP_FIELDS; i++) fields[i] = TrimBlanks(views[i]);
+        char *number_end;
+        long number = strtol(fields[0].c_str(), &number_end, 10);
+        if (count < 5 || number_end == fields[0].c_str() || *number_end != '\0' || number < 0) {
+            fprintf(stderr, "%s:%d: tool skipped, expected tool number, material, tool diameter, flutes and job quality\n", filename.c_str(), line_number);
+            continue;
+        }
+        Tool tool;
+        tool.number = number;
+        tool.job.material = fields[1];
+        tool.job.tool = fields[2];
+        tool.job.tool_teeth = fields[3];
+        tool.job.job_quality = fields[4];
+        tool.job.out_unit = "mm/m";
+        tool.job.stepover = fields[5];
+        tool.job.depth = fields[6];
+        tool.job.ball_nose = fields[7].find_first_of("yY") != std::string::npos;
+        tools.push_back(tool);
+    }
+    return true;
+}
+
+/**
+ * Function: loads the chipload table, the fuzzy index over its materials and a tool map, the start of the modes
+ * that work with a tool map.
+ *
+ * Parameters:
+ * @param file_chipload: The chipload table .csv file.
+ * @param file_tools: The tool map .csv file.
+ * @param material_index: The fuzzy index over the materials.
+ * @param tools: The tools, in file order.
+ *
+ * Returns:
+ * @return 0 with the table loaded (Unload it when done), otherwise 1, 2 or 3 with a message and the table unloaded.
+ */
+int LoadTableAndTools(const std::string &file_chipload, const std::string &file_tools, FuzzyIndex &material_index, std::vector<Tool> &tools) {
+    int error = LoadMaterialIndex(file_chipload, material_index);
+    if (error != 0) {
+        return error;
+    }
+    if (!LoadToolMap(file_tools, tools)) {
+        std::cerr << "Error opening file " << file_tools << std::endl;
+        Unload();
+        return 3;
+    }
+    return 0;
+}
+
+/**
+ * Function: the feed policy shared by the rewriters and the cycle-time estimator.
+ *
+ * Parameters:
+ * @param motion: The modal motion, 0 to 3 for G0 to G3.
+ * @param moves_xy: true if the line has an X or Y word.
+ * @param active: The loaded tool, nullptr if it isn't in the tool map.
+ *
+ * Returns:
+ * @return true if the move runs at the feedrate computed for the tool, false if it keeps the feed of the program.
+ */
+bool RunsAtToolFeed(int motion, bool moves_xy, const Tool *active) {
+    return motion != 0 && moves_xy && active != nullptr && active->error == 0;
+}
+
+/**
+ * Function: decides the F word of a line of a program whose feeds are replaced, and tracks the modal feed.
+ *
+ * Parameters:
+ * @param modal: The modal feed, updated.
+ * @param tool_word: The F word of the tool if the line runs at the tool's feed (see RunsAtToolFeed), otherwise nullptr.
+ * @param moves: true if the line moves the machine.
+ * @param feed: The F word of the line, nullptr if it has none.
+ *
+ * Returns:
+ * @return The F word the line must carry (replacing its F word or added to it), or nullptr to copy it as it is.
+ */
+const char *ReplaceFeed(ModalFeed &modal, const char *tool_word, bool moves, const GcodeWord *feed) {
+    if (feed != nullptr) modal.program.assign(feed->begin, feed->end);
+    if (tool_word != nullptr) {
+        bool write = feed != nullptr || modal.current != tool_word;
+        modal.current = tool_word;
+        return write ? tool_word : nullptr;
+    }
+    if (feed != nullptr) {
+        modal.current = modal.program;
+    } else if (moves && modal.current != modal.program && !modal.program.empty()) {
+        modal.current = modal.program;
+        return modal.program.c_str(); // back to the feed of the program
+    }
+    return nullptr;
+}
+
+/**
+ * Function: copies a line of G-code, replacing its S words and its first F word, or adding the F word after its last word.
+ *
+ * Parameters:
+ * @param output: The output.
+ * @param line: The start of the line.
+ * @param next_line: The start of the next line (after the newline).
+ * @param words: The words of the line.
+ * @param count: The number of words.
+ * @param f_word: The F word, nullptr to keep the F words.
+ * @param s_word: The S word, nullptr to keep the S words.
+ *
+ * Returns:
+ * @return true if the line was changed, false if it was copied as it is.
+ */
+bool CopyGcodeLine(GcodeOutput &output, const char *line, const char *next_line, const GcodeWord words[], int count, const char *f_word, const char *s_word) {
+    const char *copied = line;
+    bool changed = false;
+    for (int i = 0; i < count; i++) {
+        const char *replacement = nullptr;
+        if (words[i].letter == 'S') replacement = s_word;
+        if (words[i].letter == 'F') replacement = f_word;
+        if (replacement == nullptr) continue;
+        output.Append(copied, words[i].begin);
+        output.Append(replacement, replacement + strlen(replacement));
+        copied = words[i].end;
+        changed = true;
+        if (words[i].letter == 'F') f_word = nullptr;
+    }
+    if (f_word != nullptr && count > 0) {
+        output.Append(copied, words[count - 1].end);
+        output.Append(" ", " " + 1);
+        output.Append(f_word, f_word + strlen(f_word));
+        copied = words[count - 1].end;
+        changed = true;
+    }
+    output.Append(copied, next_line);
+    return changed;
+}
+
+/**
+ * Function: rewrites the F and S words of a G-code program for the tools of a tool map.
+ *
+ * Parameters:
+ * @param file_input: The G-code program.
+ * @param file_output: The rewritten program.
+ * @param tools: The tool map (see LoadToolMap), the feeds of each tool are solved when it's first loaded.
+ * @param material_index: The fuzzy index over the materials.
+ * @param machine: The machine profile to solve for.
+ *
+ * Returns:
+ * @return 0 if the program was rewritten, 3 if it can't be read or 15 if it can't be written.
+ */
+int RewriteGcode(const std::string &file_input, const std::string &file_output, std::vector<Tool> &tools, const FuzzyIndex &material_index, const Machine &machine) {
+    size_t size = 0;
+    const char *data = MapFile(file_input, size);
+    if (data == nullptr) {
+        std::cerr << "Error opening file " << file_input << std::endl;
+        return 3;
+    }
+    GcodeOutput output = {fopen(file_output.c_str(), "wb"), std::string()};
+    if (output.file == nullptr) {
+        std::cerr << "Error opening file " << file_output << std::endl;
+        UnmapFile(data, size);
+        return 15;
+    }
+    output.buffer.reserve(GCODE_BUFFER + MAX_LINE_LENGTH);
+
+    auto start = std::chrono::steady_clock::now();
+    GcodeState state;               // the position isn't needed, only the modal words
+    Tool *active = nullptr;         // loaded by the last M6, nullptr if it isn't in the tool map
+    char f_word[32] = "";           // replacement F and S words of the active tool
+    char s_word[32] = "";
+    ModalFeed modal;
+    size_t lines = 0, rewritten = 0;
+    GcodeWord words[MAX_GCODE_WORDS];
+
+    const char *end = data + size;
+    for (const char *line = data; line < end;) {
+        const char *newline = static_cast<const char *>(memchr(line, '\n', end - line));
+        const char *line_end = newline ? newline : end;
+        int count = ParseGcodeLine(line, line_end, words);
+        lines++;
+
+        // Modal state and tool changes, before rewriting the words of this line
+        bool was_inches = state.inches;
+        GcodeLine parsed = ReadGcodeState(state, words, count);
+        long next_tool = state.next_tool;
+        if (parsed.tool_change) {
+            auto found = std::find_if(tools.begin(), tools.end(), [&](const Tool &tool) { return tool.number == next_tool; });
+            active = found == tools.end() ? nullptr : &*found;
+            if (active == nullptr) {
+                fprintf(stderr, "%s:%zu: tool %ld isn't in the tool map, its F and S words are kept\n", file_input.c_str(), lines, next_tool);
+            } else if (!active->solved) {
+                active->error = SolveJob(active->job, material_index, machine, active->result);
+                active->solved = true;
+                if (active->error != 0) {
+                    fprintf(stderr, "%s:%zu: tool %ld can't be solved (error %d), its F and S words are kept\n", file_input.c_str(), lines, next_tool, active->error);
+                }
+            }
+        }
+        if (parsed.tool_change || state.inches != was_inches) {
+            if (active != nullptr && active->error == 0) {
+                float feed_rate = Convert(FeedRate{(float)active->result.feeds.y, UNIT_MM_M}, state.inches ? UNIT_IN_M : UNIT_MM_M).value;
+                snprintf(f_word, sizeof(f_word), state.inches ? "F%.2f" : "F%.1f", feed_rate);
+                snprintf(s_word, sizeof(s_word), "S%d", active->result.feeds.x);
+            } else {
+                f_word[0] = s_word[0] = '\0';
+            }
+        }
+
+        // Copy the line, with the F word of the feed policy and the S word of the tool
+        const char *tool_word = RunsAtToolFeed(state.motion, parsed.moves_xy, active) ? f_word : nullptr;
+        const char *replacement = ReplaceFeed(modal, tool_word, parsed.moves, parsed.feed);
+        const char *next_line = newline ? newline + 1 : end;
+        rewritten += CopyGcodeLine(output, line, next_line, words, count, replacement, s_word[0] != '\0' ? s_word : nullptr);
+        line = next_line;
+    }
+    output.Flush();
+    UnmapFile(data, size);
+    bool written = !output.failed && fclose(output.file) == 0;
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("Rewrote %zu of %zu lines in %.3f s (%.0f MB/s)\n", rewritten, lines, seconds, size / 1e6 / std::max(seconds, 1e-9));
+    return written ? 0 : 15;
+}
+
+/**
+ * Function: loads the chipload table and a tool map, then rewrites the F and S words of a G-code program.
+ *
+ * Parameters:
+ * @param file_chipload: The chipload table .csv file.
+ * @param file_tools: The tool map .csv file.
+ * @param file_input: The G-code program.
+ * @param file_output: The rewritten program.
+ *
+ * Returns:
+ * @return 0 if the program was rewritten, otherwise the error code (1, 2, 3 or 15).
+ */
+int RunRewrite(const std::string &file_chipload, const std::string &file_tools, const std::string &file_input, const std::string &file_output) {
+    FuzzyIndex material_index;
+    std::vector<Tool> tools;
+    int error = LoadTableAndTools(file_chipload, file_tools, material_index, tools);
+    if (error != 0) {
+        return error;
+    }
+    error = RewriteGcode(file_input, file_output, tools, material_index, machine);
+    Unload();
+    return error;
+}
@@ -0,0 +1,225 @@
+/**
+ * This file contains the following function definitions for the feasible region map:
+ * - ClassifyRow
+ * - WriteFeasibleMap
+ * - RunMap
+ *
+ * The map evaluates a grid of rpm (the machine speed range, left to right) by feedrate (0 at the bottom
+ * to MAP_FEED_MARGIN times the max feed at the top, so the machine limit shows) for each job, and classifies
+ * every cell against the same constraints as is_feasible:
+ * - CELL_FEASIBLE     lower_bound * rpm <= feed <= upper_bound * rpm and feed <= max feed
+ * - CELL_RUBBING      feed < lower_bound * rpm, the chipload is too thin and the tool rubs
+ * - CELL_OVERLOADING  feed > upper_bound * rpm, the chipload is too thick for the tool
+ * - CELL_OVER_LIMIT   feed > max feed, over the machine limit
+ *
+ * A row of the grid has a single feedrate, so the rpm dependent bounds are computed once per column and the
+ * row is classified with two comparisons per cell, eight cells at a time with AVX2 when the CPU has it.
+ */
+
+// Include headers & libraries
+#include <algorithm>    // for std::max
+#include <chrono>       // for timing the run
+#include <cstdio>       // for standard input/output operations
+#include <cstring>      // for memset
+#include <string>       // for std::string
+#include <vector>       // for std::vector
+#include "chipload.h"   // for external user defined functions
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>  // for the AVX2 intrinsics
+#define HAVE_AVX2_KERNEL 1
+#endif
+
+#define MAP_FEED_MARGIN 1.25f   // the feed axis goes 25% over the max feed
+
+// Gray level of each cell class in a .pgm map, in the order of the CELL_ defines
+static const unsigned char cell_gray[] = {255, 170, 85, 0};
+
+/**
+ * Function: classifies a row of cells, one comparison against each chipload straight per cell.
+ *
+ * Parameters:
+ * @param feed: The feedrate of the row, in mm/m.
+ * @param upper: The upper bound feed of each column (upper_bound * rpm).
+ * @param lower: The lower bound feed of each column (lower_bound * rpm).
+ * @param count: The number of columns.
+ * @param cells: The class of each cell.
+ */
+static void ClassifyRowScalar(float feed, const float *upper, const float *lower, int count, unsigned char *cells) {
+    for (int i = 0; i < count; i++) {
+        cells[i] = (feed < lower[i] ? CELL_RUBBING : 0) | (feed > upper[i] ? CELL_OVERLOADING : 0);
+    }
+}
+
+#ifdef HAVE_AVX2_KERNEL
+__attribute__((target("avx2")))
+static void ClassifyRowAvx2(float feed, const float *upper, const float *lower, int count, unsigned char *cells) {
+    const __m256 y = _mm256_set1_ps(feed);
+    const __m256i rubbing = _mm256_set1_epi32(CELL_RUBBING);
+    const __m256i overloading = _mm256_set1_epi32(CELL_OVERLOADING);
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    int i = 0;
+
+    // 32 cells per iteration: four vectors of eight 32 bit classes packed down to 32 bytes
+    for (; i + 32 <= count; i += 32) {
+        __m256i classes[4];
+        for (int k = 0; k < 4; k++) {
+            __m256 below = _mm256_cmp_ps(y, _mm256_loadu_ps(lower + i + 8 * k), _CMP_LT_OQ);
+            __m256 above = _mm256_cmp_ps(y, _mm256_loadu_ps(upper + i + 8 * k), _CMP_GT_OQ);
+            classes[k] = _mm256_or_si256(_mm256_and_si256(_mm256_castps_si256(below), rubbing),
+                                         _mm256_and_si256(_mm256_castps_si256(above), overloading));
+        }
+        __m256i packed = _mm256_packs_epi16(_mm256_packs_epi32(classes[0], classes[1]), _mm256_packs_epi32(classes[2], classes[3]));
+        packed = _mm256_permutevar8x32_epi32(packed, order); // the packs work per 128 bit lane, restore the column order
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(cells + i), packed);
+    }
+    ClassifyRowScalar(feed, upper + i, lower + i, count - i, cells + i);
+}
+#endif
+
+/**
+ * Function: classifies a row of cells, with AVX2 if the CPU supports it.
+ *
+ * Parameters:
+ * @param feed: The feedrate of the row, in mm/m.
+ * @param upper: The upper bound feed of each column (upper_bound * rpm).
+ * @param lower: The lower bound feed of each column (lower_bound * rpm).
+ * @param count: The number of columns.
+ * @param y_max: The machine feedrate limit, rows above it are CELL_OVER_LIMIT.
+ * @param cells: The class of each cell.
+ */
+void ClassifyRow(float feed, const float *upper, const float *lower, int count, float y_max, unsigned char *cells) {
+    if (feed > y_max) {
+        memset(cells, CELL_OVER_LIMIT, count);
+        return;
+    }
+#ifdef HAVE_AVX2_KERNEL
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    if (avx2) {
+        ClassifyRowAvx2(feed, upper, lower, count, cells);
+        return;
+    }
+#endif
+    ClassifyRowScalar(feed, upper, lower, count, cells);
+}
+
+/**
+ * Function: evaluates the feasible region map of a solved job and writes it as a .pgm image or a .csv matrix.
+ *
+ * Parameters:
+ * @param filename: The file to write, a binary .pgm (one gray level per class) if it ends in .pgm, a .csv otherwise
+ *                  (a header row with the rpm of each column, then the feedrate and the class of each cell per row).
+ * @param result: The solved job, its chipload straights bound the feasible region.
+ * @param machine: The machine profile the job was solved for.
+ * @param columns: The number of rpm steps.
+ * @param rows: The number of feedrate steps.
+ *
+ * Returns:
+ * @return true if the map was written, false otherwise.
+ */
+bool WriteFeasibleMap(const std::string &filename, const JobResult &result, const Machine &machine, int columns, int rows) {
+    columns = std::max(columns, 2);
+    rows = std::max(rows, 2);
+    const float feed_top = MAP_FEED_MARGIN * machine.max_feed;
+
+    // Bounds of each column, shared by every row
+    std::vector<float> rpm(columns), upper(columns), lower(columns);
+    for (int i = 0; i < columns; i++) {
+        rpm[i] = machine.min_speed + (float)(machine.max_speed - machine.min_speed) * i / (columns - 1);
+        upper[i] = result.upper_bound * rpm[i];
+        lower[i] = result.lower_bound * rpm[i];
+    }
+
+    // Rows from the highest feedrate down, the way an image is stored
+    std::vector<unsigned char> cells((size_t)columns * rows);
+    auto feed_of = [&](size_t row) { return feed_top * (rows - 1 - row) / (rows - 1); };
+    ParallelFor(rows, [&](size_t row) {
+        ClassifyRow(feed_of(row), upper.data(), lower.data(), columns, machine.max_feed, &cells[row * columns]);
+    });
+
+    FILE *file = fopen(filename.c_str(), "wb");
+    if (file == nullptr) {
+        std::cerr << "Error opening file " << filename << std::endl;
+        return false;
+    }
+    bool pgm = filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".pgm") == 0;
+    if (pgm) {
+        for (unsigned char &cell : cells) cell = cell_gray[cell];
+        fprintf(file, "P5\n# %s %.2f %s (%d flutes) on %s, rpm %d to %d, feed %.0f to 0 mm/m\n%d %d\n255\n",
+                result.material.c_str(), result.tool_diameter, result.tool_unit.c_str(), result.tool_teeth,
+                machine.name.c_str(), machine.min_speed, machine.max_speed, feed_top, columns, rows);
+        fwrite(cells.data(), 1, cells.size(), file);
+    } else {
+        std::string text = "feed\\rpm";
+        char number[32];
+        for (int i = 0; i < columns; i++) {
+            snprintf(number, sizeof(number), ",%.0f", rpm[i]);
+            text += number;
+        }
+        text += '\n';
+        for (int row = 0; row < rows; row++) {
+            snprintf(number, sizeof(number), "%.1f", feed_of(row));
+            text += number;
+            for (int i = 0; i < columns; i++) {
+                text += ',';
+                text += (char)('0' + cells[(size_t)row * columns + i]);
+            }
+            text += '\n';
+            if (text.size() >= (1 << 20)) {
+                fwrite(text.data(), 1, text.size(), file);
+                text.clear();
+            }
+        }
+        fwrite(text.data(), 1, text.size(), file);
+    }
+    return fclose(file) == 0;
+}
+
+/**
+ * Function: solves every job of a jobs file and writes the feasible region map of each one.
+ * With a single job the map is written to file_output, otherwise to file_output with the job number
+ * before the extension (ex.: map_1.pgm, map_2.pgm, ...).
+ *
+ * Parameters:
+ * @param file_chipload: The chipload table .csv file.
+ * @param file_jobs: The jobs file (see ReadJobsFromFile).
+ * @param file_output: The .pgm or .csv map file.
+ * @param columns: The number of rpm steps.
+ * @param rows: The number of feedrate steps.
+ *
+ * Returns:
+ * @return 0 if every map was written, otherwise the first error code found.
+ */
+int RunMap(const std::string &file_chipload, const std::string &file_jobs, const std::string &file_output, int columns, int rows) {
+    FuzzyIndex material_index;
+    std::vector<Job> jobs;
+    int error = LoadTableAndJobs(file_chipload, file_jobs, material_index, jobs);
+    if (error != 0) {
+        return error;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    int first_error = 0;
+    size_t dot = file_output.find_last_of('.');
+    std::string stem = dot == std::string::npos ? file_output : file_output.substr(0, dot);
+    std::string extension = dot == std::string::npos ? "" : file_output.substr(dot);
+    for (size_t i = 0; i < jobs.size(); i++) {
+        JobResult result;
+        int error = SolveJob(jobs[i], material_index, machine, result);
+        if (error != 0 && error != 14) { // a bad output unit doesn't change the feasible region
+            printf("Job %zu: error %d, no map\n", i + 1, error);
+            if (first_error == 0) first_error = error;
+            continue;
+        }
+        std::string filename = jobs.size() == 1 ? file_output : stem + "_" + std::to_string(i + 1) + extension;
+        if (!WriteFeasibleMap(filename, result, machine, columns, rows)) {
+            Unload();
+            return 15;
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("Mapped %zu jobs of %d x %d cells in %.3f s\n", jobs.size(), columns, rows, seconds);
+
+    Unload();
+    return first_error;
+}
@@ -4,12 +4,14 @@
 #include <cstdlib>      // for memory allocation
 #include <cstring>      // for string manipulation functions
 #include <string>       // for std::string
+#include <string_view>  // for std::string_view
+#include <charconv>     // for std::from_chars
 #include <vector>       // for std::vector
+#include <algorithm>    // for std::min and std::max
+#include <climits>      // for INT_MAX
+#include <cstdint>      // for uint64_t
 #include "chipload.h"   // for external user defined functions
 
-// external variable
-extern Node *table[N_BUCKETS]; // Ensure this is declared somewhere in your code
-
 /**
  * Function: initializes unique materials by checking and adding them to the unique_materials array.
  * 
@@ -21,98 +23,178 @@ extern Node *table[N_BUCKETS]; // Ensure this is declared somewhere in your code
  * @return true if the initialization is successful, false otherwise.
  */
 bool UniqueElements(std::vector<std::string> &unique_materials, unsigned int *material_counter) {
-    unique_materials.clear(); // Clear the vector to start fresh
-    *material_counter = 0;
-
-    for (unsigned int i = 0; i < N_BUCKETS; i++) {
-        Node *cursor = table[i];
-        while (cursor != NULL) {
-            bool unique = true;
-            // check if the material is already in the unique_materials vector
-            for (unsigned int j = 0; j < unique_materials.size(); j++) {
-                if (strcasecmp(cursor->material.c_str(), unique_materials[j].c_str()) == 0) {
-                    unique = false;
-                    break;
-                }
-            }
-            // If the material is unique, add it to the unique_materials vector
-            if (unique) {
-                unique_materials.push_back(cursor->material);
-                (*material_counter)++;
-            }
-            cursor = cursor->next;
-        }
+    // Materials are interned when loaded, the table already holds each of them once
+    unique_materials.clear();
+    for (unsigned int id = 0; id < table.material_count; id++) {
+        unique_materials.push_back(table.names + table.name_offsets[id]);
     }
+    *material_counter = unique_materials.size();
     return true;
 }
 
+/**
+ * Function: loads the chipload table and builds the fuzzy index over its materials, the start of every mode.
+ * 
+ * Parameters:
+ * @param file_chipload: The chipload table .csv file.
+ * @param material_index: The fuzzy index over the materials.
+ * 
+ * Returns:
+ * @return 0 with the table loaded (Unload it when done), otherwise 1 or 2 with a message and the table unloaded.
+ */
+int LoadMaterialIndex(const std::string &file_chipload, FuzzyIndex &material_index) {
+    if (!Load(file_chipload)) {
+        printf("Failed to Load materials\n");
+        return 1;
+    }
+    std::vector<std::string> unique_materials;
+    unsigned int unique_materials_count = 0;
+    if (!UniqueElements(unique_materials, &unique_materials_count)) {
+        printf("Memory allocation for unique materials has failed\n");
+        Unload();
+        return 2;
+    }
+    BuildFuzzyIndex(unique_materials, material_index);
+    return 0;
+}
+
+/**
+ * Function: hands out the next bytes of the arena.
+ * 
+ * Parameters:
+ * @param size: The bytes wanted, shrunk to what's left of the arena.
+ * 
+ * Returns:
+ * @return The start of the bytes handed out.
+ */
+char *Arena::Allocate(size_t &size) {
+    size = std::min(size, sizeof(buffer) - used);
+    char *block = buffer + used;
+    used += size;
+    return block;
+}
+
+/**
+ * Function: frees everything the arena handed out, for the next request.
+ */
+void Arena::Reset() {
+    used = 0;
+}
+
 /**
  * Function: cleans a string by retaining only alphabetical characters.
  * 
  * Parameters:
  * @param source: The input string to be cleaned.
+ * @param arena: The arena of the request, the cleaned string is copied into it.
  * 
- * Description:
- * This function iterates through the input string and copies only the alphabetical characters to the destination array.
- * It null-terminates the cleaned string at the end.
+ * Returns:
+ * @return The cleaned string, a view into the arena (cut short if the arena is full).
  */
-void CleanString(std::string &source) {
-    std::string result;
-    for (char c : source) {
-        if (isalpha(static_cast<unsigned char>(c))) {
-            result += c;
+std::string_view CleanString(std::string_view source, Arena &arena) {
+    size_t size = source.size();
+    char *cleaned = arena.Allocate(size);
+    size_t length = 0;
+    for (size_t i = 0; i < source.size() && length < size; i++) {
+        if (isalpha(static_cast<unsigned char>(source[i]))) {
+            cleaned[length++] = source[i];
         }
     }
-    source = result;
+    return std::string_view(cleaned, length);
+}
+
+// Skips spaces and tabs
+static const char *SkipBlanks(const char *p, const char *end) {
+    while (p < end && (*p == ' ' || *p == '\t')) p++;
+    return p;
 }
 
 /**
- * Function: cleans the input string by extracting and processing numbers, including fractions and floating-point numbers.
+ * Function: extracts the number of a field: an integer or decimal ("6 mm", "3.175mm"), a fraction ("1/4 inches")
+ * or a mixed number ("1 1/4 in", "1-1/4 in"). Text before the number, a sign included, is skipped.
  * 
  * Parameters:
  * @param source: The input string containing the number to be cleaned.
  * 
  * Returns:
- * @return The cleaned number as a float after processing any fractions or decimal points present in the input string.
+ * @return The number, or 0 if there is none or the denominator is 0. It never throws nor allocates.
  */
-float CleanNumber(const std::string &source) {
-    std::string cleanedStr;
-    bool has_decimal_point = false;
-    bool has_fraction = false;
-    int numerator = 0;
-    int denominator = 0;
-    size_t fraction_pos = source.find('/');
+float CleanNumber(std::string_view source) {
+    const char *end = source.data() + source.size();
+    const char *p = source.data();
+    while (p < end && !isdigit(static_cast<unsigned char>(*p)) && *p != '.') p++;
+    double value;
+    auto [number_end, error] = std::from_chars(p, end, value, std::chars_format::fixed);
+    if (error != std::errc()) {
+        return 0.0;
+    }
 
-    // If it's a fraction
-    if (fraction_pos != std::string::npos) {
-        try {
-            numerator = std::stoi(source.substr(0, fraction_pos));
-            denominator = std::stoi(source.substr(fraction_pos + 1));
-            if (denominator == 0) throw std::invalid_argument("Denominator cannot be zero.");
-            return static_cast<float>(numerator) / denominator;
-        } catch (const std::exception &e) {
-            std::cerr << "Exception in CleanNumber (fraction): " << e.what() << std::endl;
-            return 0.0;
+    // After a blank or a dash, a number followed by a slash is the fraction of a mixed number
+    double whole = 0;
+    double numerator = value;
+    p = SkipBlanks(number_end, end);
+    const char *next = p < end && *p == '-' ? SkipBlanks(p + 1, end) : p;
+    if (next > number_end && next < end && *next != '/') {
+        double fraction;
+        auto [fraction_end, fraction_error] = std::from_chars(next, end, fraction, std::chars_format::fixed);
+        const char *slash = SkipBlanks(fraction_end, end);
+        if (fraction_error == std::errc() && slash < end && *slash == '/') {
+            whole = value;
+            numerator = fraction;
+            p = slash;
         }
     }
 
-    // If it's a decimal or integer
-    for (char c : source) {
-        if (isdigit(static_cast<unsigned char>(c))) {
-            cleanedStr += c;
-        } else if (c == '.' && !has_decimal_point) {
-            cleanedStr += c;
-            has_decimal_point = true;
+    // If it's a fraction
+    if (p < end && *p == '/') {
+        p = SkipBlanks(p + 1, end);
+        double denominator;
+        auto [denominator_end, denominator_error] = std::from_chars(p, end, denominator, std::chars_format::fixed);
+        if (denominator_error != std::errc() || denominator == 0) {
+            return 0.0;
         }
+        return static_cast<float>(whole + numerator / denominator);
     }
+    return static_cast<float>(value);
+}
 
-    try {
-        if (cleanedStr.empty()) throw std::invalid_argument("No digits found in the input string.");
-        return std::stof(cleanedStr);
-    } catch (const std::exception &e) {
-        std::cerr << "Exception in CleanNumber (decimal/integer): " << e.what() << std::endl;
-        return 0.0;
+/**
+ * Function: splits a line at a separator without copying it.
+ * 
+ * Parameters:
+ * @param line: The line to split.
+ * @param separator: The separator, ex.: ',' or ';'.
+ * @param fields: The fields, views into the line. Fields past the last one of the line are left as they are.
+ * @param max_fields: The size of fields, the fields after it are counted but not stored.
+ * 
+ * Returns:
+ * @return The number of fields in the line.
+ */
+size_t SplitFields(std::string_view line, char separator, std::string_view fields[], size_t max_fields) {
+    size_t count = 0;
+    while (true) {
+        size_t found = line.find(separator);
+        if (count < max_fields) fields[count] = line.substr(0, found);
+        count++;
+        if (found == std::string_view::npos) break;
+        line.remove_prefix(found + 1);
     }
+    return count;
+}
+
+/**
+ * Function: removes the blanks around a field, ex.: a field of SplitFields.
+ * 
+ * Parameters:
+ * @param field: The field.
+ * 
+ * Returns:
+ * @return The field without its leading and trailing spaces, tabs and carriage returns.
+ */
+std::string_view TrimBlanks(std::string_view field) {
+    size_t first = field.find_first_not_of(" \t\r");
+    if (first == std::string_view::npos) return field.substr(field.size());
+    return field.substr(first, field.find_last_not_of(" \t\r") - first + 1);
 }
 
 /**
@@ -125,45 +207,132 @@ int min(int a, int b, int c) {
 }
 
 /**
- * Function: calculates the Levenshtein distance between two input strings.
+ * Function: calculates the Levenshtein distance with the bit-parallel algorithm of Myers (in Hyyrö's formulation).
+ * The columns of the dynamic programming matrix are kept as bit vectors of vertical deltas, so each character
+ * of the text costs a handful of word operations. The pattern must be 1 to 64 characters long.
  * 
  * Parameters:
- * @param string1: The first input string.
- * @param string2: The second input string.
+ * @param pattern: The shorter input string.
+ * @param text: The longer input string.
+ * @param max_distance: The distance above which the calculation stops.
  * 
  * Returns:
- * @return The Levenshtein distance between the two input strings.
+ * @return The Levenshtein distance, or max_distance + 1 if it's above max_distance.
  */
-int LevenshteinDistance(const std::string &string1, const std::string &string2) {
+static int MyersDistance(std::string_view pattern, std::string_view text, int max_distance) {
+    int m = pattern.length();
+    int n = text.length();
+
+    // Bit masks of the positions of each character in the pattern, zeroed on every call: the 2 KB on the stack
+    // cost less than a per-thread table cleared entry by entry
+    uint64_t peq[256] = {};
+    for (int i = 0; i < m; i++) {
+        peq[tolower(static_cast<unsigned char>(pattern[i]))] |= uint64_t(1) << i;
+    }
+
+    uint64_t pv = ~uint64_t(0);     // positive vertical deltas
+    uint64_t mv = 0;                // negative vertical deltas
+    uint64_t last = uint64_t(1) << (m - 1);
+    int score = m;
+
+    for (int j = 0; j < n; j++) {
+        uint64_t eq = peq[tolower(static_cast<unsigned char>(text[j]))];
+        uint64_t xv = eq | mv;
+        uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+        uint64_t ph = mv | ~(xh | pv);
+        uint64_t mh = pv & xh;
+        if (ph & last) score++;
+        else if (mh & last) score--;
+        ph = (ph << 1) | 1;         // the first row grows by one per text character
+        mh <<= 1;
+        pv = mh | ~(xv | ph);
+        mv = ph & xv;
+
+        // Each remaining character lowers the score by one at most
+        if (score - (n - j - 1) > max_distance) {
+            return max_distance + 1;
+        }
+    }
+    return score;
+}
+
+/**
+ * Function: calculates the Levenshtein distance two rows at a time, for strings too long for MyersDistance.
+ * The rows live on the stack up to MAX_LINE_LENGTH characters, longer strings reuse a per-thread buffer.
+ * 
+ * Parameters:
+ * @param string1: The shorter input string.
+ * @param string2: The longer input string.
+ * @param max_distance: The distance above which the calculation stops.
+ * 
+ * Returns:
+ * @return The Levenshtein distance, or max_distance + 1 if it's above max_distance.
+ */
+static int TwoRowDistance(std::string_view string1, std::string_view string2, int max_distance) {
     int len1 = string1.length();
     int len2 = string2.length();
-    int **d = (int **)malloc((len1 + 1) * sizeof(int *));
-    for (int i = 0; i <= len1; i++) {
-        d[i] = (int *)malloc((len2 + 1) * sizeof(int));
+
+    int stack_rows[2 * (MAX_LINE_LENGTH + 1)];
+    thread_local std::vector<int> heap_rows;
+    int *rows = stack_rows;
+    if (len1 > MAX_LINE_LENGTH) {
+        if (heap_rows.size() < 2 * size_t(len1 + 1)) heap_rows.resize(2 * size_t(len1 + 1));
+        rows = heap_rows.data();
     }
+    int *previous = rows;
+    int *current = rows + len1 + 1;
 
-    for (int i = 0; i <= len1; i++) d[i][0] = i;
-    for (int j = 0; j <= len2; j++) d[0][j] = j;
+    for (int i = 0; i <= len1; i++) previous[i] = i;
 
-    for (int i = 1; i <= len1; i++) {
-        for (int j = 1; j <= len2; j++) {
+    for (int j = 1; j <= len2; j++) {
+        current[0] = j;
+        int row_min = current[0];
+        for (int i = 1; i <= len1; i++) {
             int cost = (tolower(static_cast<unsigned char>(string1[i - 1])) == tolower(static_cast<unsigned char>(string2[j - 1]))) ? 0 : 1;
-            d[i][j] = min(
-                d[i - 1][j] + 1,    // Deletion
-                d[i][j - 1] + 1,    // Insertion
-                d[i - 1][j - 1] + cost // Substitution
+            current[i] = min(
+                previous[i] + 1,        // Deletion
+                current[i - 1] + 1,     // Insertion
+                previous[i - 1] + cost  // Substitution
             );
+            row_min = std::min(row_min, current[i]);
+        }
+        // The distance never goes below the smallest value of a row
+        if (row_min > max_distance) {
+            return max_distance + 1;
         }
+        std::swap(previous, current);
     }
+    return previous[len1] > max_distance ? max_distance + 1 : previous[len1];
+}
 
-    int distance = d[len1][len2];
+/**
+ * Function: calculates the case insensitive Levenshtein distance between two input strings, without allocating memory.
+ * 
+ * Parameters:
+ * @param string1: The first input string.
+ * @param string2: The second input string.
+ * @param max_distance: The distance above which the calculation stops early (optional).
+ * 
+ * Returns:
+ * @return The Levenshtein distance between the two input strings, or max_distance + 1 if it's above max_distance.
+ */
+int LevenshteinDistance(std::string_view string1, std::string_view string2, int max_distance) {
+    CountMetric(METRIC_LEVENSHTEIN_CALLS);
+    std::string_view shorter = string1.length() <= string2.length() ? string1 : string2;
+    std::string_view longer = string1.length() <= string2.length() ? string2 : string1;
+    max_distance = std::max(max_distance, 0);
 
-    for (int i = 0; i <= len1; i++) {
-        free(d[i]);
+    // The distance is at least the difference in length
+    if ((int)(longer.length() - shorter.length()) > max_distance) {
+        return max_distance + 1;
     }
-    free(d);
-
-    return distance;
+    if (shorter.empty()) {
+        return longer.length();
+    }
+    if (shorter.length() <= 64) {
+        return MyersDistance(shorter, longer, max_distance);
+    }
+    return TwoRowDistance(shorter, longer, max_distance);
 }
 
 /**
@@ -175,80 +344,23 @@ int LevenshteinDistance(const std::string &string1, const std::string &string2)
  * @param max_distance: The maximum allowed Levenshtein distance for a valid match.
  * 
  * Returns:
- * @return the best matching unit from the vector based on the Levenshtein distance, or "error" if no match is found.
+ * @return the index of the best matching unit in the vector based on the Levenshtein distance, or -1 if no match is found.
  */
-std::string BestMatch(const std::string &source, const std::vector<std::string> &dictionary, int max_distance) {
-    int min_distance = LevenshteinDistance(source, dictionary[0]);
-    std::string best_match = dictionary[0];
+int BestMatch(std::string_view source, const std::vector<std::string> &dictionary, int max_distance) {
+    int min_distance = LevenshteinDistance(source, dictionary[0], max_distance);
+    int best_match = 0;
 
     for (size_t i = 1; i < dictionary.size(); i++) {
-        int distance = LevenshteinDistance(source, dictionary[i]);
+        // Only a distance below the best one so far matters
+        int distance = LevenshteinDistance(source, dictionary[i], std::min(min_distance - 1, max_distance));
         if (distance < min_distance && distance <= max_distance) {
             min_distance = distance;
-            best_match = dictionary[i];
+            best_match = i;
         }
     }
     if (min_distance > max_distance) {
-        return "error";
+        return -1;
     }
     
     return best_match;
 }
-
-// struct with units and a multiplier that compares to mm/s
-struct conversion {
-    std::string unit;
-    float multiplier;
-} conversions[] = {
-    {"mm", (1.0 / 1.0)},
-    {"in", (25.4 / 1.0)},
-    {"inch", (25.4 / 1.0)},
-    {"inches", (25.4 / 1.0)},
-    {"mm/s", (1.0 / 1.0)},
-    {"mm/m", (1.0 / 60.0)},
-    {"m/m", (1000.0 / 60.0)},
-    {"in/s", (25.4 / 1.0)},
-    {"in/m", (25.4 / 60.0)},
-    {"inch/s", (25.4 / 1.0)},
-    {"inch/m", (25.4 / 60.0)},
-    {"feet/m", (304.8 / 60.0)},
-};
-
-/**
- * Function: converts a given value from one unit to another based on predefined conversion factors.
- * 
- * Parameters:
- * @param value: The numerical value to be converted.
- * @param from: The unit of the input value.
- * @param to: The unit to convert the value to.
- * 
- * Returns:
- * @return The converted value after applying the appropriate conversion factor.
- * @return Returns -1 if either the 'from' or 'to' unit is not found in the predefined conversion table.
- */
-float Convert(float value, const std::string &from, const std::string &to)
-{
-    int size = sizeof(conversions) / sizeof(conversions[0]);
-    float from_multiplier = -1;
-    float to_multiplier = -1;
-
-    for (int i = 0; i < size; ++i) {
-        if (conversions[i].unit == from) {
-            from_multiplier = conversions[i].multiplier;
-            break;
-        }
-    }
-
-    for (int j = 0; j < size; ++j) {
-        if (conversions[j].unit == to) {
-            to_multiplier = conversions[j].multiplier;
-            break;
-        }
-    }
-
-    if (from_multiplier == -1 || to_multiplier == -1) {
-        return -1;
-    } else {
-        return value * (from_multiplier / to_multiplier);
-    }
-}
@@ -0,0 +1,252 @@
+/**
+ * This file contains the following function definitions for solving a single feeds and speeds job:
+ * - SolveFeeds
+ * - SearchAndSolve
+ * - SolveJob
+ *
+ * SolveJob holds the clean, match, search, solve and convert steps of the program so that main
+ * and the batch mode share them. It doesn't print nor write to the output file, the caller reports
+ * the error and warning codes, which makes it safe to run on several threads at once.
+ * Cleaning and matching don't allocate: the cleaned fields are views into an arena on the stack of the job, and
+ * the unit matches are indices into the unit names.
+ * Once a job is cleaned and matched, the search, solve and convert steps go through the result cache (see cache.cpp).
+ */
+
+// Include headers & libraries
+#include <string>       // for std::string
+#include <string_view>  // for std::string_view
+#include <vector>       // for std::vector
+#include "chipload.h"   // for external user defined functions
+
+/**
+ * Function: solves the feeds of a chipload for the job quality, within the machine limits and the spindle power.
+ *
+ * Parameters:
+ * @param machine: The machine profile to solve for.
+ * @param chipload: The chipload, after the chip-thinning correction.
+ * @param tool_z: The number of flutes.
+ * @param speed: The job quality, 6 in beginner mode.
+ * @param power_per_feed: The cutting power in W per mm/m of feed, 0 for no power constraint.
+ * @param cached: The results, sets the bounds, feeds, binding constraints and power.
+ *
+ * Returns:
+ * @return true if the feeds are feasible, false otherwise (warning 15, or 18 if the spindle power alone rules them out).
+ */
+bool SolveFeeds(const Machine &machine, float chipload, float tool_z, float speed, float power_per_feed, CachedResult &cached) {
+    float upper_bound = 0.5 * (chipload + machine.max_deviation) * tool_z;    // upper bound chipload straight slope
+    float lower_bound = 0.5 * (chipload - machine.max_deviation) * tool_z;    // lower bound chipload straight slope
+    cached.upper_bound = upper_bound;
+    cached.lower_bound = lower_bound;
+    cached.power_per_feed = power_per_feed;
+    cached.binding = 0;
+    bool feasible;        // false if the feasible region is empty
+    switch ((int)speed) {
+    case 1: // MAX FINISH
+    case 2: // FINISH
+    case 4: // MATERIAL REMOVAL
+    case 5: // MAX MATERIAL REMOVAL
+        feasible = Simplex(machine, upper_bound, lower_bound, cached.power_per_feed, false, cached.feeds, &cached.binding);
+        break;
+
+    case 6: // BEGGINER MODE, SIMILAR TO DEFAULT BUT LESS CHIPLOAD (x0.5) AND REDUCED FEEDRATE (x0.625)
+        cached.feeds = Midpoint(machine, chipload * tool_z, cached.power_per_feed);
+        cached.feeds.x = 0.9 * cached.feeds.x;    // lower rpm
+        cached.feeds.y = 0.5 * cached.feeds.y;    // lower feedrate significantly
+        feasible = cached.feeds.x != 0 && cached.feeds.y != 0;
+        break;
+
+    default: // BALANCED TOOL LIFE OPTIMIZATION (case 3 or other)
+        cached.feeds = Midpoint(machine, chipload * tool_z, cached.power_per_feed, &cached.binding);
+        feasible = cached.feeds.x != 0 && cached.feeds.y != 0;
+        break;
+    }
+    cached.power = cached.power_per_feed * cached.feeds.y;
+    cached.spindle_power = SpindlePower(machine, cached.feeds.x);
+    cached.power_exceeded = cached.power > cached.spindle_power + 1;
+    if (cached.power_exceeded) {
+        feasible = false; // the chipload needs more power than the spindle has at this rpm
+    }
+    if (cached.feeds.y > machine.max_feed) {
+        feasible = false; // Midpoint keeps the chipload, a thick one can ask for more than the max feedrate
+    }
+    if (!feasible && !cached.power_exceeded && power_per_feed > 0) {
+        // An empty region, the spindle power emptied it if the machine limits alone leave room
+        Point unbounded;
+        cached.power_exceeded = Simplex(machine, upper_bound, lower_bound, 0, false, unbounded, nullptr);
+    }
+    cached.feasible = feasible;
+    return feasible;
+}
+
+/**
+ * Function: searches the chipload of a normalized job, solves its feeds and converts the feedrate, the part
+ * of a job the result cache keeps.
+ *
+ * Parameters:
+ * @param material: The matched material.
+ * @param diameter: The tool diameter in mm.
+ * @param tool_z: The number of flutes.
+ * @param speed: The job quality, 6 in beginner mode.
+ * @param stepover: The radial engagement in mm.
+ * @param depth: The axial depth of cut in mm.
+ * @param thinning: The chip-thinning factor of the engagement (see engagement.cpp).
+ * @param feed_unit: The output unit.
+ * @param machine: The machine profile to solve for.
+ * @param timer: The stage timer of the job, in the search stage.
+ *
+ * Returns:
+ * @return The results, with error 13 if the material isn't in the chipload table.
+ */
+static CachedResult SearchAndSolve(const std::string &material, float diameter, float tool_z, float speed, float stepover, float depth, float thinning,
+                                   FeedUnit feed_unit, const Machine &machine, StageTimer &timer) {
+    CachedResult cached = {};
+    DiameterMatch match;
+    if (!Search(material, diameter, cached.chipload, cached.rpm_factor, &match)) {
+        cached.error = 13;
+        return cached;
+    }
+    cached.diameter_match = match;
+
+    // Calculate the feeds based on the job quality, see main for the scenarios. The table chipload is for a full
+    // slot, a lighter engagement cuts a thinner chip, so the tool takes more feed per tooth for the same chip
+    timer.Next(STAGE_SOLVE);
+    cached.specific_energy = SpecificCuttingEnergy(material);
+    float power_per_feed = cached.specific_energy * depth * stepover / 60; // the material removed per mm of feed
+    SolveFeeds(machine, cached.chipload * thinning, tool_z, speed, power_per_feed, cached);
+
+    // Convert the feedrate to the desired output unit
+    timer.Next(STAGE_CONVERT);
+    cached.feed_rate = Convert(FeedRate{(float)cached.feeds.y, UNIT_MM_M}, feed_unit).value;
+    return cached;
+}
+
+/**
+ * Function: solves a job, from the raw user input to the feedrate and rpm in the desired units.
+ *
+ * Parameters:
+ * @param job: The raw user input for the job.
+ * @param material_index: The fuzzy index over the materials loaded into the chipload table.
+ * @param machine: The machine profile to solve for.
+ * @param result: The job outcome, filled as far as the job got.
+ *
+ * Returns:
+ * @return 0 on success, otherwise the error code the program exits with (14 is reported as a warning).
+ */
+int SolveJob(const Job &job, const FuzzyIndex &material_index, const Machine &machine, JobResult &result) {
+    // Clean and extract numerical values, the cleaned fields live in the arena of the request
+    StageTimer timer(STAGE_CLEAN);
+    Arena arena;
+    std::string_view material = CleanString(job.material, arena);
+    std::string_view tool_unit = CleanString(job.tool, arena);
+    float tool_diameter = CleanNumber(job.tool);
+    float tool_z = CleanNumber(job.tool_teeth);
+    float speed = CleanNumber(job.job_quality);
+    std::string_view out_unit = CleanString(job.out_unit, arena);
+
+    // Error checking
+    if (material.empty()) {
+        return result.error = 4;
+    } else if (tool_diameter == 0) {
+        return result.error = 8;
+    } else if (tool_unit.empty()) {
+        return result.error = 5;
+    } else if (tool_z > 4 || tool_z <= 0) {
+        result.warnings.push_back(7);
+        tool_z = 2;
+    } else if (speed != 1 && speed != 2 && speed != 3 && speed != 4 && speed != 5) {
+        result.warnings.push_back(speed == 0 ? 9 : 10);
+    } else if (out_unit.empty()) {
+        result.warnings.push_back(6);
+        out_unit = "mm/m";
+    }
+    result.tool_diameter = tool_diameter;
+    result.tool_teeth = tool_z;
+    result.speed = speed;
+
+    // Convert tool diameter
+    timer.Next(STAGE_MATCH);
+    int tool_unit_match = BestMatch(tool_unit, length_unit_names, MAX_UNIT_DISTANCE);
+    LengthUnit length_unit;
+    if (tool_unit_match < 0 || !ParseLengthUnit(length_unit_names[tool_unit_match], length_unit)) {
+        result.tool_unit = "error";
+        return result.error = 11;
+    }
+    result.tool_unit = length_unit_names[tool_unit_match];
+    timer.Next(STAGE_CONVERT);
+    result.diameter = Convert(Length{tool_diameter, length_unit}, UNIT_MM).value;
+
+    // Engagement, a full slot as deep as half the diameter unless given, and its chip-thinning factor
+    result.stepover = ParseEngagement(job.stepover, result.diameter, length_unit);
+    result.depth = ParseEngagement(job.depth, result.diameter, length_unit);
+    if (result.stepover <= 0 || result.stepover > result.diameter) {
+        result.stepover = result.diameter;
+    }
+    if (result.depth <= 0) {
+        result.depth = result.diameter / 2;
+    }
+    EngagementFactors(result.diameter, job.ball_nose, &result.stepover, &result.depth, 1, &result.thinning, &result.effective_diameter);
+
+    // Find best material match
+    timer.Next(STAGE_MATCH);
+    result.suggestions = FuzzyMatches(material_index, material, MAX_MATERIAL_DISTANCE, N_SUGGESTIONS);
+    if (result.suggestions.empty()) {
+        return result.error = 12;
+    }
+    result.material = material_index.words[result.suggestions[0].index];
+
+    // Match the output unit, the last parameter of the cache key (a bad unit is only reported after the search)
+    int out_unit_match = BestMatch(out_unit, feed_unit_names, MAX_UNIT_DISTANCE);
+    FeedUnit feed_unit = UNIT_MM_M;
+    bool unit_matched = out_unit_match >= 0 && ParseFeedUnit(feed_unit_names[out_unit_match], feed_unit);
+    result.out_unit = out_unit_match >= 0 ? feed_unit_names[out_unit_match] : "error";
+    if (job.beginner) {
+        speed = 6; // begginer mode
+    }
+
+    // The normalized job decides everything from here on, solve it unless it's in the result cache
+    timer.Next(STAGE_SEARCH);
+    CacheKey key = MakeCacheKey(result.material, result.diameter, tool_z, speed, unit_matched ? feed_unit : -1,
+                                result.stepover, result.depth, job.ball_nose, machine);
+    CachedResult cached;
+    if (!LookupResult(key, cached)) {
+        cached = SearchAndSolve(result.material, result.diameter, tool_z, speed, result.stepover, result.depth, result.thinning, feed_unit, machine, timer);
+        StoreResult(key, cached);
+    }
+    if (cached.error != 0) {
+        return result.error = cached.error;
+    }
+    result.chipload = cached.chipload;
+    result.rpm_factor = cached.rpm_factor;
+    result.upper_bound = cached.upper_bound;
+    result.lower_bound = cached.lower_bound;
+    result.specific_energy = cached.specific_energy;
+    result.power_per_feed = cached.power_per_feed;
+    result.power = cached.power;
+    result.spindle_power = cached.spindle_power;
+    result.binding = cached.binding;
+    result.feeds = cached.feeds;
+
+    // The chipload of a diameter outside the rows of the material is the one of the nearest row
+    if (cached.diameter_match == DIAMETER_CLAMPED) {
+        result.warnings.push_back(16);
+    }
+
+    // Without the cutting energy of the material the spindle power isn't a constraint, say so
+    if (cached.specific_energy <= 0) {
+        result.warnings.push_back(17);
+    }
+
+    // Handles edge case where Point Feeds is out of feasible region, the spindle power and the feed limits apart
+    if (cached.power_exceeded) {
+        result.warnings.push_back(18);
+    }
+    if (!cached.feasible && (!cached.power_exceeded || cached.feeds.y > machine.max_feed)) {
+        result.warnings.push_back(15);
+    }
+    if (!unit_matched) {
+        return result.error = 14;
+    }
+    result.feed_rate = cached.feed_rate;
+
+    return 0;
+}
@@ -1,148 +1,632 @@
 #include <iostream>     // for standard C++ library for input and output
+#include <algorithm>    // for std::sort, std::lower_bound and std::fill
 #include <cctype>       // for character handling functions
 #include <cstdio>       // for standard input/output operations
 #include <cstdlib>      // for memory allocation
 #include <cstring>      // for string manipulation functions
 #include <string>       // for std::string
+#include <charconv>     // for std::from_chars
+#include <cmath>        // for std::isfinite
+#include <iterator>     // for std::back_inserter
+#include <thread>       // for std::thread::hardware_concurrency
+#include <fcntl.h>      // for open
+#include <sys/mman.h>   // for mmap
+#include <sys/stat.h>   // for fstat
+#include <unistd.h>     // for close
 #include "chipload.h"   // for external user defined functions
 
-// Hash table
-Node* table[N_BUCKETS];
+// Chipload table, and the arrays it points to when it isn't the embedded table
+ChiploadTable table;
+static TableData loaded;
+
+// Hash of the contents of the table, it identifies the table in the result cache (see cache.cpp)
+uint64_t table_hash = 0;
+
+// Table pinned by the calling thread while the chipload table is hot reloaded (see reload.cpp), and its hash
+thread_local const ChiploadTable *pinned_table = nullptr;
+thread_local uint64_t pinned_table_hash = 0;
 
 // Variables for future use
-unsigned int material_count = 0;         // positive integer counter for the number of unique materials loaded into memory
+unsigned int material_count = 0;         // positive integer counter for the number of rows loaded into memory
 unsigned int unique_materials_count = 0; // positive integer counter for the number of unique materials loaded into memory
 
 /**
- * Calculate the Hash value for a given word using the djb2 Hash function.
+ * Calculate the Hash value for a given word using the djb2 Hash function (case insensitive).
  * 
  * @param word The word for which the Hash value needs to be calculated.
- * @return The Hash value of the word.
+ * @return The Hash value of the word, the caller masks it to the index size.
  */
 unsigned int Hash(const std::string &word)
 {
     unsigned long hash_value = 5381;
     for (char c : word)
     {
-        hash_value = ((hash_value << 5) + hash_value) + toupper(c); // hash_value * 33 + c
+        hash_value = ((hash_value << 5) + hash_value) + toupper(static_cast<unsigned char>(c)); // hash_value * 33 + c
     }
-    return hash_value % N_BUCKETS;
+    return hash_value;
 }
 
 /**
- * Load material data from a CSV file into a Hash table.
+ * Probe an open addressing index for a material.
  * 
- * @param filename The name of the CSV file to Load data from.
- * @return true if the data is loaded successfully, false otherwise.
+ * @param slots The index, material id or -1 if empty.
+ * @param slot_count The size of the index, a power of two.
+ * @param name_of Returns the name of a material id.
+ * @param material The material to look for (case insensitive).
+ * @param probes If not null, incremented by the number of slots looked at (the chain length).
+ * @return The slot holding the material id, or the empty slot where it would be inserted.
  */
-bool Load(const std::string& filename)
+template <typename NameOf>
+static unsigned int Probe(const int *slots, unsigned int slot_count, NameOf name_of, const std::string &material, unsigned int *probes = nullptr)
+{
+    unsigned int mask = slot_count - 1;
+    unsigned int slot = Hash(material) & mask;
+    unsigned int looked_at = 1;
+    while (slots[slot] != -1 && strcasecmp(name_of(slots[slot]), material.c_str()) != 0)
+    {
+        slot = (slot + 1) & mask; // linear probing
+        looked_at++;
+    }
+    if (probes != nullptr)
+    {
+        *probes += looked_at;
+    }
+    return slot;
+}
+
+/**
+ * Build a chipload table from rows: intern the materials, group the rows per material and sort them by diameter.
+ * Rows repeating a material and diameter already present are skipped (the first one is kept).
+ * 
+ * @param rows The rows to build the table from, in file order.
+ * @param built The arrays of the table to build.
+ * @return true if the table was built, false if memory allocation failed.
+ */
+bool BuildTable(const std::vector<TableRow> &rows, TableData &built)
 {
-    FILE *file = fopen(filename.c_str(), "r");
-    if (!file)
+    try
+    {
+        built = TableData();
+        std::vector<std::string> materials;
+        auto name_of = [&](int id) { return materials[id].c_str(); };
+
+        // Intern the materials in order of first appearance, the index doubles whenever it gets half full
+        std::vector<unsigned int> ids(rows.size());
+        built.slots.assign(16, -1);
+        for (size_t i = 0; i < rows.size(); i++)
+        {
+            unsigned int slot = Probe(built.slots.data(), built.slots.size(), name_of, rows[i].material);
+            if (built.slots[slot] == -1)
+            {
+                materials.push_back(rows[i].material);
+                if (2 * materials.size() > built.slots.size())
+                {
+                    built.slots.assign(2 * built.slots.size(), -1);
+                    for (size_t id = 0; id + 1 < materials.size(); id++)
+                    {
+                        built.slots[Probe(built.slots.data(), built.slots.size(), name_of, materials[id])] = id;
+                    }
+                    slot = Probe(built.slots.data(), built.slots.size(), name_of, rows[i].material);
+                }
+                built.slots[slot] = materials.size() - 1;
+            }
+            ids[i] = built.slots[slot];
+        }
+
+        // Shrink the index to the number of materials
+        size_t n_slots = 2;
+        while (n_slots < 2 * materials.size()) n_slots *= 2;
+        if (n_slots != built.slots.size())
+        {
+            built.slots.assign(n_slots, -1);
+            for (size_t id = 0; id < materials.size(); id++)
+            {
+                built.slots[Probe(built.slots.data(), built.slots.size(), name_of, materials[id])] = id;
+            }
+        }
+
+        // Store the names one after the other
+        for (const std::string &material : materials)
+        {
+            built.name_offsets.push_back(built.names.size());
+            built.names += material;
+            built.names += '\0';
+        }
+
+        // Group the rows per material (counting sort, keeps the file order) then sort each group by diameter,
+        // the row index breaks ties so the first of repeated rows comes first
+        std::vector<unsigned int> group(materials.size() + 1, 0);
+        for (unsigned int id : ids) group[id + 1]++;
+        for (size_t id = 1; id < group.size(); id++) group[id] += group[id - 1];
+        std::vector<std::pair<float, unsigned int>> order(rows.size());
+        std::vector<unsigned int> next(group.begin(), group.end() - 1);
+        for (size_t i = 0; i < rows.size(); i++)
+        {
+            order[next[ids[i]]++] = {rows[i].diameter, (unsigned int)i};
+        }
+
+        // Every material has at least one row, so each offset is set once its last row is stored
+        built.offsets.assign(materials.size() + 1, 0);
+        built.diameters.reserve(rows.size());
+        built.chiploads.reserve(rows.size());
+        built.factors.reserve(rows.size());
+        for (size_t id = 0; id < materials.size(); id++)
+        {
+            std::sort(order.begin() + group[id], order.begin() + group[id + 1]);
+            for (unsigned int k = group[id]; k < group[id + 1]; k++)
+            {
+                if (k > group[id] && order[k - 1].first == order[k].first)
+                {
+                    continue; // Skip if material and diameter are already present
+                }
+                const TableRow &row = rows[order[k].second];
+                built.diameters.push_back(row.diameter);
+                built.chiploads.push_back(row.chipload);
+                built.factors.push_back(row.factor);
+            }
+            built.offsets[id + 1] = built.diameters.size();
+        }
+    }
+    catch (const std::bad_alloc &)
     {
-        printf("Can't open file\n");
+        printf("Failed to allocate memory for the LookupTable chipload data structure\n");
+        built = TableData();
         return false;
     }
+    return true;
+}
+
+/**
+ * Point a chipload table to the arrays of a table built at runtime.
+ * 
+ * @param built The arrays of the table, they must outlive the view.
+ * @return The chipload table.
+ */
+ChiploadTable TableView(const TableData &built)
+{
+    ChiploadTable view;
+    view.material_count = built.name_offsets.size();
+    view.row_count = built.diameters.size();
+    view.slot_count = built.slots.size();
+    view.names = built.names.data();
+    view.name_offsets = built.name_offsets.data();
+    view.offsets = built.offsets.data();
+    view.diameters = built.diameters.data();
+    view.chiploads = built.chiploads.data();
+    view.factors = built.factors.data();
+    view.slots = built.slots.data();
+    return view;
+}
+
+/**
+ * List the rows of a chipload table, grouped by material and sorted by diameter.
+ * 
+ * @param view The chipload table.
+ * @param rows The rows, appended.
+ */
+void TableRows(const ChiploadTable &view, std::vector<TableRow> &rows)
+{
+    for (unsigned int id = 0; id < view.material_count; id++)
+    {
+        for (unsigned int row = view.offsets[id]; row < view.offsets[id + 1]; row++)
+        {
+            rows.push_back({view.names + view.name_offsets[id], view.diameters[row], view.chiploads[row], view.factors[row]});
+        }
+    }
+}
 
-    // Initialize the Hash table
-    for (unsigned int i = 0; i < N_BUCKETS; i++)
+// Represents the rows parsed from one chunk of a CSV file
+struct Chunk {
+    const char *begin;
+    const char *end;
+    size_t lines;                                           // number of lines in the chunk
+    std::vector<TableRow> rows;
+    std::vector<std::pair<size_t, std::string>> rejected;   // (line in the chunk, reason)
+};
+
+/**
+ * Skip spaces and tabs.
+ */
+static const char *SkipBlanks(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t'))
     {
-        table[i] = NULL;
+        p++;
     }
+    return p;
+}
 
-    char line[MAX_LINE_LENGTH];
-    if (fgets(line, sizeof(line), file) == NULL) // Skip the header line
+/**
+ * Parse a number field of a CSV line, followed by a comma or the end of the line.
+ * 
+ * @param p The start of the field, moved past the comma.
+ * @param end The end of the line.
+ * @param value The number parsed.
+ * @return true if the field holds a number, false otherwise.
+ */
+static bool ParseField(const char *&p, const char *end, float &value)
+{
+    p = SkipBlanks(p, end);
+    if (p < end && *p == '+') p++; // from_chars doesn't take a plus sign
+    std::from_chars_result parsed = std::from_chars(p, end, value);
+    if (parsed.ec != std::errc())
     {
-        fclose(file);
         return false;
     }
+    p = SkipBlanks(parsed.ptr, end);
+    if (p < end && *p != ',')
+    {
+        return false;
+    }
+    if (p < end) p++;
+    return true;
+}
 
-    while (fgets(line, sizeof(line), file))
+/**
+ * Parse the lines of a chunk of a CSV file: material, diameter, chipload, factor (optional, defaults to 1.0).
+ * Empty lines are skipped, other lines that can't be parsed are rejected with the reason.
+ * 
+ * @param chunk The chunk to parse.
+ */
+static void ParseChunk(Chunk &chunk)
+{
+    const char *p = chunk.begin;
+    chunk.lines = 0;
+    while (p < chunk.end)
     {
-        std::string str_line(line); // Convert C-string to std::string
-        size_t comma1 = str_line.find(',');
-        if (comma1 == std::string::npos) continue; // Skip line if no comma
+        const char *line_end = static_cast<const char *>(memchr(p, '\n', chunk.end - p));
+        const char *next = line_end ? line_end + 1 : chunk.end;
+        if (!line_end) line_end = chunk.end;
+        if (line_end > p && line_end[-1] == '\r') line_end--;
+        size_t line = chunk.lines++;
+
+        const char *field = SkipBlanks(p, line_end);
+        p = next;
+        if (field == line_end) continue; // Skip empty lines
 
-        std::string material = str_line.substr(0, comma1);
-        str_line = str_line.substr(comma1 + 1);
-        
-        float diameter, chipload, factor;
-        int scanned = sscanf(str_line.c_str(), "%f, %f, %f", &diameter, &chipload, &factor);
-        if (scanned < 3) // Skip line if parsing fails
+        const char *comma = static_cast<const char *>(memchr(field, ',', line_end - field));
+        if (!comma)
+        {
+            chunk.rejected.emplace_back(line, "expected material, diameter, chipload, factor (optional)");
+            continue;
+        }
+        const char *material_end = comma;
+        while (material_end > field && (material_end[-1] == ' ' || material_end[-1] == '\t')) material_end--;
+        if (material_end == field)
         {
+            chunk.rejected.emplace_back(line, "missing material");
             continue;
         }
-        if (scanned == 3)
+        if (material_end - field > MAX_WORD_LENGTH)
         {
-            factor = 1.0; // Default factor if not provided
+            // The result cache keys on the name, a longer one would share its key with another
+            chunk.rejected.emplace_back(line, "the material name is longer than " + std::to_string(MAX_WORD_LENGTH) + " characters");
+            continue;
         }
 
-        // Check for uniqueness
-        unsigned int index = Hash(material);
-        Node *cursor = table[index];
-        bool unique = true;
-        while (cursor != NULL)
+        TableRow row;
+        const char *number = comma + 1;
+        if (!ParseField(number, line_end, row.diameter))
         {
-            if (strcasecmp(cursor->material.c_str(), material.c_str()) == 0 && cursor->diameter == diameter) {
-                unique = false;
-                break;
-            }
-            cursor = cursor->next;
+            chunk.rejected.emplace_back(line, "the diameter isn't a number");
+            continue;
+        }
+        if (!ParseField(number, line_end, row.chipload))
+        {
+            chunk.rejected.emplace_back(line, "the chipload isn't a number");
+            continue;
+        }
+        // from_chars takes nan, inf and negative numbers, none of them is a tool, a chip or a factor
+        if (!std::isfinite(row.diameter) || row.diameter <= 0)
+        {
+            chunk.rejected.emplace_back(line, "the diameter must be a number above 0");
+            continue;
+        }
+        if (!std::isfinite(row.chipload) || row.chipload <= 0)
+        {
+            chunk.rejected.emplace_back(line, "the chipload must be a number above 0");
+            continue;
+        }
+        row.factor = 1.0; // Default factor if not provided
+        if (SkipBlanks(number, line_end) != line_end && !ParseField(number, line_end, row.factor))
+        {
+            chunk.rejected.emplace_back(line, "the factor isn't a number");
+            continue;
         }
-        
-        if (!unique) {
-            continue; // Skip if material and diameter are already present
+        if (!std::isfinite(row.factor) || row.factor <= 0)
+        {
+            chunk.rejected.emplace_back(line, "the factor must be a number above 0");
+            continue;
+        }
+        if (SkipBlanks(number, line_end) != line_end)
+        {
+            chunk.rejected.emplace_back(line, "unexpected field after the factor");
+            continue;
         }
+        row.material.assign(field, material_end);
+        chunk.rows.push_back(std::move(row));
+    }
+}
 
-        // Create a new node for the material
-        Node *n = new(std::nothrow) Node; // Use new with std::nothrow to avoid exception on failure
-        if (!n)
+/**
+ * Read the rows of a chipload table CSV file.
+ * The file is memory mapped and split at line boundaries into chunks which are parsed in parallel,
+ * the rows of each chunk are then appended in file order. Rejected rows are reported on stderr with their line number.
+ * 
+ * @param filename The name of the CSV file to read.
+ * @param rows The rows read, appended in file order.
+ * @return true if the file was read, false if it can't be opened or has no header line.
+ */
+bool ReadTableRows(const std::string &filename, std::vector<TableRow> &rows)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0)
+    {
+        close(fd);
+        return false;
+    }
+    size_t file_size = file_stat.st_size;
+    void *mapped = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED)
+    {
+        return false;
+    }
+    madvise(mapped, file_size, MADV_SEQUENTIAL);
+    const char *data = static_cast<const char *>(mapped);
+    const char *end = data + file_size;
+
+    // Skip the header line
+    const char *header_end = static_cast<const char *>(memchr(data, '\n', file_size));
+    const char *body = header_end ? header_end + 1 : end;
+
+    // Split the body into chunks ending at a newline, a few per thread but at least 1 MB each
+    size_t n_threads = std::max(1u, std::thread::hardware_concurrency());
+    size_t chunk_size = std::max<size_t>(1 << 20, (end - body) / (4 * n_threads) + 1);
+    std::vector<Chunk> chunks;
+    for (const char *begin = body; begin < end;)
+    {
+        const char *chunk_end = begin + std::min<size_t>(chunk_size, end - begin);
+        if (chunk_end < end)
         {
-            printf("Failed to allocate memory for a new node (LookupTable chipload data structure)");
-            fclose(file);
-            Unload(); // Clean up allocated memory before exiting
-            return false;
+            const char *newline = static_cast<const char *>(memchr(chunk_end, '\n', end - chunk_end));
+            chunk_end = newline ? newline + 1 : end;
         }
-        n->material = material;
-        n->diameter = diameter;
-        n->chipload = chipload;
-        n->factor = factor;
-        n->next = table[index];
-        table[index] = n;
-        material_count++;
+        chunks.push_back({begin, chunk_end, 0, {}, {}});
+        begin = chunk_end;
     }
 
-    fclose(file);
+    ParallelFor(chunks.size(), [&](size_t i) { ParseChunk(chunks[i]); });
+
+    // Merge in file order, the header is line 1
+    size_t total = rows.size();
+    for (const Chunk &chunk : chunks) total += chunk.rows.size();
+    rows.reserve(total);
+    size_t first_line = 2;
+    for (Chunk &chunk : chunks)
+    {
+        for (const auto &rejected : chunk.rejected)
+        {
+            fprintf(stderr, "%s:%zu: row skipped, %s\n", filename.c_str(), first_line + rejected.first, rejected.second.c_str());
+        }
+        std::move(chunk.rows.begin(), chunk.rows.end(), std::back_inserter(rows));
+        first_line += chunk.lines;
+    }
+
+    munmap(mapped, file_size);
     return true;
 }
 
+/**
+ * Compare two chipload tables, array by array.
+ * 
+ * @return true if both tables hold the same materials and rows in the same layout.
+ */
+static bool SameTable(const ChiploadTable &a, const ChiploadTable &b)
+{
+    if (a.material_count != b.material_count || a.row_count != b.row_count || a.slot_count != b.slot_count)
+    {
+        return false;
+    }
+    unsigned int names_size = a.material_count == 0 ? 0 : a.name_offsets[a.material_count - 1] + strlen(a.names + a.name_offsets[a.material_count - 1]) + 1;
+    return memcmp(a.names, b.names, names_size) == 0 &&
+           memcmp(a.name_offsets, b.name_offsets, a.material_count * sizeof(unsigned int)) == 0 &&
+           memcmp(a.offsets, b.offsets, (a.material_count + 1) * sizeof(unsigned int)) == 0 &&
+           memcmp(a.diameters, b.diameters, a.row_count * sizeof(float)) == 0 &&
+           memcmp(a.chiploads, b.chiploads, a.row_count * sizeof(float)) == 0 &&
+           memcmp(a.factors, b.factors, a.row_count * sizeof(float)) == 0 &&
+           memcmp(a.slots, b.slots, a.slot_count * sizeof(int)) == 0;
+}
 
 /**
- * Search for a material and diameter in the Hash table.
+ * Load the chipload table: the table embedded at build time, overridden or extended by a CSV file.
+ * Rows of the CSV file replace the embedded rows with the same material and diameter, new ones are added.
+ * Without a CSV file, or with the same one the binary was built from, lookups go straight to the embedded table.
+ * Once loaded from a CSV file the table is saved to a snapshot next to it, which later runs load instead (see snapshot.cpp).
+ * 
+ * @param filename The name of the CSV file to Load data from.
+ * @return true if the data is loaded successfully, false otherwise.
+ */
+bool Load(const std::string& filename)
+{
+    StageTimer timer(STAGE_LOAD);
+
+    // A valid snapshot of the same .csv file skips the parsing altogether
+    if (LoadSnapshot(filename, table))
+    {
+        loaded = TableData();
+        material_count = table.row_count;
+        unique_materials_count = table.material_count;
+        table_hash = HashTable(table);
+        return true;
+    }
+    UnmapSnapshot();
+
+    std::vector<TableRow> rows;
+    if (!ReadTableRows(filename, rows))
+    {
+        if (default_table.material_count == 0)
+        {
+            printf("Can't open file\n");
+            return false;
+        }
+        printf("Can't open file %s, using the embedded chipload table\n", filename.c_str());
+        table = default_table;
+    }
+    else
+    {
+        // CSV rows first, so they win over the embedded ones
+        TableRows(default_table, rows);
+        if (!BuildTable(rows, loaded))
+        {
+            return false;
+        }
+        table = TableView(loaded);
+        if (SameTable(table, default_table))
+        {
+            table = default_table;
+            loaded = TableData();
+        }
+        WriteSnapshot(filename, table); // best effort, the next run parses the .csv again if it fails
+    }
+    material_count = table.row_count;
+    unique_materials_count = table.material_count;
+    table_hash = HashTable(table);
+    return true;
+}
+
+
+/**
+ * The chipload table the calling thread reads: the one it pinned with a TableReadGuard, or else the global table.
+ */
+const ChiploadTable &ActiveTable()
+{
+    return pinned_table != nullptr ? *pinned_table : table;
+}
+
+/**
+ * The hash of the contents of the chipload table the calling thread reads (see ActiveTable).
+ */
+uint64_t ActiveTableHash()
+{
+    return pinned_table != nullptr ? pinned_table_hash : table_hash;
+}
+
+
+/**
+ * Find the id of a material in the chipload table.
+ * 
+ * @param material The material to look for (case insensitive).
+ * @return The material id, or -1 if the material isn't in the table.
+ */
+int FindMaterial(const std::string &material)
+{
+    const ChiploadTable &table = ActiveTable(); // the table pinned by a TableReadGuard, if any
+    if (table.slot_count == 0)
+    {
+        return -1;
+    }
+    auto name_of = [&](int id) { return table.names + table.name_offsets[id]; };
+    unsigned int probes = 0;
+    int id = table.slots[Probe(table.slots, table.slot_count, name_of, material, &probes)];
+    CountMetric(METRIC_SEARCH_CALLS);
+    CountMetric(METRIC_SEARCH_PROBES, probes);
+    return id;
+}
+
+
+/**
+ * Search for a material and diameter in the chipload table, see SearchDiameters.
  * 
  * @param material The material to Search for.
- * @param diameter The diameter to Search for.
+ * @param diameter The diameter to Search for, in mm.
  * @param chipload Pointer to store the found chipload value.
  * @param rpm_factor Pointer to store the found RPM factor value.
- * @return true if the material and diameter are found in the Hash table, false otherwise.
+ * @param match Pointer to store how the diameter was resolved (optional).
+ * @return true if the material is found in the chipload table, false otherwise.
  */
-bool Search(const std::string &material, float diameter, float &chipload, float &rpm_factor)
+bool Search(const std::string &material, float diameter, float &chipload, float &rpm_factor, DiameterMatch *match)
 {
-    unsigned int index = Hash(material);
-    Node *cursor = table[index];
-    while (cursor != NULL)
+    DiameterMatch found;
+    bool searched = SearchDiameters(material, &diameter, 1, &chipload, &rpm_factor, &found);
+    if (match != nullptr)
     {
-        if (strcasecmp(cursor->material.c_str(), material.c_str()) == 0 && cursor->diameter == diameter)
+        *match = found;
+    }
+    return searched;
+}
+
+/**
+ * Search for a material and many diameters in the chipload table at once. The rows of a material are sorted by
+ * diameter, so each diameter is a binary search: a diameter between two rows gets the chipload and rpm factor
+ * interpolated linearly between them, one outside the rows of the material gets those of the nearest row.
+ * Diameters in ascending order resume the search where the previous one stopped.
+ * 
+ * @param material The material to Search for.
+ * @param diameters The diameters to Search for, in mm.
+ * @param count The number of diameters.
+ * @param chiploads Array to store the chipload of each diameter.
+ * @param rpm_factors Array to store the RPM factor of each diameter.
+ * @param matches Array to store how each diameter was resolved.
+ * @return true if the material is found in the chipload table, false otherwise (every match is DIAMETER_MISSING).
+ */
+bool SearchDiameters(const std::string &material, const float diameters[], size_t count, float chiploads[], float rpm_factors[], DiameterMatch matches[])
+{
+    const ChiploadTable &table = ActiveTable();
+    int id = FindMaterial(material);
+    if (id < 0 || table.offsets[id] == table.offsets[id + 1])
+    {
+        std::fill(matches, matches + count, DIAMETER_MISSING);
+        return false;
+    }
+    const float *begin = table.diameters + table.offsets[id];
+    const float *end = table.diameters + table.offsets[id + 1];
+    const float *from = begin;
+    for (size_t i = 0; i < count; i++)
+    {
+        float diameter = diameters[i];
+        if (i > 0 && !(diameter >= diameters[i - 1]))
+        {
+            from = begin; // not in ascending order, search all the rows again
+        }
+        const float *found = std::lower_bound(from, end, diameter);
+        from = found;
+
+        size_t row;
+        if (found == end)
+        {
+            row = end - 1 - table.diameters;
+            matches[i] = DIAMETER_CLAMPED;
+        }
+        else if (*found == diameter)
         {
-            printf("Found: Material=%s, Diameter=%.2f, Chipload=%.2f, Factor=%.2f\n",
-                   cursor->material.c_str(), cursor->diameter, cursor->chipload, cursor->factor);
-            chipload = cursor->chipload;
-            rpm_factor = cursor->factor;
-            return true;
+            row = found - table.diameters;
+            matches[i] = DIAMETER_EXACT;
         }
-        cursor = cursor->next;
+        else if (found == begin)
+        {
+            row = begin - table.diameters;
+            matches[i] = DIAMETER_CLAMPED;
+        }
+        else
+        {
+            size_t upper = found - table.diameters;
+            size_t lower = upper - 1;
+            float t = (diameter - table.diameters[lower]) / (table.diameters[upper] - table.diameters[lower]);
+            chiploads[i] = table.chiploads[lower] + t * (table.chiploads[upper] - table.chiploads[lower]);
+            rpm_factors[i] = table.factors[lower] + t * (table.factors[upper] - table.factors[lower]);
+            matches[i] = DIAMETER_INTERPOLATED;
+            continue;
+        }
+        chiploads[i] = table.chiploads[row];
+        rpm_factors[i] = table.factors[row];
     }
-    return false;
+    return true;
 }
 
 // Function to return the number of words in the dictionary
@@ -152,43 +636,33 @@ unsigned int size(void)
 }
 
 /**
- * Unload the Hash table from memory by freeing all allocated nodes.
+ * Unload the chipload table from memory.
  * 
- * @return true if the Hash table is successfully unloaded, false otherwise.
+ * @return true if the chipload table is successfully unloaded, false otherwise.
  */
 bool Unload(void)
 {
-    for (int i = 0; i < N_BUCKETS; i++)
-    {
-        Node* cursor = table[i];
-        while (cursor)
-        {
-            Node* tmp = cursor;
-            cursor = cursor->next;
-            delete tmp; // Use delete instead of free
-        }
-        table[i] = NULL; // Ensure bucket is set to NULL after deletion
-    }
+    table = ChiploadTable();
+    table_hash = 0;
+    loaded = TableData();
+    UnmapSnapshot();
+    material_count = 0;
+    unique_materials_count = 0;
     return true;
 }
 
 /**
- * Print the contents of the Hash table, including material, diameter, chipload, and factor for each entry.
+ * Print the contents of the chipload table, including material, diameter, chipload, and factor for each entry.
  */
 void PrintTable(void)
 {
-    for (unsigned int i = 0; i < N_BUCKETS; i++)
+    for (unsigned int id = 0; id < table.material_count; id++)
     {
-        Node *cursor = table[i];
-        if (cursor != NULL)
+        printf("Material %u:\n", id);
+        for (unsigned int row = table.offsets[id]; row < table.offsets[id + 1]; row++)
         {
-            printf("Bucket %u:\n", i);
-            while (cursor != NULL)
-            {
-                printf("  Material: %s, Diameter: %.2f, Chipload: %.2f, Factor: %.2f\n",
-                       cursor->material.c_str(), cursor->diameter, cursor->chipload, cursor->factor);
-                cursor = cursor->next;
-            }
+            printf("  Material: %s, Diameter: %.2f, Chipload: %.2f, Factor: %.2f\n",
+                   table.names + table.name_offsets[id], table.diameters[row], table.chiploads[row], table.factors[row]);
         }
     }
 }
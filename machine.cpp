@@ -0,0 +1,178 @@
+/**
+ * This file contains the following function definitions for the machine profiles:
+ * - LoadMachines
+ * - FindMachine
+ * - RunCompare
+ *
+ * The limits of the machine used to be compiled in (CNCPOWER, CNCMAXFEED, ...), they are now the built-in
+ * profile. A profiles file (Machines.csv) holds one machine per line after a header line:
+ *
+ *     Machine, Power(W), MaxFeed(mm/m), MinSpeed(rpm), MaxSpeed(rpm), MaxDeviation(mm), Acceleration(mm/s2), SpindleCurve(rpm:W)
+ *     Shop Router, 3000, 4080, 10000, 24000, 0.01, 500, 6000:750 18000:2200 24000:2200
+ *
+ * MaxDeviation and Acceleration are optional and default to MAXDEV and CNCACCEL. The spindle curve is optional
+ * too, without it the power of the spindle is Power at every rpm (see power.cpp).
+ */
+
+// Include headers & libraries
+#include <algorithm>    // for std::max and std::find_if
+#include <cerrno>       // for errno
+#include <climits>      // for INT_MIN and INT_MAX
+#include <cmath>        // for std::isfinite
+#include <cstdio>       // for standard input/output operations
+#include <cstdlib>      // for strtof and strtol
+#include <fstream>      // for reading the profiles file
+#include <string>       // for std::string
+#include <string_view>  // for std::string_view
+#include <strings.h>    // for strcasecmp
+#include <vector>       // for std::vector
+#include "chipload.h"   // for external user defined functions
+
+#define MACHINE_FIELDS 8    // name, power, max feed, min speed, max speed, max deviation, acceleration, spindle curve
+
+// Profile of the machine jobs are solved for, the built-in limits unless a profile is selected
+Machine machine = {"Built-in", CNCPOWER, CNCMAXFEED, CNCMINSPEED, CNCMAXSPEED, MAXDEV, CNCACCEL, {}};
+
+/**
+ * Function: parses a field holding a number and nothing else, ex.: "0.01".
+ */
+static bool ParseNumber(const std::string &field, float &value) {
+    char *end;
+    value = strtof(field.c_str(), &end);
+    return end != field.c_str() && *end == '\0' && std::isfinite(value);
+}
+
+/**
+ * Function: parses a field holding a whole number and nothing else, ex.: "4080".
+ */
+static bool ParseWhole(const std::string &field, int &value) {
+    char *end;
+    errno = 0;
+    long parsed = strtol(field.c_str(), &end, 10);
+    if (end == field.c_str() || *end != '\0' || errno == ERANGE || parsed < INT_MIN || parsed > INT_MAX) return false;
+    value = (int)parsed;
+    return true;
+}
+
+/**
+ * Function: loads the machine profiles from a .csv file, rows that don't make sense are skipped with a message.
+ *
+ * Parameters:
+ * @param filename: The profiles file.
+ * @param machines: The profiles, in file order.
+ *
+ * Returns:
+ * @return true if the file was read, false if it can't be opened.
+ */
+bool LoadMachines(const std::string &filename, std::vector<Machine> &machines) {
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    std::string line;
+    std::getline(file, line); // Skip the header line
+    for (int line_number = 2; std::getline(file, line); line_number++) {
+        std::string_view views[MACHINE_FIELDS] = {};
+        size_t count = SplitFields(line, ',', views, MACHINE_FIELDS);
+        std::string fields[MACHINE_FIELDS];
+        for (size_t i = 0; i < MACHINE_FIELDS; i++) fields[i] = TrimBlanks(views[i]);
+        if (count == 1 && fields[0].empty()) continue; // Skip empty lines
+        if (count < 5 || fields[0].empty()) {
+            fprintf(stderr, "%s:%d: machine skipped, expected name, power, max feed, min speed and max speed\n", filename.c_str(), line_number);
+            continue;
+        }
+        Machine profile;
+        profile.name = fields[0];
+        profile.max_deviation = MAXDEV;
+        profile.acceleration = CNCACCEL;
+        if (!ParseNumber(fields[1], profile.power) || !ParseWhole(fields[2], profile.max_feed) ||
+            !ParseWhole(fields[3], profile.min_speed) || !ParseWhole(fields[4], profile.max_speed) ||
+            (count > 5 && !fields[5].empty() && !ParseNumber(fields[5], profile.max_deviation)) ||
+            (count > 6 && !fields[6].empty() && !ParseNumber(fields[6], profile.acceleration))) {
+            fprintf(stderr, "%s:%d: machine skipped, the limits must be numbers (whole numbers for the max feed and speeds)\n", filename.c_str(), line_number);
+            continue;
+        }
+        if (count > 7 && !ParseSpindleCurve(fields[7], profile.spindle_curve)) {
+            fprintf(stderr, "%s:%d: machine skipped, expected the spindle curve as rpm:W pairs with distinct rpm\n", filename.c_str(), line_number);
+            continue;
+        }
+        if (profile.power <= 0 || profile.max_deviation < 0 || profile.max_feed <= 0 || profile.acceleration <= 0 ||
+            profile.min_speed <= 0 || profile.max_speed < profile.min_speed) {
+            fprintf(stderr, "%s:%d: machine skipped, limits out of range\n", filename.c_str(), line_number);
+            continue;
+        }
+        machines.push_back(profile);
+    }
+    return true;
+}
+
+/**
+ * Function: finds a machine profile by name (case insensitive).
+ *
+ * Returns:
+ * @return The profile, or nullptr if there is none with that name.
+ */
+const Machine *FindMachine(const std::vector<Machine> &machines, const std::string &name) {
+    for (const Machine &profile : machines) {
+        if (strcasecmp(profile.name.c_str(), name.c_str()) == 0) {
+            return &profile;
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * Function: solves the jobs of a jobs file for every machine profile in parallel and compares them.
+ *
+ * Parameters:
+ * @param file_chipload: The chipload table .csv file.
+ * @param file_jobs: The jobs file (see ReadJobsFromFile), or the single job input file.
+ * @param machines: The machine profiles.
+ * @param file_output: A .csv file for the comparison, or empty to print it as a table.
+ *
+ * Returns:
+ * @return 0 if the comparison was made, otherwise the error code (1, 2, 3 or 15 if it couldn't be written).
+ */
+int RunCompare(const std::string &file_chipload, const std::string &file_jobs, const std::vector<Machine> &machines, const std::string &file_output) {
+    FuzzyIndex material_index;
+    std::vector<Job> jobs;
+    int error = LoadTableAndJobs(file_chipload, file_jobs, material_index, jobs);
+    if (error != 0) {
+        return error;
+    }
+
+    // Solve every (job, machine) pair, each one only writes its own result slot
+    std::vector<JobResult> results(jobs.size() * machines.size());
+    ParallelFor(results.size(), [&](size_t i) {
+        SolveJob(jobs[i / machines.size()], material_index, machines[i % machines.size()], results[i]);
+    });
+    ConvertResultFeedRates(results); // the compared feedrates, a column per output unit
+    Unload();
+
+    FILE *file = file_output.empty() ? stdout : fopen(file_output.c_str(), "w");
+    if (file == nullptr) {
+        std::cerr << "Error opening file " << file_output << std::endl;
+        return 15;
+    }
+    if (file_output.empty()) {
+        fprintf(file, "%-5s %-24s %-20s %8s %12s %-8s %s\n", "Job", "Machine", "Material", "RPM", "Feedrate", "Unit", "Status");
+    } else {
+        fprintf(file, "job,machine,material,rpm,feed_mm_per_min,feedrate,out_unit,feasible,error\n");
+    }
+    for (size_t i = 0; i < results.size(); i++) {
+        const JobResult &result = results[i];
+        const Machine &profile = machines[i % machines.size()];
+        bool feasible = std::find_if(result.warnings.begin(), result.warnings.end(), [](int warning) { return warning == 15 || warning == 18; }) == result.warnings.end();
+        if (file_output.empty()) {
+            char status[32];
+            snprintf(status, sizeof(status), result.error ? "error %d" : feasible ? "feasible" : "infeasible", result.error);
+            fprintf(file, "%-5zu %-24s %-20s %8d %12.1f %-8s %s\n", i / machines.size() + 1, profile.name.c_str(),
+                    result.material.c_str(), result.feeds.x, result.feed_rate, result.out_unit.c_str(), status);
+        } else {
+            fprintf(file, "%zu,%s,%s,%d,%d,%.1f,%s,%d,%d\n", i / machines.size() + 1, profile.name.c_str(), result.material.c_str(),
+                    result.feeds.x, result.feeds.y, result.feed_rate, result.out_unit.c_str(), result.error == 0 && feasible, result.error);
+        }
+    }
+    return file == stdout || fclose(file) == 0 ? 0 : 15;
+}
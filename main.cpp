@@ -28,42 +28,176 @@
 #include "chipload.h"   // for external user defined functions
 
 
-// Constant Expressions
-#define MAX_UNIT_DISTANCE 3
-#define MAX_MATERIAL_DISTANCE 6
+/**
+ * Prints the debug message for an error or warning code returned by SolveJob.
+ */
+static void PrintCode(int code) {
+    switch (code) {
+    case 4:  printf("No material selected\n"); break;
+    case 5:  printf("No tool diameter unit selected\n"); break;
+    case 6:  printf("No out unit selected, resumed with default mm/m\n"); break;
+    case 7:  printf("No cutting edges selected, resumed with 2\n"); break;
+    case 8:  printf("No tool diameter selected\n"); break;
+    case 9:  printf("No job quality selected, resumed with default case (3)\n"); break;
+    case 10: printf("Not a valid job quality, resumed with default case (3)\n"); break;
+    case 11: printf("Invalid entry for the tool diameter\n"); break;
+    case 12: printf("Invalid material\n"); break;
+    case 13: printf("No chipload data for that material and tool diameter\n"); break;
+    case 14: printf("You didn't specify the units you want the results to be displayed, the feedrate was calculated in mm/m.\n"); break;
+    case 15: printf("Chipload out of feasible region\n"); break;
+    case 16: printf("Tool diameter outside the chipload table, resumed with the nearest diameter\n"); break;
+    case 17: printf("No cutting energy for the material, the spindle power isn't checked\n"); break;
+    case 18: printf("Cut needs more power than the spindle gives, reduce depth or stepover\n"); break;
+    default: printf("Undocumented code %d\n", code); break;
+    }
+}
 
 
-int main(void)
+// Metrics file written on exit (set with --metrics <file>)
+static std::string file_metrics;
+
+/**
+ * Writes the stage metrics on exit, see metrics.cpp.
+ */
+static void DumpMetrics(void) {
+    WriteMetrics(file_metrics);
+}
+
+// Result cache file loaded at startup and saved on exit (set with --cache <file>)
+static std::string file_cache;
+
+/**
+ * Saves the result cache on exit, see cache.cpp.
+ */
+static void SaveCache(void) {
+    SaveResultCache(file_cache);
+}
+
+
+int main(int argc, char *argv[])
 {
     // File names
     std::string file_chipload = "ChiploadTable.csv";
     std::string file_input = "SpeedNFeeds.txt";
     std::string file_output = "MyTools.txt";
+    std::string file_machines = "Machines.csv";
+
+    // Machine profiles, jobs are solved for the first one unless --machine picks another (built-in limits without the file)
+    std::vector<Machine> machines;
+    LoadMachines(file_machines, machines);
+    if (!machines.empty()) {
+        machine = machines[0];
+    }
+
+    // Options: --grid-simplex solves with the original grid walk to compare results,
+    // --metrics <file> writes the stage metrics on exit (JSON for a .json file, Prometheus text otherwise),
+    // --machine <name> solves for another machine profile, --watch reloads the chipload table when it changes (daemon mode),
+    // --cache <file> keeps the results of earlier runs in a file
+    bool watch = false;
+    int arg = 1;
+    while (arg < argc) {
+        if (strcmp(argv[arg], "--grid-simplex") == 0) {
+            grid_simplex = true;
+            arg++;
+        } else if (strcmp(argv[arg], "--metrics") == 0 && arg + 1 < argc) {
+            file_metrics = argv[arg + 1];
+            atexit(DumpMetrics);
+            arg += 2;
+        } else if (strcmp(argv[arg], "--machine") == 0 && arg + 1 < argc) {
+            const Machine *profile = FindMachine(machines, argv[arg + 1]);
+            if (profile == nullptr) {
+                printf("No machine called %s in %s\n", argv[arg + 1], file_machines.c_str());
+                return 16;
+            }
+            machine = *profile;
+            arg += 2;
+        } else if (strcmp(argv[arg], "--cache") == 0 && arg + 1 < argc) {
+            file_cache = argv[arg + 1];
+            LoadResultCache(file_cache); // a missing or stale file starts an empty cache
+            atexit(SaveCache);
+            arg += 2;
+        } else if (strcmp(argv[arg], "--watch") == 0) {
+            watch = true;
+            arg++;
+        } else {
+            break;
+        }
+    }
+
+    // Only the daemon lives long enough to reload the table
+    if (watch && (arg >= argc || strcmp(argv[arg], "--serve") != 0)) {
+        printf("--watch only works with --serve, ex.: ./chipload --watch --serve\n");
+        return 16;
+    }
+
+    // Machine comparison: chipload --compare [jobs file] [output.csv], every job solved for every machine profile
+    if (arg < argc && strcmp(argv[arg], "--compare") == 0) {
+        if (machines.empty()) {
+            machines.push_back(machine);
+        }
+        return RunCompare(file_chipload, argc - arg >= 2 ? argv[arg + 1] : file_input, machines, argc - arg >= 3 ? argv[arg + 2] : "");
+    }
+
+    // Batch mode: chipload --batch <jobs file> [output file]
+    if (argc - arg >= 2 && strcmp(argv[arg], "--batch") == 0) {
+        return RunBatch(file_chipload, argv[arg + 1], argc - arg >= 3 ? argv[arg + 2] : file_output);
+    }
+
+    // Feasible region maps: chipload --map <jobs file> <output.pgm|output.csv> [columns rows]
+    if (argc - arg >= 3 && strcmp(argv[arg], "--map") == 0) {
+        int columns = argc - arg >= 5 ? atoi(argv[arg + 3]) : MAP_COLUMNS;
+        int rows = argc - arg >= 5 ? atoi(argv[arg + 4]) : MAP_ROWS;
+        return RunMap(file_chipload, argv[arg + 1], argv[arg + 2], columns, rows);
+    }
+
+    // Pareto fronts: chipload --pareto <jobs file> <output.csv> [samples], see pareto.cpp
+    if (argc - arg >= 3 && strcmp(argv[arg], "--pareto") == 0) {
+        return RunPareto(file_chipload, argv[arg + 1], argv[arg + 2], argc - arg >= 4 ? atoi(argv[arg + 3]) : PARETO_SAMPLES);
+    }
+
+    // G-code post-processor: chipload --gcode <program> <rewritten program> [tool map], see gcode.cpp
+    if (argc - arg >= 3 && strcmp(argv[arg], "--gcode") == 0) {
+        return RunRewrite(file_chipload, argc - arg >= 4 ? argv[arg + 3] : "ToolMap.csv", argv[arg + 1], argv[arg + 2]);
+    }
+
+    // Engagement sweep: chipload --sweep <tool map> <output.csv> [stepovers depths], see engagement.cpp
+    if (argc - arg >= 3 && strcmp(argv[arg], "--sweep") == 0) {
+        return RunSweep(file_chipload, argv[arg + 1], argv[arg + 2], argc - arg >= 5 ? argv[arg + 3] : SWEEP_STEPOVERS,
+                        argc - arg >= 5 ? argv[arg + 4] : SWEEP_DEPTHS);
+    }
+
+    // Stock simulation: chipload --simulate <program> <rewritten program> [tool map] [resolution in mm], see simulate.cpp
+    if (argc - arg >= 3 && strcmp(argv[arg], "--simulate") == 0) {
+        return RunSimulate(file_chipload, argc - arg >= 4 ? argv[arg + 3] : "ToolMap.csv", argv[arg + 1], argv[arg + 2],
+                           argc - arg >= 5 ? atof(argv[arg + 4]) : STOCK_RESOLUTION);
+    }
+
+    // Cycle-time estimate: chipload --cycle-time <program> [tool map], see cycle.cpp
+    if (argc - arg >= 2 && strcmp(argv[arg], "--cycle-time") == 0) {
+        return RunCycleTime(file_chipload, argc - arg >= 3 ? argv[arg + 2] : "ToolMap.csv", argv[arg + 1]);
+    }
+
+    // Daemon mode: chipload [--watch] --serve [socket path]
+    if (arg < argc && strcmp(argv[arg], "--serve") == 0) {
+        return RunServer(file_chipload, argc - arg >= 2 ? argv[arg + 1] : CHIPLOAD_SOCKET, watch);
+    } else if (arg < argc) {
+        printf("Usage: %s [--grid-simplex] [--metrics <file>] [--machine <name>] [--watch] [--cache <file>] [--batch <jobs.csv|jobs.txt> [output.txt] | --map <jobs> <map.pgm|map.csv> [columns rows] | --compare [jobs] [output.csv] | --pareto <jobs> <output.csv> [samples] | --gcode <program> <output> [toolmap.csv] | --cycle-time <program> [toolmap.csv] | --sweep <toolmap.csv> <output.csv> [stepovers depths] | --simulate <program> <output> [toolmap.csv] [resolution] | --serve [socket]]\n", argv[0]);
+        return 16;
+    }
 
     // User input
-    bool beginner = false;
-    bool checklist = false;
-    bool supported_materials_list = false;
-    std::string material = "";
-    std::string tool = "";
-    std::string tool_teeth = "";
-    std::string job_quality = "";
-    std::string out_unit = "";
+    Job job;
     std::vector<std::string> unique_materials; // Array of fixed size
 
-    // Variables for CSV values
-    float chipload = 0;
-    float rpm_factor = 0;
-
-    // Supported units
-    std::vector<std::string> length_units = {"mm", "in", "inch", "inches"};
-    std::vector<std::string> speed_units = {"mm/s", "mm/m", "m/m", "inch/s", "inch/m", "in/s", "in/m", "feet/m"};
+    // Output file, opened once and written when the report is closed (see write.cpp)
+    Report report;
+    OpenReport(report, file_output);
 
     // Load material and chipload information
     if (Load(file_chipload)) {
         printf("Successfully loaded materials\n");
     } else {
-        ErrorMessage(file_output, 1);
+        ErrorMessage(report, 1);
         printf("Failed to Load materials\n");
         return 1;
     }
@@ -74,7 +208,7 @@ int main(void)
     // Initialize unique materials
     unsigned int unique_materials_count = 0;
     if (!UniqueElements(unique_materials, &unique_materials_count)) {
-        ErrorMessage(file_output.c_str(), 2);
+        ErrorMessage(report, 2);
         printf("Memory allocation for unique materials has failed\n");
         return 2;
     }
@@ -83,217 +217,80 @@ int main(void)
         printf("%s\n", unique_materials[i].c_str());
     }
     printf("\n");
+    FuzzyIndex material_index;
+    BuildFuzzyIndex(unique_materials, material_index);
 
 
     // Read user input
-    if (!ReadFromFile(file_input, beginner, material, tool, tool_teeth, job_quality, out_unit, checklist, supported_materials_list)) {
-        ErrorMessage(file_output.c_str(), 3);
+    if (!ReadFromFile(file_input, job)) {
+        ErrorMessage(report, 3);
         printf("Failed to read from file.\n");
         return 3;
     }
-
-
-    // Clean and extract numerical values
-    std::string tool_unit = tool;
-    CleanString(material);
-    CleanString(tool_unit);
-    float tool_diameter = CleanNumber(tool);
-    float tool_z = CleanNumber(tool_teeth);
-    float speed = CleanNumber(job_quality);
-    CleanString(out_unit);
-
-    printf("Material to cut: %s\n", material.c_str());
-    printf("Tool Diameter to cut: %.2f %s\n", tool_diameter, tool_unit.c_str());
-    printf("Tool Teeth: %.2f\n", tool_z);
-    printf("Job Quality: %s\n", job_quality.c_str());
-    printf("Units: %s\n", out_unit.c_str());
-    printf("\n");
-
-
-    // Error checking
-    if (material.empty()) {
-        ErrorMessage(file_output.c_str(), 4);
-        printf("No material selected\n");
-        return 4;
-    } else if (tool_diameter == 0) {
-        ErrorMessage(file_output.c_str(), 8);
-        printf("No tool diameter selected\n");
-        return 8;
-    } else if (tool_unit.empty()) {
-        ErrorMessage(file_output.c_str(), 5);
-        printf("No tool diameter unit selected\n");
-        return 5;
-    } else if (tool_z > 4 || tool_z <= 0) {
-        WarningMessage(file_output.c_str(), 7);
-        printf("No cutting edges selected, resumed with 2\n");
-        tool_z = 2;
-    } else if (speed != 1 && speed != 2 && speed != 3 && speed != 4 && speed != 5) {
-        if (speed == 0) {
-            WarningMessage(file_output.c_str(), 9);
-            printf("No job quality selected, resumed with default case (3)\n");
-        } else {
-            WarningMessage(file_output.c_str(), 10);
-            printf("Not a valid job quality, resumed with default case (3)\n");
-        }
-    } else if (out_unit.empty()) {
-        WarningMessage(file_output.c_str(), 6);
-        printf("No out unit selected, resumed with default mm/m\n");
-        out_unit = "mm/m";
-    }
-
-
-    // Convert tool diameter
-    std::string best_tool_unit = BestMatch(tool_unit, length_units, MAX_UNIT_DISTANCE);
-    if (best_tool_unit == "error") {
-        printf("Invalid entry for the tool diameter\n");
-        ErrorMessage(file_output.c_str(), 11);
-        return 11;
-    }
-    float diameter = Convert(tool_diameter, best_tool_unit, "mm/s");
-    int rounded_diameter = std::round(diameter);
-    printf("The diameter is %d mm (rounded from %.2f %s)\n", rounded_diameter, diameter, best_tool_unit.c_str());
-    printf("\n");
-
-
-    // Find best material match
-    std::string best_material = BestMatch(material, unique_materials, MAX_MATERIAL_DISTANCE);
-    if (best_material == "error") {
-        printf("Invalid material\n");
-        ErrorMessage(file_output.c_str(), 12);
-        return 12;
-    }
-    // for debugging purposes prints the material that best matches the materials supported
-    printf("The best match found in the materials for %s was %s\n", material.c_str(), best_material.c_str());
+    printf("Material to cut: %s\n", job.material.c_str());
+    printf("Tool Diameter to cut: %s\n", job.tool.c_str());
+    printf("Tool Teeth: %s\n", job.tool_teeth.c_str());
+    printf("Job Quality: %s\n", job.job_quality.c_str());
+    printf("Units: %s\n", job.out_unit.c_str());
     printf("\n");
 
 
     /**
-     * Calculates the feed_rate rates based on the given speed value and specific scenarios.
-     * 
-     * Parameters:
-     * - speed: The speed value determining the scenario for feed_rate rate calculation.
-     * - chipload: The chipload value used in the feed_rate rate calculation.
-     * - tool_z: The number of cutting edges on the tool.
-     * 
-     * Returns:
-     * - Feeds: The calculated feed_rate rates based on the speed scenario.
+     * Clean the input, match the tool unit and material, search the chipload and calculate the feed rate
+     * and speed for the job quality, converted to the desired output unit (see job.cpp).
+     *
+     * Warnings are written to the output file and the calculation resumes with defaults,
+     * errors are written to the output file and the program returns with the error code.
      */
-    if (beginner) {
-        speed = 6; // begginer mode
+    JobResult result;
+    int error = SolveJob(job, material_index, machine, result);
+    report.job = 1;
+    for (int warning : result.warnings) {
+        WarningMessage(report, warning);
+        PrintCode(warning);
     }
-    Point Feeds;          // variable of type Point, holds x(rpm) and y value(feedrate)
-    float upper_bound;    // upper bound chipload straight slope
-    float lower_bound;    // lower bound chipload straight slope
-    switch ((int)speed) {
-    case 1: // MAX FINISH
-        // lower chipload
-        upper_bound = 0.5 * (chipload + MAXDEV) * tool_z;
-        lower_bound = 0.5 * (chipload - MAXDEV) * tool_z;
-        // Simplex for speed
-        Feeds = Simplex(CNCMINSPEED, CNCMAXSPEED, CNCMAXFEED, upper_bound, lower_bound, false);
-        break;
-
-    case 2: // FINISH
-        // lower chipload
-        upper_bound = 0.5 * (chipload + MAXDEV) * tool_z;
-        lower_bound = 0.5 * (chipload - MAXDEV) * tool_z;
-        // Simplex for speed
-        Feeds = Simplex(CNCMINSPEED, CNCMAXSPEED, CNCMAXFEED, upper_bound, lower_bound, false);
-        break;
-
-    case 4: // MATERIAL REMOVAL
-        // higher chipload
-        upper_bound = 0.5 * (chipload + MAXDEV) * tool_z;
-        lower_bound = 0.5 * (chipload - MAXDEV) * tool_z;
-        // Simplex for feed_rate
-        Feeds = Simplex(CNCMINSPEED, CNCMAXSPEED, CNCMAXFEED, upper_bound, lower_bound, false);
-        break;
-
-    case 5: // MAX MATERIAL REMOVAL
-        // higher chipload
-        upper_bound = 0.5 * (chipload + MAXDEV) * tool_z;
-        lower_bound = 0.5 * (chipload - MAXDEV) * tool_z;
-        // Simplex for feed_rate
-        Feeds = Simplex(CNCMINSPEED, CNCMAXSPEED, CNCMAXFEED, upper_bound, lower_bound, false);
-        break;
-
-    case 6: // BEGGINER MODE, SIMILAR TO DEFAULT BUT LESS CHIPLOAD (x0.5) AND REDUCED FEEDRATE (x0.625)
-        // use chipload from table
-        chipload = chipload * tool_z;
-        // Midpoint
-        Feeds = Midpoint(CNCMINSPEED, CNCMAXSPEED, CNCMAXFEED, chipload);
-        Feeds.x = 0.9 * Feeds.x;    // lower rpm
-        Feeds.y = 0.5 * Feeds.y;    // lower feedrate significantly
-        break;
-
-    default: // BALANCED TOOL LIFE OPTIMIZATION (case 3 or other)
-        // use chipload from table
-        chipload = chipload * tool_z;
-        // Midpoint
-        Feeds = Midpoint(CNCMINSPEED, CNCMAXSPEED, CNCMAXFEED, chipload);
-        break;
-    }
-
-    // Handles edge case where Point Feeds is out of feasible region
-    if (Feeds.x == 0 || Feeds.y == 0) {
-        WarningMessage(file_output, 15); // Warns user and gives helpful advice
-        printf("Chipload out of feasible region\n");
+    if (error != 0) {
+        if (error == 14) {
+            WarningMessage(report, error);
+        } else {
+            ErrorMessage(report, error);
+        }
+        PrintCode(error);
+        Unload();
+        return error;
     }
-
-
-    /**
-     * Performs unit conversion for the feed_rate rate based on the desired output unit.
-     * 
-     * Parameters:
-     * - out_unit: The desired output unit for the feed_rate rate.
-     * - Feeds.y: The calculated feed_rate rate in mm/m.
-     * 
-     * Returns:
-     * - feed_rate: The converted feed_rate rate based on the desired output unit.
-     */
-    std::string best_out_unit = BestMatch(out_unit, speed_units, MAX_UNIT_DISTANCE);
-    if (strcmp(best_out_unit.c_str(), "error") == 0) {
-        printf("You didn't specify the units you want the results to be displayed, the feedrate was calculated in mm/m.\n");
-        WarningMessage(file_output, 14);
-        return 14;
+    // for debugging purposes prints the diameter, the material and the feed rate unit that best match
+    printf("The diameter is %.2f mm (from %.2f %s)\n", result.diameter, result.tool_diameter, result.tool_unit.c_str());
+    printf("The best match found in the materials for %s was %s\n", job.material.c_str(), result.material.c_str());
+    printf("Found: Chipload=%.2f, Factor=%.2f\n", result.chipload, result.rpm_factor);
+    printf("Engagement: stepover %.2f mm, depth %.2f mm, effective diameter %.2f mm, chip thinning x%.2f\n",
+           result.stepover, result.depth, result.effective_diameter, result.thinning);
+    for (const Match &match : result.suggestions) {
+        printf("  candidate %s at distance %d\n", unique_materials[match.index].c_str(), match.distance);
     }
-    const float feed_rate = Convert(Feeds.y, "mm/m", best_out_unit);
-    // for debugging purposes prints the feed rate unit that best matches
-    printf("best match for unit %s is %s\n", out_unit.c_str(), best_out_unit.c_str());
+    printf("best match for unit %s is %s\n", job.out_unit.c_str(), result.out_unit.c_str());
     printf("\n");
 
 
     /**
      * Write the calculated feed_rate rate, speed, and other relevant information to a specified .txt file.
-     * 
-     * Parameters:
-     * - file_output: The name of the output file to write the results to.
-     * - best_material: The matched material for the machining job.
-     * - tool_diameter: The diameter of the cutting tool.
-     * - tool_unit: The unit of the cutting tool diameter.
-     * - tool_z: The number of cutting edges on the tool.
-     * - speed: The selected job quality/speed for machining.
-     * - Feeds: The calculated feed_rate rates based on the speed scenario.
-     * - checklist: A flag indicating if a checklist is required.
-     * - supported_materials_list: A flag indicating if the supported materials list is needed.
-     * 
+     *
      * Returns:
      * - 0 if the results were successfully written to the file; otherwise, returns 15 and prints an error message.
      */
-    if (!WriteResultsToFile(file_output, best_material, tool_diameter, best_tool_unit, tool_z, speed, Feeds, feed_rate, best_out_unit, unique_materials, checklist, supported_materials_list)) {
+    if (!WriteResultsToFile(report, result.material, result.tool_diameter, result.tool_unit, result.tool_teeth, result.speed, result.feeds, result.feed_rate, result.out_unit, DescribeLimits(result), unique_materials, job.checklist, job.supported_materials_list)) {
         printf("Couldn't write results to file\n");
         return 15;
     }
+    WriteSuggestions(report, job.material, result, unique_materials);
     // for debugging purposes prints the feed_rate and Point Feeds to stdout
-    printf("The feed_rate is %.1f %s (from the calculated %i mm/m), and the rpm is %i\n", feed_rate, best_out_unit.c_str(), Feeds.y, Feeds.x);
+    printf("The feed_rate is %.1f %s (from the calculated %i mm/m), and the rpm is %i\n", result.feed_rate, result.out_unit.c_str(), result.feeds.y, result.feeds.x);
     printf("\n");
 
 
-        /**
-     * Free allocated memory for unique materials array elements, material, tool unit, tool teeth, job quality, output units,
-     * and Unload the Hash table.
+    /**
+     * Unload the Hash table.
      */
-    // Mallocced Hash table
     Unload();
 
 
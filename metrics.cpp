@@ -0,0 +1,292 @@
+/**
+ * This file contains the following function definitions for the stage metrics:
+ * - RecordLatency
+ * - CountMetric
+ * - StageTimer
+ * - MetricsText
+ * - MetricsJson
+ * - WriteMetrics
+ *
+ * Every thread records into its own block of histograms and counters, which only that thread writes, so
+ * recording is a couple of plain (relaxed atomic) adds without locks or shared cache lines. Readers merge
+ * the blocks of the live threads with the totals of the threads that already exited.
+ *
+ * The latency histograms are HDR style: values below 16 ns get a bucket each, above that every power of two
+ * is split in 16 linear buckets, so any value is recorded within 6.25% from 1 ns up to hours.
+ */
+
+// Include headers & libraries
+#include <atomic>       // for the per-thread counters
+#include <chrono>       // for std::chrono::steady_clock
+#include <cstdint>      // for uint64_t
+#include <cstdio>       // for standard input/output operations
+#include <mutex>        // for the registry of threads
+#include <string>       // for std::string
+#include <vector>       // for std::vector
+#include "chipload.h"   // for external user defined functions
+
+#define SUB_BUCKET_BITS 4                   // 16 buckets per power of two
+#define SUB_BUCKETS (1 << SUB_BUCKET_BITS)
+#define N_BUCKETS ((64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS)
+
+// Names in the dumps, in the order of the Stage and Metric enums
+static const char *stage_names[N_STAGES] = {"load", "read", "clean", "match", "search", "solve", "convert", "write"};
+static const char *metric_names[N_METRICS] = {"search_calls", "search_probes", "levenshtein_calls", "solver_iterations", "bytes_written", "table_reloads", "cache_hits", "cache_misses"};
+static const char *metric_help[N_METRICS] = {
+    "Material lookups in the chipload table.",
+    "Index slots compared by the lookups, probes per call is the mean chain length.",
+    "Levenshtein distances computed by the unit and material matching.",
+    "Vertices evaluated by the exact solver or grid points visited by the grid walk.",
+    "Bytes appended to the output file by WriteResultsToFile.",
+    "Chipload tables published by the hot reload, the table generation is one more.",
+    "Jobs answered from the result cache.",
+    "Jobs searched and solved, then stored in the result cache."};
+
+// Represents the metrics of one thread
+struct ThreadMetrics {
+    std::atomic<uint64_t> buckets[N_STAGES][N_BUCKETS];
+    std::atomic<uint64_t> sums[N_STAGES];
+    std::atomic<uint64_t> counters[N_METRICS];
+};
+
+// Represents the metrics merged over every thread
+struct MergedMetrics {
+    std::vector<uint64_t> buckets[N_STAGES];
+    uint64_t counts[N_STAGES] = {};
+    uint64_t sums[N_STAGES] = {};
+    uint64_t counters[N_METRICS] = {};
+};
+
+// Registry of the live threads and totals of the exited ones
+static std::mutex registry_mutex;
+static std::vector<ThreadMetrics *> live_threads;
+static ThreadMetrics exited_threads;
+
+/**
+ * Function: adds to a value only the calling thread writes, readers may load it at any time.
+ */
+static inline void Add(std::atomic<uint64_t> &value, uint64_t n) {
+    value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+// Owns the metrics of a thread, folds them into exited_threads when the thread exits
+struct ThreadMetricsOwner {
+    ThreadMetrics *metrics = nullptr;
+
+    ThreadMetrics &Get() {
+        if (metrics == nullptr) {
+            metrics = new ThreadMetrics();
+            std::lock_guard<std::mutex> lock(registry_mutex);
+            live_threads.push_back(metrics);
+        }
+        return *metrics;
+    }
+
+    ~ThreadMetricsOwner() {
+        if (metrics == nullptr) return;
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        for (int s = 0; s < N_STAGES; s++) {
+            for (int b = 0; b < N_BUCKETS; b++) Add(exited_threads.buckets[s][b], metrics->buckets[s][b].load(std::memory_order_relaxed));
+            Add(exited_threads.sums[s], metrics->sums[s].load(std::memory_order_relaxed));
+        }
+        for (int m = 0; m < N_METRICS; m++) Add(exited_threads.counters[m], metrics->counters[m].load(std::memory_order_relaxed));
+        for (size_t i = 0; i < live_threads.size(); i++) {
+            if (live_threads[i] == metrics) {
+                live_threads.erase(live_threads.begin() + i);
+                break;
+            }
+        }
+        delete metrics;
+    }
+};
+
+static thread_local ThreadMetricsOwner thread_metrics;
+
+/**
+ * Function: finds the histogram bucket of a value.
+ */
+static inline int Bucket(uint64_t value) {
+    if (value < SUB_BUCKETS) return value;
+    int exponent = 63 - __builtin_clzll(value);
+    int sub_bucket = (value >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+    return (exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + sub_bucket;
+}
+
+/**
+ * Function: finds the smallest value of a histogram bucket, the next bucket starts where it ends.
+ */
+static uint64_t BucketStart(int bucket) {
+    if (bucket < SUB_BUCKETS) return bucket;
+    int exponent = bucket / SUB_BUCKETS + SUB_BUCKET_BITS - 1;
+    uint64_t sub_bucket = bucket % SUB_BUCKETS;
+    return (SUB_BUCKETS + sub_bucket) << (exponent - SUB_BUCKET_BITS);
+}
+
+static uint64_t BucketEnd(int bucket) {
+    return bucket + 1 < N_BUCKETS ? BucketStart(bucket + 1) : UINT64_MAX;
+}
+
+/**
+ * Function: records the latency of one run of a stage.
+ *
+ * Parameters:
+ * @param stage: The pipeline stage.
+ * @param nanoseconds: How long it took.
+ */
+void RecordLatency(Stage stage, uint64_t nanoseconds) {
+    ThreadMetrics &metrics = thread_metrics.Get();
+    Add(metrics.buckets[stage][Bucket(nanoseconds)], 1);
+    Add(metrics.sums[stage], nanoseconds);
+}
+
+/**
+ * Function: adds to a counter.
+ *
+ * Parameters:
+ * @param metric: The counter.
+ * @param n: How much to add.
+ */
+void CountMetric(Metric metric, uint64_t n) {
+    Add(thread_metrics.Get().counters[metric], n);
+}
+
+StageTimer::StageTimer(Stage stage) : stage(stage), start(std::chrono::steady_clock::now()) {}
+
+/**
+ * Function: records the stage timed so far and starts timing the next one.
+ */
+void StageTimer::Next(Stage next) {
+    auto now = std::chrono::steady_clock::now();
+    RecordLatency(stage, std::chrono::duration_cast<std::chrono::nanoseconds>(now - start).count());
+    stage = next;
+    start = now;
+}
+
+StageTimer::~StageTimer() {
+    RecordLatency(stage, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+}
+
+/**
+ * Function: merges the metrics of every thread, live or exited.
+ */
+static void Merge(MergedMetrics &merged) {
+    for (int s = 0; s < N_STAGES; s++) merged.buckets[s].assign(N_BUCKETS, 0);
+
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    std::vector<const ThreadMetrics *> blocks(live_threads.begin(), live_threads.end());
+    blocks.push_back(&exited_threads);
+    for (const ThreadMetrics *metrics : blocks) {
+        for (int s = 0; s < N_STAGES; s++) {
+            for (int b = 0; b < N_BUCKETS; b++) {
+                uint64_t n = metrics->buckets[s][b].load(std::memory_order_relaxed);
+                merged.buckets[s][b] += n;
+                merged.counts[s] += n;
+            }
+            merged.sums[s] += metrics->sums[s].load(std::memory_order_relaxed);
+        }
+        for (int m = 0; m < N_METRICS; m++) merged.counters[m] += metrics->counters[m].load(std::memory_order_relaxed);
+    }
+}
+
+/**
+ * Function: estimates a percentile of a merged histogram, as the middle of the bucket holding it.
+ */
+static uint64_t Percentile(const MergedMetrics &merged, int stage, double p) {
+    if (merged.counts[stage] == 0) return 0;
+    uint64_t rank = p * (merged.counts[stage] - 1) + 1;
+    uint64_t seen = 0;
+    for (int b = 0; b < N_BUCKETS; b++) {
+        seen += merged.buckets[stage][b];
+        if (seen >= rank) return BucketStart(b) + (BucketEnd(b) - 1 - BucketStart(b)) / 2;
+    }
+    return 0;
+}
+
+/**
+ * Function: dumps the metrics in the Prometheus text exposition format.
+ *
+ * Returns:
+ * @return The metrics, a histogram of latencies in seconds per stage and one line per counter.
+ */
+std::string MetricsText() {
+    MergedMetrics merged;
+    Merge(merged);
+
+    std::string text;
+    char line[256];
+    text += "# HELP chipload_stage_seconds Latency of each pipeline stage.\n";
+    text += "# TYPE chipload_stage_seconds histogram\n";
+    for (int s = 0; s < N_STAGES; s++) {
+        uint64_t cumulative = 0;
+        for (int b = 0; b < N_BUCKETS; b++) {
+            if (merged.buckets[s][b] == 0) continue; // empty buckets add nothing to the cumulative counts
+            cumulative += merged.buckets[s][b];
+            snprintf(line, sizeof(line), "chipload_stage_seconds_bucket{stage=\"%s\",le=\"%.9g\"} %llu\n",
+                     stage_names[s], BucketEnd(b) / 1e9, (unsigned long long)cumulative);
+            text += line;
+        }
+        snprintf(line, sizeof(line), "chipload_stage_seconds_bucket{stage=\"%s\",le=\"+Inf\"} %llu\n"
+                                     "chipload_stage_seconds_sum{stage=\"%s\"} %.9g\n"
+                                     "chipload_stage_seconds_count{stage=\"%s\"} %llu\n",
+                 stage_names[s], (unsigned long long)merged.counts[s], stage_names[s], merged.sums[s] / 1e9,
+                 stage_names[s], (unsigned long long)merged.counts[s]);
+        text += line;
+    }
+    for (int m = 0; m < N_METRICS; m++) {
+        snprintf(line, sizeof(line), "# HELP chipload_%s_total %s\n# TYPE chipload_%s_total counter\nchipload_%s_total %llu\n",
+                 metric_names[m], metric_help[m], metric_names[m], metric_names[m], (unsigned long long)merged.counters[m]);
+        text += line;
+    }
+    return text;
+}
+
+/**
+ * Function: dumps the metrics as JSON, on a single line.
+ *
+ * Returns:
+ * @return The metrics, count, mean and percentiles in nanoseconds per stage and the counters.
+ */
+std::string MetricsJson() {
+    MergedMetrics merged;
+    Merge(merged);
+
+    std::string json = "{\"stages\":{";
+    char entry[256];
+    for (int s = 0; s < N_STAGES; s++) {
+        snprintf(entry, sizeof(entry), "%s\"%s\":{\"count\":%llu,\"sum_ns\":%llu,\"mean_ns\":%.1f,\"p50_ns\":%llu,\"p90_ns\":%llu,\"p99_ns\":%llu,\"max_ns\":%llu}",
+                 s ? "," : "", stage_names[s], (unsigned long long)merged.counts[s], (unsigned long long)merged.sums[s],
+                 merged.counts[s] ? (double)merged.sums[s] / merged.counts[s] : 0.0,
+                 (unsigned long long)Percentile(merged, s, 0.50), (unsigned long long)Percentile(merged, s, 0.90),
+                 (unsigned long long)Percentile(merged, s, 0.99), (unsigned long long)Percentile(merged, s, 1.0));
+        json += entry;
+    }
+    json += "},\"counters\":{";
+    for (int m = 0; m < N_METRICS; m++) {
+        snprintf(entry, sizeof(entry), "%s\"%s\":%llu", m ? "," : "", metric_names[m], (unsigned long long)merged.counters[m]);
+        json += entry;
+    }
+    json += "}}\n";
+    return json;
+}
+
+/**
+ * Function: writes the metrics to a file, as JSON if its name ends in .json and in the Prometheus text format otherwise.
+ *
+ * Parameters:
+ * @param filename: The file to write, replaced if it exists.
+ *
+ * Returns:
+ * @return true if the metrics were written, false otherwise.
+ */
+bool WriteMetrics(const std::string &filename) {
+    bool json = filename.size() >= 5 && filename.compare(filename.size() - 5, 5, ".json") == 0;
+    std::string dump = json ? MetricsJson() : MetricsText();
+
+    FILE *file = fopen(filename.c_str(), "w");
+    if (file == nullptr) {
+        std::cerr << "Error opening file " << filename << std::endl;
+        return false;
+    }
+    bool written = fwrite(dump.data(), 1, dump.size(), file) == dump.size();
+    return fclose(file) == 0 && written;
+}
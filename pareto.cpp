@@ -0,0 +1,191 @@
+/**
+ * This file contains the following function definitions for the trade-off between speed, finish and tool life:
+ * - ParetoFront
+ * - RunPareto
+ *
+ * The Job Quality picks one point of the feasible region. To see the whole trade-off, the region is sampled on a
+ * grid (rpm from the min to the max speed, and at each rpm the feedrate from the lower chipload straight to the
+ * lowest of the upper straight, the max feed and the spindle power) and each sample is scored on:
+ * - the material removal rate, stepover * depth * feed, to maximize
+ * - the feed marks, a peak to valley roughness of fz^2 / (8 * R) with fz the feed per tooth and R the radius of the
+ *   cutting diameter, to minimize
+ * - the tool life from the extended Taylor equation V * T^n * fz^a = C (TAYLOR_N and TAYLOR_FEED), relative to the
+ *   slowest rpm at the lower chipload straight, to maximize
+ * The Pareto front is the set of samples no other sample beats on one score without losing on another. The samples
+ * are split in chunks filtered in parallel, each keeping its own non-dominated samples, then the survivors of all
+ * the chunks are filtered together. A sample dominated by anything is dominated by a point of the front, which
+ * survives its chunk, so the last step only needs the survivors. Each filter is a sweep in O(n log n).
+ *
+ * Every score is monotone in the rpm and the feed per tooth, each in its own direction, so most of the feasible
+ * samples trade one score for another and the front is a surface over the region, meant to be plotted or filtered.
+ */
+
+// Include headers & libraries
+#include <algorithm>    // for std::sort, std::min and std::max
+#include <chrono>       // for timing the jobs
+#include <cmath>        // for pow
+#include <cstdio>       // for standard input/output operations
+#include <iterator>     // for std::prev
+#include <map>          // for the staircase of the filter
+#include <string>       // for std::string
+#include <vector>       // for std::vector
+#include "chipload.h"   // for external user defined functions
+
+#define PARETO_CHUNK 256    // samples filtered together in the first step
+
+// Orders the samples so none is dominated by one after it: removal rate first, then roughness, then tool life
+static bool Before(const ParetoPoint &a, const ParetoPoint &b) {
+    if (a.removal != b.removal) return a.removal > b.removal;
+    if (a.roughness != b.roughness) return a.roughness < b.roughness;
+    return a.tool_life > b.tool_life;
+}
+
+/**
+ * Function: keeps the samples no sample before them dominates, a sample equal to one kept is dropped.
+ * In the order of Before a sample can only be dominated by an earlier one, which removes at least as much, so
+ * it's dominated if an earlier sample is at least as smooth and lasts at least as long. The earlier samples are
+ * kept as a staircase of roughness to tool life, where the life grows with the roughness, and the longest life
+ * at a roughness up to the sample's is the last step at or under it.
+ *
+ * Parameters:
+ * @param points: The samples, sorted with Before.
+ * @param count: The number of samples.
+ * @param front: The samples kept, in the same order.
+ */
+static void FilterSorted(const ParetoPoint *points, size_t count, std::vector<ParetoPoint> &front) {
+    std::map<float, float> steps; // roughness to tool life
+    for (size_t i = 0; i < count; i++) {
+        const ParetoPoint &point = points[i];
+        auto next = steps.upper_bound(point.roughness);
+        if (next != steps.begin() && std::prev(next)->second >= point.tool_life) continue;
+        // The steps it covers, as smooth or rougher with a shorter life, aren't steps anymore
+        while (next != steps.end() && next->second <= point.tool_life) next = steps.erase(next);
+        steps[point.roughness] = point.tool_life;
+        front.push_back(point);
+    }
+}
+
+/**
+ * Function: samples the feasible region of a solved job and finds the Pareto front of removal rate, roughness and tool life.
+ *
+ * Parameters:
+ * @param result: The solved job, for its chipload straights, tool and engagement.
+ * @param machine: The machine profile the job was solved for.
+ * @param samples: The number of rpm steps and of feedrate steps at each rpm.
+ * @param front: The samples on the front, by removal rate from the highest.
+ *
+ * Returns:
+ * @return The number of feasible samples.
+ */
+size_t ParetoFront(const JobResult &result, const Machine &machine, int samples, std::vector<ParetoPoint> &front) {
+    front.clear();
+    std::vector<ParetoPoint> points;
+    points.reserve((size_t)samples * samples);
+    float radius = std::max(result.effective_diameter, result.diameter * 0.01f) / 2;
+    float teeth = std::max(result.tool_teeth, 1);
+
+    // Reference of the tool life, the gentlest corner of the region
+    float reference_rpm = machine.min_speed;
+    float reference_tooth = std::max(result.lower_bound * reference_rpm, 1.0f) / (reference_rpm * teeth);
+
+    for (int column = 0; column < samples; column++) {
+        float rpm = machine.min_speed + (float)(machine.max_speed - machine.min_speed) * column / std::max(samples - 1, 1);
+        float low = std::max(result.lower_bound * rpm, 1.0f);
+        float high = std::min(result.upper_bound * rpm, (float)machine.max_feed);
+        if (result.power_per_feed > 0) {
+            high = std::min(high, SpindlePower(machine, rpm) / result.power_per_feed);
+        }
+        if (high < low) continue;
+        for (int row = 0; row < samples; row++) {
+            ParetoPoint point;
+            point.rpm = (int)rpm;
+            point.feed = low + (high - low) * row / std::max(samples - 1, 1);
+            point.feed_per_tooth = point.feed / (rpm * teeth);
+            point.removal = result.stepover * result.depth * point.feed / 1000;
+            point.roughness = point.feed_per_tooth * point.feed_per_tooth / (8 * radius) * 1000;
+            point.tool_life = pow(reference_rpm / rpm, 1 / TAYLOR_N) * pow(reference_tooth / point.feed_per_tooth, TAYLOR_FEED / TAYLOR_N);
+            point.power = result.power_per_feed * point.feed;
+            points.push_back(point);
+        }
+    }
+
+    // Non-dominated samples of each chunk in parallel, then the survivors of every chunk filtered together
+    size_t chunks = (points.size() + PARETO_CHUNK - 1) / PARETO_CHUNK;
+    std::vector<std::vector<ParetoPoint>> survivors(chunks);
+    ParallelFor(chunks, [&](size_t c) {
+        size_t begin = c * PARETO_CHUNK, end = std::min(points.size(), begin + PARETO_CHUNK);
+        std::sort(points.begin() + begin, points.begin() + end, Before);
+        FilterSorted(&points[begin], end - begin, survivors[c]);
+    });
+    std::vector<ParetoPoint> merged;
+    for (const std::vector<ParetoPoint> &chunk : survivors) merged.insert(merged.end(), chunk.begin(), chunk.end());
+    std::sort(merged.begin(), merged.end(), Before);
+    FilterSorted(merged.data(), merged.size(), front);
+    return points.size();
+}
+
+/**
+ * Function: loads the chipload table and the jobs of a file, then writes the Pareto front of each job to a .csv file.
+ *
+ * Parameters:
+ * @param file_chipload: The chipload table .csv file.
+ * @param file_jobs: The jobs file (see ReadJobsFromFile).
+ * @param file_output: The .csv file written, one row per point of each front.
+ * @param samples: The number of rpm steps and of feedrate steps at each rpm.
+ *
+ * Returns:
+ * @return 0 if every front was written, otherwise the first error code found (16 for a bad number of samples).
+ */
+int RunPareto(const std::string &file_chipload, const std::string &file_jobs, const std::string &file_output, int samples) {
+    if (samples < 2) {
+        printf("The samples are the rpm and feedrate steps of the grid, ex.: %d\n", PARETO_SAMPLES);
+        return 16;
+    }
+    FuzzyIndex material_index;
+    std::vector<Job> jobs;
+    int error = LoadTableAndJobs(file_chipload, file_jobs, material_index, jobs);
+    if (error != 0) {
+        return error;
+    }
+    FILE *file = fopen(file_output.c_str(), "w");
+    if (file == nullptr) {
+        std::cerr << "Error opening file " << file_output << std::endl;
+        Unload();
+        return 15;
+    }
+    fprintf(file, "job,material,diameter_mm,rpm,feed_mm_per_min,feed_per_tooth_mm,mrr_cm3_per_min,roughness_um,tool_life,power_w\n");
+
+    auto start = std::chrono::steady_clock::now();
+    int first_error = 0;
+    size_t total_front = 0;
+    std::vector<ParetoPoint> front;
+    for (size_t i = 0; i < jobs.size(); i++) {
+        JobResult result;
+        int error = SolveJob(jobs[i], material_index, machine, result);
+        if (error != 0 && error != 14) { // a bad output unit doesn't change the feasible region
+            printf("Job %zu: error %d, no front\n", i + 1, error);
+            if (first_error == 0) first_error = error;
+            continue;
+        }
+        if (result.specific_energy <= 0) {
+            printf("Job %zu: no cutting energy for %s, the spindle power doesn't bound the front\n", i + 1, result.material.c_str());
+        }
+        auto job_start = std::chrono::steady_clock::now();
+        size_t feasible = ParetoFront(result, machine, samples, front);
+        double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - job_start).count();
+        for (const ParetoPoint &point : front) {
+            fprintf(file, "%zu,%s,%.3f,%d,%.0f,%.4f,%.2f,%.3f,%.3f,%.0f\n", i + 1, result.material.c_str(), result.diameter,
+                    point.rpm, point.feed, point.feed_per_tooth, point.removal, point.roughness, point.tool_life, point.power);
+        }
+        printf("Job %zu: %s, %zu of %d samples feasible, %zu on the Pareto front in %.2f ms\n", i + 1, result.material.c_str(),
+               feasible, samples * samples, front.size(), milliseconds);
+        total_front += front.size();
+    }
+    bool written = fclose(file) == 0;
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("Explored %zu jobs on %d x %d samples, %zu points on the fronts, in %.3f s\n", jobs.size(), samples, samples, total_front, seconds);
+
+    Unload();
+    if (!written) return 15;
+    return first_error;
+}
@@ -0,0 +1,81 @@
+/**
+ * This file contains the following function definitions for running work on several threads:
+ * - ParallelFor
+ *
+ * The indices are split into chunks that are dealt round robin into one deque per worker.
+ * Each worker pops chunks from the back of its own deque and, once it runs dry, steals chunks
+ * from the front of the other workers' deques, so a few slow jobs don't leave threads idle.
+ */
+
+// Include headers & libraries
+#include <algorithm>    // for std::min and std::max
+#include <deque>        // for std::deque
+#include <mutex>        // for std::mutex
+#include <thread>       // for std::thread
+#include <vector>       // for std::vector
+#include "chipload.h"   // for external user defined functions
+
+// Represents the chunks of indices owned by a worker
+struct WorkQueue {
+    std::mutex lock;
+    std::deque<std::pair<size_t, size_t>> chunks; // [begin, end) ranges of indices
+};
+
+/**
+ * Function: runs body(i) for every i in [0, count) on a work-stealing pool of threads.
+ * Returns once every index has been processed, body must be safe to call from several threads.
+ *
+ * Parameters:
+ * @param count: The number of indices.
+ * @param body: The work for one index.
+ */
+void ParallelFor(size_t count, const std::function<void(size_t)> &body) {
+    if (count == 0) return;
+
+    size_t n_threads = std::max(1u, std::thread::hardware_concurrency());
+    n_threads = std::min(n_threads, count);
+    if (n_threads == 1) {
+        for (size_t i = 0; i < count; i++) body(i);
+        return;
+    }
+
+    // Several chunks per worker leave something to steal at the end of the run
+    size_t chunk = std::max<size_t>(1, count / (n_threads * 8));
+    std::vector<WorkQueue> queues(n_threads);
+    size_t owner = 0;
+    for (size_t begin = 0; begin < count; begin += chunk) {
+        queues[owner].chunks.emplace_back(begin, std::min(count, begin + chunk));
+        owner = (owner + 1) % n_threads;
+    }
+
+    auto worker = [&](size_t self) {
+        while (true) {
+            std::pair<size_t, size_t> range;
+            bool found = false;
+
+            // Own deque first (back), then steal from the others (front)
+            for (size_t k = 0; k < n_threads && !found; k++) {
+                WorkQueue &queue = queues[(self + k) % n_threads];
+                std::lock_guard<std::mutex> guard(queue.lock);
+                if (queue.chunks.empty()) continue;
+                if (k == 0) {
+                    range = queue.chunks.back();
+                    queue.chunks.pop_back();
+                } else {
+                    range = queue.chunks.front();
+                    queue.chunks.pop_front();
+                }
+                found = true;
+            }
+            // No work is added once the run starts, so empty deques everywhere means done
+            if (!found) return;
+
+            for (size_t i = range.first; i < range.second; i++) body(i);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < n_threads; t++) threads.emplace_back(worker, t);
+    worker(0);
+    for (std::thread &thread : threads) thread.join();
+}
@@ -0,0 +1,180 @@
+/**
+ * This file contains the following function definitions for the spindle power constraint:
+ * - SpecificCuttingEnergy
+ * - ParseSpindleCurve
+ * - SpindlePower
+ * - PowerConstraints
+ * - DescribeLimits
+ *
+ * Cutting takes the specific cutting energy of the material times the material removal rate. For the depth
+ * of cut the report suggests (half the tool diameter D) in a full slot (a width of D) at a feed y in mm/m:
+ *
+ *     power = energy * (D / 2) * D * y / 60    W, with the energy in J/mm3
+ *
+ * which is linear in y. The power the spindle gives is a piecewise linear curve over the rpm (ex.: constant
+ * torque up to the rated speed, then constant power). Each segment of the curve, extended over the whole rpm
+ * range, is a half-plane power_per_feed * y - slope * x <= intercept; for a concave curve (the usual shape)
+ * the intersection of those half-planes is exactly the area under the curve, for any other curve it's below
+ * it, so the constraint stays on the safe side. Either way the feasible region is still a convex polygon.
+ */
+
+// Include headers & libraries
+#include <algorithm>    // for std::sort and std::min
+#include <cstdio>       // for snprintf
+#include <cstdlib>      // for strtof
+#include <strings.h>    // for strcasecmp
+#include <string>       // for std::string
+#include <vector>       // for std::vector
+#include "chipload.h"   // for external user defined functions
+
+// Specific cutting energy of the materials of the chipload table in J/mm3, usual handbook values
+static const struct {
+    const char *material;
+    float energy;
+} cutting_energy[] = {
+    {"Aluminium", 0.7f},
+    {"Steel", 2.7f},
+    {"Hard Plastic", 0.12f},
+    {"Soft Plastic", 0.06f},
+    {"Hard Wood", 0.05f},
+    {"Soft Wood", 0.03f},
+    {"Plywood", 0.04f},
+    {"MDF", 0.05f},
+};
+
+/**
+ * Function: looks up the specific cutting energy of a material, ignoring case.
+ *
+ * Parameters:
+ * @param material: The material, as named in the chipload table.
+ *
+ * Returns:
+ * @return The energy in J/mm3, or 0 if the material isn't known: the spindle power can't be checked and
+ * SolveJob raises warning 17.
+ */
+float SpecificCuttingEnergy(const std::string &material) {
+    for (const auto &entry : cutting_energy) {
+        if (strcasecmp(material.c_str(), entry.material) == 0) {
+            return entry.energy;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Function: parses a spindle power curve written as rpm:W pairs separated by spaces, ex.: "6000:750 18000:2200 24000:2200".
+ *
+ * Parameters:
+ * @param text: The curve.
+ * @param curve: The points, sorted by rpm.
+ *
+ * Returns:
+ * @return true if the curve was parsed (an empty text is an empty curve), false otherwise, also when two points
+ * share an rpm (the straight between them would have no slope).
+ */
+bool ParseSpindleCurve(const std::string &text, std::vector<SpindlePoint> &curve) {
+    curve.clear();
+    const char *p = text.c_str();
+    while (true) {
+        while (*p == ' ' || *p == '\t') p++;
+        if (*p == '\0') break;
+        char *end;
+        SpindlePoint point;
+        point.rpm = strtof(p, &end);
+        if (end == p || *end != ':') return false;
+        p = end + 1;
+        point.power = strtof(p, &end);
+        if (end == p || point.rpm <= 0 || point.power <= 0 || curve.size() == MAX_SPINDLE_POINTS) return false;
+        curve.push_back(point);
+        p = end;
+    }
+    std::sort(curve.begin(), curve.end(), [](const SpindlePoint &a, const SpindlePoint &b) { return a.rpm < b.rpm; });
+    for (size_t i = 1; i < curve.size(); i++) {
+        if (curve[i].rpm <= curve[i - 1].rpm) return false;
+    }
+    return true;
+}
+
+/**
+ * Function: computes the power the spindle gives at a speed, the rated power capped by the curve.
+ *
+ * Parameters:
+ * @param machine: The machine profile.
+ * @param rpm: The speed.
+ *
+ * Returns:
+ * @return The power in W.
+ */
+float SpindlePower(const Machine &machine, float rpm) {
+    float power = machine.power;
+    const std::vector<SpindlePoint> &curve = machine.spindle_curve;
+    if (curve.size() == 1) {
+        power = std::min(power, curve[0].power);
+    }
+    for (size_t i = 1; i < curve.size(); i++) {
+        float slope = (curve[i].power - curve[i - 1].power) / (curve[i].rpm - curve[i - 1].rpm);
+        power = std::min(power, curve[i - 1].power + slope * (rpm - curve[i - 1].rpm));
+    }
+    return power;
+}
+
+/**
+ * Function: builds the half-planes of the power constraint, one for the rated power and one per segment of the curve.
+ *
+ * Parameters:
+ * @param machine: The machine profile.
+ * @param power_per_feed: The cutting power in W per mm/m of feed, no half-planes if it's 0.
+ * @param planes: The half-planes, room for MAX_SPINDLE_POINTS of them.
+ *
+ * Returns:
+ * @return The number of half-planes.
+ */
+int PowerConstraints(const Machine &machine, float power_per_feed, HalfPlane planes[]) {
+    if (power_per_feed <= 0) {
+        return 0;
+    }
+    int count = 0;
+    planes[count++] = {0, power_per_feed, machine.power, CONSTRAINT_POWER};
+    const std::vector<SpindlePoint> &curve = machine.spindle_curve;
+    if (curve.size() == 1) {
+        planes[count++] = {0, power_per_feed, curve[0].power, CONSTRAINT_POWER};
+    }
+    for (size_t i = 1; i < curve.size(); i++) {
+        double slope = (double)(curve[i].power - curve[i - 1].power) / (curve[i].rpm - curve[i - 1].rpm);
+        planes[count++] = {-slope, power_per_feed, curve[i - 1].power - slope * curve[i - 1].rpm, CONSTRAINT_POWER};
+    }
+    return count;
+}
+
+/**
+ * Function: describes the constraints active at the feeds of a job, ex.: "max rpm and spindle power (2200 of 2200 W)".
+ * The power is what the job takes of what the spindle gives at its rpm.
+ *
+ * Returns:
+ * @return The description, empty if no constraint is active.
+ */
+std::string DescribeLimits(const JobResult &result) {
+    static const struct {
+        int constraint;
+        const char *name;
+    } names[] = {
+        {CONSTRAINT_MIN_SPEED, "min rpm"},
+        {CONSTRAINT_MAX_SPEED, "max rpm"},
+        {CONSTRAINT_MAX_FEED, "max feedrate"},
+        {CONSTRAINT_MAX_CHIPLOAD, "max chipload"},
+        {CONSTRAINT_MIN_CHIPLOAD, "min chipload"},
+        {CONSTRAINT_POWER, "spindle power"},
+    };
+    std::string text;
+    for (const auto &entry : names) {
+        if (!(result.binding & entry.constraint)) continue;
+        if (!text.empty()) text += " and ";
+        text += entry.name;
+    }
+    if (result.binding & CONSTRAINT_POWER) {
+        char power[48];
+        snprintf(power, sizeof(power), " (%.0f of %.0f W)", result.power, result.spindle_power);
+        text += power;
+    }
+    return text;
+}
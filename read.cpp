@@ -1,7 +1,10 @@
 #include <iostream>     // for standard C++ library input and output
 #include <fstream>      // for file stream operations
 #include <string>       // for std::string
+#include <string_view>  // for std::string_view
+#include <utility>      // for std::move
 #include <algorithm>    // for std::remove and std::find
+#include <vector>       // for std::vector
 #include "chipload.h"   // for external user defined functions
 
 // Function to trim newline characters from a std::string
@@ -10,8 +13,39 @@ void TrimNewline(std::string &str) {
     str.erase(std::remove(str.begin(), str.end(), '\r'), str.end());
 }
 
-// Function to read data from a file and populate the variables
-bool ReadFromFile(const std::string &filename, bool &beginner, std::string &material, std::string &tool_diam, std::string &tool_z, std::string &job_quality, std::string &out_units, bool &checklist, bool &supported_materials_list) {
+// Function to parse one line of the input file into the matching job field, returns false if the line holds no field
+static bool ReadJobLine(const std::string &line, Job &job) {
+    if (line.rfind("I'm a beginner:", 0) == 0) {
+        job.beginner = (line.find('y') != std::string::npos || line.find('Y') != std::string::npos);
+    } else if (line.rfind("Material to cut:", 0) == 0) {
+        job.material.assign(line, 16); // Extract material from line
+    } else if (line.rfind("Tool Diameter:", 0) == 0) {
+        job.tool.assign(line, 14); // Extract tool diameter from line
+    } else if (line.rfind("Tool Flutes:", 0) == 0) {
+        job.tool_teeth.assign(line, 12); // Extract tool flutes from line
+    } else if (line.rfind("Job Quality:", 0) == 0) {
+        job.job_quality.assign(line, 12); // Extract job quality from line
+    } else if (line.rfind("I want to get the FeedRate in:", 0) == 0) {
+        job.out_unit.assign(line, 30); // Extract output units from line
+    } else if (line.rfind("Print a generic CNC CHECKLIST for the job:", 0) == 0) {
+        job.checklist = (line.find('y') != std::string::npos || line.find('Y') != std::string::npos);
+    } else if (line.rfind("Print a LIST of supported materials:", 0) == 0) {
+        job.supported_materials_list = (line.find('y') != std::string::npos || line.find('Y') != std::string::npos);
+    } else if (line.rfind("Stepover:", 0) == 0) {
+        job.stepover.assign(line, 9); // Extract radial engagement from line
+    } else if (line.rfind("Depth of cut:", 0) == 0) {
+        job.depth.assign(line, 13); // Extract axial depth of cut from line
+    } else if (line.rfind("Ball nose:", 0) == 0) {
+        job.ball_nose = (line.find('y', 10) != std::string::npos || line.find('Y', 10) != std::string::npos);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Function to read data from a file into a job, fields the file doesn't hold keep their value
+bool ReadFromFile(const std::string &filename, Job &job) {
+    StageTimer timer(STAGE_READ);
     std::ifstream file(filename); // Open file in read mode
     if (!file.is_open()) {        // Handle case where file can't be accessed
         std::cerr << "Error opening file" << std::endl;
@@ -22,26 +56,110 @@ bool ReadFromFile(const std::string &filename, bool &beginner, std::string &mate
 
     while (std::getline(file, line)) { // Read file line by line until EOF
         TrimNewline(line); // Trim newline characters from line
+        ReadJobLine(line, job);
+    }
+
+    file.close(); // Close file
+    return true;  // Return success
+}
+
+// Function to check a yes / no field
+static bool IsYes(std::string_view field) {
+    return field.find('y') != std::string_view::npos || field.find('Y') != std::string_view::npos;
+}
+
+/**
+ * ReadJobsFromFile: reads a list of jobs for the batch mode.
+ *
+ * A .csv file holds one job per line after a header line, with the columns:
+ * material, tool diameter, flutes, job quality, output unit, beginner (optional), checklist (optional), materials list (optional),
+ * stepover (optional), depth of cut (optional), ball nose (optional)
+ *
+ * Any other file holds several blocks in the SpeedNFeeds.txt format, separated by lines starting with "===",
+ * blocks without any field (like the title block) are skipped.
+ *
+ * Parameters:
+ * @param filename The name of the file to read from.
+ * @param jobs The jobs read, in file order.
+ *
+ * Returns:
+ * @return true if the file was successfully read, false otherwise.
+ */
+bool ReadJobsFromFile(const std::string &filename, std::vector<Job> &jobs) {
+    StageTimer timer(STAGE_READ);
+    std::ifstream file(filename); // Open file in read mode
+    if (!file.is_open()) {        // Handle case where file can't be accessed
+        std::cerr << "Error opening file " << filename << std::endl;
+        return false;
+    }
+
+    std::string line;
+    bool csv = filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".csv") == 0;
 
-        if (line.rfind("I'm a beginner:", 0) == 0) {
-            beginner = (line.find('y') != std::string::npos || line.find('Y') != std::string::npos);
-        } else if (line.rfind("Material to cut:", 0) == 0) {
-            material = line.substr(16); // Extract material from line
-        } else if (line.rfind("Tool Diameter:", 0) == 0) {
-            tool_diam = line.substr(14); // Extract tool diameter from line
-        } else if (line.rfind("Tool Flutes:", 0) == 0) {
-            tool_z = line.substr(12); // Extract tool flutes from line
-        } else if (line.rfind("Job Quality:", 0) == 0) {
-            job_quality = line.substr(12); // Extract job quality from line
-        } else if (line.rfind("I want to get the FeedRate in:", 0) == 0) {
-            out_units = line.substr(30); // Extract output units from line
-        } else if (line.rfind("Print a generic CNC CHECKLIST for the job:", 0) == 0) {
-            checklist = (line.find('y') != std::string::npos || line.find('Y') != std::string::npos);
-        } else if (line.rfind("Print a LIST of supported materials:", 0) == 0) {
-            supported_materials_list = (line.find('y') != std::string::npos || line.find('Y') != std::string::npos);
+    if (csv) {
+        std::getline(file, line); // Skip the header line
+        while (std::getline(file, line)) {
+            TrimNewline(line);
+            if (line.find_first_not_of(" \t,") == std::string::npos) continue; // Skip empty lines
+
+            std::string_view fields[11] = {};
+            SplitFields(line, ',', fields, 11);
+            Job job;
+            job.material = fields[0];
+            job.tool = fields[1];
+            job.tool_teeth = fields[2];
+            job.job_quality = fields[3];
+            job.out_unit = fields[4];
+            job.beginner = IsYes(fields[5]);
+            job.checklist = IsYes(fields[6]);
+            job.supported_materials_list = IsYes(fields[7]);
+            job.stepover = fields[8];
+            job.depth = fields[9];
+            job.ball_nose = IsYes(fields[10]);
+            jobs.push_back(std::move(job));
+        }
+    } else {
+        Job job;
+        bool has_fields = false;
+        while (std::getline(file, line)) {
+            TrimNewline(line);
+            if (line.rfind("===", 0) == 0) { // A separator closes the current block
+                if (has_fields) jobs.push_back(job);
+                job = Job();
+                has_fields = false;
+            } else if (ReadJobLine(line, job)) {
+                has_fields = true;
+            }
         }
+        if (has_fields) jobs.push_back(job);
     }
 
     file.close(); // Close file
     return true;  // Return success
 }
+
+/**
+ * LoadTableAndJobs: loads the chipload table, the fuzzy index over its materials and the jobs of a file,
+ * the start of the modes that solve a jobs file.
+ *
+ * Parameters:
+ * @param file_chipload The chipload table .csv file.
+ * @param file_jobs The jobs file (see ReadJobsFromFile).
+ * @param material_index The fuzzy index over the materials.
+ * @param jobs The jobs read, in file order.
+ *
+ * Returns:
+ * @return 0 with the table loaded (Unload it when done), otherwise 1, 2 or 3 with a message and the table unloaded.
+ */
+int LoadTableAndJobs(const std::string &file_chipload, const std::string &file_jobs, FuzzyIndex &material_index, std::vector<Job> &jobs) {
+    int error = LoadMaterialIndex(file_chipload, material_index);
+    if (error != 0) {
+        return error;
+    }
+    if (!ReadJobsFromFile(file_jobs, jobs)) {
+        printf("Failed to read from file.\n");
+        Unload();
+        return 3;
+    }
+    return 0;
+}
@@ -0,0 +1,233 @@
+/**
+ * This file contains the following function definitions for reloading the chipload table while it's in use:
+ * - TableReadGuard
+ * - TableGeneration
+ * - WatchTable
+ *
+ * A long running process (the daemon) watches the .csv file with inotify. When the file is written or replaced
+ * a background thread parses it into a new TableSnapshot (table and fuzzy index) and publishes it with a single
+ * atomic pointer swap, readers never wait for it. Reclamation is epoch based:
+ * - a reader announces the current epoch in its slot, then reads the pointer (TableReadGuard)
+ * - the publisher swaps the pointer, then advances the epoch, the old snapshot retires at the new epoch
+ * - a retired snapshot is freed once every busy slot announces that epoch or a later one, since those
+ *   readers read the pointer after the swap
+ * So a job that started on the old table finishes on it, and the table is never freed under it.
+ */
+
+// Include headers & libraries
+#include <atomic>       // for the published snapshot and the epochs
+#include <cerrno>       // for errno
+#include <chrono>       // for the debounce delay
+#include <cstdio>       // for standard input/output operations
+#include <cstring>      // for strerror
+#include <string>       // for std::string
+#include <thread>       // for the watcher thread
+#include <utility>      // for std::pair
+#include <vector>       // for std::vector
+#include <poll.h>       // for poll
+#include <sys/inotify.h> // for inotify
+#include <unistd.h>     // for read
+#include "chipload.h"   // for external user defined functions
+
+#define RECLAIM_INTERVAL_MS 1000    // how often the watcher frees retired snapshots without events
+#define RELOAD_DEBOUNCE_MS 100      // editors write a file in several steps, wait for the last one
+
+// Published snapshot, epoch and reader slots (0 in a slot means the thread isn't reading)
+static std::atomic<const TableSnapshot *> current_snapshot{nullptr};
+static std::atomic<uint64_t> generation{0};
+static std::atomic<uint64_t> global_epoch{1};
+static std::atomic<uint64_t> reader_epochs[MAX_TABLE_READERS];
+static std::atomic<bool> slot_taken[MAX_TABLE_READERS];
+
+// Reader slot and pinned snapshot of a thread, the slot is given back when the thread exits
+struct ReaderSlot {
+    int index = -1;
+    int depth = 0;                          // nested guards
+    const TableSnapshot *pinned = nullptr;
+
+    int Get() {
+        while (index < 0) {
+            for (int i = 0; i < MAX_TABLE_READERS && index < 0; i++) {
+                bool expected = false;
+                if (!slot_taken[i].load(std::memory_order_relaxed) && slot_taken[i].compare_exchange_strong(expected, true)) {
+                    index = i;
+                }
+            }
+            if (index < 0) std::this_thread::yield(); // every slot is busy, wait for a reader to exit
+        }
+        return index;
+    }
+
+    ~ReaderSlot() {
+        if (index >= 0) {
+            reader_epochs[index].store(0);
+            slot_taken[index].store(false);
+        }
+    }
+};
+
+static thread_local ReaderSlot reader;
+
+TableReadGuard::TableReadGuard() {
+    snapshot = nullptr;
+    if (reader.depth++ > 0) {
+        snapshot = reader.pinned;
+        return;
+    }
+    if (current_snapshot.load() == nullptr) return; // not watched
+    int slot = reader.Get();
+    reader_epochs[slot].store(global_epoch.load());
+    snapshot = reader.pinned = current_snapshot.load();
+    pinned_table = &snapshot->view;
+    pinned_table_hash = snapshot->hash;
+}
+
+TableReadGuard::~TableReadGuard() {
+    if (--reader.depth > 0) return;
+    reader.pinned = nullptr;
+    pinned_table = nullptr;
+    if (reader.index >= 0) reader_epochs[reader.index].store(0);
+}
+
+/**
+ * Function: returns the generation of the published chipload table, 0 if the table isn't watched.
+ */
+uint64_t TableGeneration() {
+    return generation.load(std::memory_order_relaxed);
+}
+
+/**
+ * Function: builds a snapshot from a chipload table, the same way Load does (the .csv rows win over the embedded ones).
+ *
+ * Parameters:
+ * @param filename: The .csv file, or empty to copy the global table.
+ * @param snapshot: The snapshot to build.
+ *
+ * Returns:
+ * @return true if the snapshot was built, false if the file can't be read or has no rows.
+ */
+static bool BuildSnapshot(const std::string &filename, TableSnapshot &snapshot) {
+    std::vector<TableRow> rows;
+    if (filename.empty()) {
+        TableRows(table, rows);
+    } else {
+        if (!ReadTableRows(filename, rows) || rows.empty()) return false;
+        TableRows(default_table, rows);
+    }
+    if (!BuildTable(rows, snapshot.data)) return false;
+    snapshot.view = TableView(snapshot.data);
+    snapshot.hash = HashTable(snapshot.view);
+
+    std::vector<std::string> materials;
+    for (unsigned int id = 0; id < snapshot.view.material_count; id++) {
+        materials.push_back(snapshot.view.names + snapshot.view.name_offsets[id]);
+    }
+    BuildFuzzyIndex(materials, snapshot.material_index);
+    return true;
+}
+
+/**
+ * Function: frees the retired snapshots no reader can still hold.
+ *
+ * Parameters:
+ * @param retired: The retired snapshots and the epoch they retired at, the freed ones are removed.
+ */
+static void Reclaim(std::vector<std::pair<const TableSnapshot *, uint64_t>> &retired) {
+    if (retired.empty()) return;
+    uint64_t oldest = UINT64_MAX;
+    for (int i = 0; i < MAX_TABLE_READERS; i++) {
+        uint64_t epoch = reader_epochs[i].load();
+        if (epoch != 0 && epoch < oldest) oldest = epoch;
+    }
+    for (size_t i = 0; i < retired.size();) {
+        if (retired[i].second <= oldest) {
+            delete retired[i].first;
+            retired[i] = retired.back();
+            retired.pop_back();
+        } else {
+            i++;
+        }
+    }
+}
+
+/**
+ * Function: waits for changes of the .csv file and publishes a new snapshot after each one, it never returns.
+ *
+ * Parameters:
+ * @param filename: The chipload table .csv file.
+ * @param fd: The inotify descriptor, watching the directory of the file.
+ */
+static void WatchLoop(std::string filename, int fd) {
+    std::string name = filename.substr(filename.find_last_of('/') + 1);
+    std::vector<std::pair<const TableSnapshot *, uint64_t>> retired;
+    alignas(inotify_event) char events[4096];
+    while (true) {
+        pollfd watched = {fd, POLLIN, 0};
+        int ready = poll(&watched, 1, RECLAIM_INTERVAL_MS);
+        Reclaim(retired);
+        if (ready <= 0) continue;
+
+        // Look for an event on the file, then let the writer finish and drop the events that followed
+        bool changed = false;
+        do {
+            ssize_t length = read(fd, events, sizeof(events));
+            for (char *p = events; length > 0 && p < events + length;) {
+                const inotify_event *event = reinterpret_cast<const inotify_event *>(p);
+                if (event->len > 0 && name == event->name) changed = true;
+                p += sizeof(inotify_event) + event->len;
+            }
+            if (changed) std::this_thread::sleep_for(std::chrono::milliseconds(RELOAD_DEBOUNCE_MS));
+            watched.revents = 0;
+        } while (changed && poll(&watched, 1, 0) > 0);
+        if (!changed) continue;
+
+        TableSnapshot *fresh = new TableSnapshot();
+        if (!BuildSnapshot(filename, *fresh)) {
+            fprintf(stderr, "Reload of %s failed, keeping generation %llu\n", filename.c_str(), (unsigned long long)TableGeneration());
+            delete fresh;
+            continue;
+        }
+        fresh->generation = TableGeneration() + 1;
+        const TableSnapshot *old = current_snapshot.exchange(fresh);
+        retired.emplace_back(old, global_epoch.fetch_add(1) + 1);
+        generation.store(fresh->generation);
+        CountMetric(METRIC_TABLE_RELOADS);
+        WriteSnapshot(filename, fresh->view); // best effort, so a restart loads the new table fast
+        fprintf(stderr, "Reloaded %s: generation %llu, %u materials, %u rows\n", filename.c_str(),
+                (unsigned long long)fresh->generation, fresh->view.material_count, fresh->view.row_count);
+        Reclaim(retired);
+    }
+}
+
+/**
+ * Function: publishes the loaded chipload table as generation 1 and starts watching its .csv file for changes.
+ * Call it once, after Load. Readers that want the reloaded tables read them through a TableReadGuard.
+ *
+ * Parameters:
+ * @param filename: The chipload table .csv file.
+ *
+ * Returns:
+ * @return true if the file is watched, false otherwise (the table stays the one loaded).
+ */
+bool WatchTable(const std::string &filename) {
+    size_t slash = filename.find_last_of('/');
+    std::string directory = slash == std::string::npos ? "." : filename.substr(0, slash + 1);
+    int fd = inotify_init1(IN_CLOEXEC);
+    if (fd < 0 || inotify_add_watch(fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        fprintf(stderr, "Can't watch %s: %s\n", filename.c_str(), strerror(errno));
+        if (fd >= 0) close(fd);
+        return false;
+    }
+
+    TableSnapshot *first = new TableSnapshot();
+    if (!BuildSnapshot("", *first)) {
+        delete first;
+        close(fd);
+        return false;
+    }
+    first->generation = 1;
+    generation.store(1);
+    current_snapshot.store(first);
+    std::thread(WatchLoop, filename, fd).detach();
+    return true;
+}
@@ -0,0 +1,237 @@
+/**
+ * This file contains the following function definitions for the calculator daemon:
+ * - RunServer
+ *
+ * The server loads the chipload table, the unique materials and their fuzzy index once and answers
+ * requests over a Unix domain socket, one thread per client. Requests and responses are single lines,
+ * so a client can pipeline several requests and read the responses back in order.
+ *
+ * Request (fields separated by ';', the fields after the output unit are optional):
+ *     material;tool diameter and unit;flutes;job quality;output unit;beginner;stepover;depth of cut;ball nose
+ *     ex.: softwood;1/4 inches;2;3;inch/s;no
+ *          aluminium;6 mm;3;3;mm/m;no;10%;6;no
+ *
+ * Response:
+ *     OK;rpm;feedrate;output unit;material;tool unit;warnings (comma separated codes, may be empty)
+ *     ERR;error code
+ *
+ * The request METRICS answers the stage metrics merged over every thread, as one line of JSON (see metrics.cpp).
+ * The request GENERATION answers OK;generation of the chipload table (0 if it isn't watched, see reload.cpp).
+ *
+ * With --watch the server reloads the chipload table when its .csv file changes, each request is solved on
+ * the table that was current when it started.
+ */
+
+// Include headers & libraries
+#include <cerrno>       // for errno
+#include <csignal>      // for ignoring SIGPIPE
+#include <cstdio>       // for standard input/output operations
+#include <cstring>      // for memchr and strerror
+#include <string>       // for std::string
+#include <string_view>  // for std::string_view
+#include <thread>       // for std::thread
+#include <vector>       // for std::vector
+#include <sys/socket.h> // for socket, bind, listen and accept
+#include <sys/un.h>     // for sockaddr_un
+#include <unistd.h>     // for read, write, close and unlink
+#include "chipload.h"   // for external user defined functions
+
+// Constant Expressions
+#define SERVER_BUFFER 65536 // bytes read from a client at once
+
+/**
+ * Function: parses a request line into a job.
+ *
+ * Parameters:
+ * @param line: The request, without the newline.
+ * @param job: The job to fill.
+ *
+ * Returns:
+ * @return true if the request has at least the five mandatory fields, false otherwise.
+ */
+static bool ParseRequest(const std::string &line, Job &job) {
+    std::string_view fields[9] = {};
+    size_t count = SplitFields(line, ';', fields, 9);
+    if (count < 5) {
+        return false;
+    }
+    job.material = fields[0];
+    job.tool = fields[1];
+    job.tool_teeth = fields[2];
+    job.job_quality = fields[3];
+    job.out_unit = fields[4];
+    job.beginner = fields[5].find('y') != std::string_view::npos || fields[5].find('Y') != std::string_view::npos;
+    job.stepover = fields[6];
+    job.depth = fields[7];
+    job.ball_nose = fields[8].find('y') != std::string_view::npos || fields[8].find('Y') != std::string_view::npos;
+    return true;
+}
+
+/**
+ * Function: answers one request line, appending the response line to a buffer.
+ *
+ * Parameters:
+ * @param line: The request, without the newline.
+ * @param material_index: The fuzzy index over the materials.
+ * @param response: The buffer the response is appended to.
+ */
+static void Answer(const std::string &line, const FuzzyIndex &material_index, std::string &response) {
+    if (line == "METRICS") {
+        response += MetricsJson(); // one line, already terminated
+        return;
+    }
+    if (line == "GENERATION") {
+        response += "OK;" + std::to_string(TableGeneration()) + "\n";
+        return;
+    }
+
+    Job job;
+    if (!ParseRequest(line, job)) {
+        response += "ERR;3\n"; // failed to read the input
+        return;
+    }
+
+    JobResult result;
+    TableReadGuard guard; // the table and its fuzzy index stay the same for the whole request
+    int error = SolveJob(job, guard.snapshot ? guard.snapshot->material_index : material_index, machine, result);
+    if (error != 0) {
+        response += "ERR;" + std::to_string(error) + "\n";
+        return;
+    }
+
+    char numbers[64];
+    snprintf(numbers, sizeof(numbers), "OK;%d;%.1f;", result.feeds.x, result.feed_rate);
+    response += numbers;
+    response += result.out_unit + ";" + result.material + ";" + result.tool_unit + ";";
+    for (size_t i = 0; i < result.warnings.size(); i++) {
+        if (i > 0) response += ",";
+        response += std::to_string(result.warnings[i]);
+    }
+    response += "\n";
+}
+
+/**
+ * Function: serves one client until it closes the connection.
+ * Every complete line read is answered, and the responses of one read are written back at once.
+ *
+ * Parameters:
+ * @param client: The connected socket.
+ * @param material_index: The fuzzy index over the materials.
+ */
+static void ServeClient(int client, const FuzzyIndex &material_index) {
+    std::vector<char> buffer(SERVER_BUFFER);
+    std::string pending;    // start of a request split between reads
+    std::string response;
+    std::string line;
+    bool discarding = false; // the rest of a line already answered as too long
+
+    while (true) {
+        ssize_t received = read(client, buffer.data(), buffer.size());
+        if (received <= 0) break;
+
+        const char *p = buffer.data();
+        const char *end = p + received;
+        response.clear();
+        while (p < end) {
+            const char *newline = static_cast<const char *>(memchr(p, '\n', end - p));
+            if (!newline) {
+                if (!discarding) pending.append(p, end);
+                break;
+            }
+            if (discarding) {
+                discarding = false;
+                p = newline + 1;
+                continue;
+            }
+            line.assign(pending);
+            line.append(p, newline);
+            pending.clear();
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (!line.empty()) Answer(line, material_index, response);
+            p = newline + 1;
+        }
+
+        // Guard against a client sending an endless line, answered once and skipped up to its newline
+        if (pending.size() > 16 * MAX_LINE_LENGTH) {
+            response += "ERR;3\n";
+            pending.clear();
+            discarding = true;
+        }
+
+        const char *out = response.data();
+        size_t left = response.size();
+        while (left > 0) {
+            ssize_t sent = write(client, out, left);
+            if (sent <= 0) {
+                close(client);
+                return;
+            }
+            out += sent;
+            left -= sent;
+        }
+    }
+    close(client);
+}
+
+/**
+ * Function: runs the calculator daemon on a Unix domain socket until it's killed.
+ *
+ * Parameters:
+ * @param file_chipload: The chipload table .csv file.
+ * @param socket_path: The path of the socket, replaced if it exists.
+ * @param watch: Reload the chipload table when its .csv file changes.
+ *
+ * Returns:
+ * @return 1 or 2 if the table couldn't be loaded, 17 if the socket couldn't be set up.
+ */
+int RunServer(const std::string &file_chipload, const std::string &socket_path, bool watch) {
+    if (!Load(file_chipload)) {
+        printf("Failed to Load materials\n");
+        return 1;
+    }
+    std::vector<std::string> unique_materials;
+    unsigned int unique_materials_count = 0;
+    if (!UniqueElements(unique_materials, &unique_materials_count)) {
+        printf("Memory allocation for unique materials has failed\n");
+        Unload();
+        return 2;
+    }
+    static FuzzyIndex material_index; // outlives the detached client threads
+    BuildFuzzyIndex(unique_materials, material_index);
+    if (watch && WatchTable(file_chipload)) {
+        printf("Watching %s for changes\n", file_chipload.c_str());
+    }
+
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path)) {
+        printf("Socket path too long: %s\n", socket_path.c_str());
+        return 17;
+    }
+    strcpy(address.sun_path, socket_path.c_str());
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(socket_path.c_str());
+    if (listener < 0 || bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || listen(listener, 128) != 0) {
+        printf("Couldn't listen on %s: %s\n", socket_path.c_str(), strerror(errno));
+        if (listener >= 0) close(listener);
+        return 17;
+    }
+    signal(SIGPIPE, SIG_IGN); // a client leaving mid response must not kill the server
+    printf("Serving %u materials on %s\n", unique_materials_count, socket_path.c_str());
+    fflush(stdout);
+
+    while (true) {
+        int client = accept(listener, nullptr, nullptr);
+        if (client < 0) {
+            if (errno == EINTR) continue;
+            printf("accept failed: %s\n", strerror(errno));
+            break;
+        }
+        std::thread(ServeClient, client, std::cref(material_index)).detach();
+    }
+
+    close(listener);
+    unlink(socket_path.c_str());
+    return 17;
+}
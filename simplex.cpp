@@ -1,8 +1,15 @@
 /**
  * This file contains the following function definitions for linear programming problems:
  * - is_feasible
+ * - SolveLP
  * - Simplex
+ * - GridSimplex
  * - Midpoint
+ *
+ * The feasible region is the convex polygon bounded by x_min <= x <= x_max, 0 <= y <= y_max, the
+ * chipload straights b * x <= y <= a * x and the spindle power half-planes (see power.cpp). SolveLP clips
+ * the rectangle by the straights and half-planes and evaluates the objective at each vertex, a linear
+ * objective is optimal at one of them. The constraints whose line goes through the optimum are the binding ones.
  */
 
 // Include headers & libraries
@@ -10,6 +17,7 @@
 #include <cfloat>     // for constants related to floating point values
 #include <cmath>      // for mathematical functions
 #include <vector>     // for using std::vector
+#include <algorithm>  // for std::max and std::min
 #include "chipload.h" // for external user defined functions
 
 /**
@@ -33,9 +41,158 @@ bool is_feasible(const Point &p, int x_min, int x_max, int y_max, float a, float
             p.y <= a * p.x);
 }
 
+// Use the grid walk instead of the exact solver (set with --grid-simplex)
+bool grid_simplex = false;
+
+#define MAX_POLYGON (6 + MAX_SPINDLE_POINTS) // each clip adds at most one vertex to the rectangle
+
+// Represents a vertex of the feasible region
+struct Vertex {
+    double x;
+    double y;
+};
+
+/**
+ * Function: Clip a convex polygon by the half-plane n_x * x + n_y * y <= c (Sutherland-Hodgman).
+ *
+ * Parameters:
+ * @param polygon The vertices of the polygon, in order, replaced by the clipped polygon.
+ * @param n_x The x coefficient of the half-plane.
+ * @param n_y The y coefficient of the half-plane.
+ * @param c The constant of the half-plane.
+ * @param count The number of vertices, updated.
+ */
+static void Clip(Vertex polygon[], double n_x, double n_y, double c, int &count) {
+    Vertex clipped[MAX_POLYGON];
+    int clipped_count = 0;
+    for (int i = 0; i < count; i++) {
+        const Vertex &p = polygon[i];
+        const Vertex &q = polygon[(i + 1) % count];
+        double dp = n_x * p.x + n_y * p.y - c;
+        double dq = n_x * q.x + n_y * q.y - c;
+        if (dp <= 0) {
+            clipped[clipped_count++] = p;
+        }
+        if ((dp < 0 && dq > 0) || (dp > 0 && dq < 0)) {
+            double t = dp / (dp - dq);
+            clipped[clipped_count++] = {p.x + t * (q.x - p.x), p.y + t * (q.y - p.y)};
+        }
+    }
+    for (int i = 0; i < clipped_count; i++) {
+        polygon[i] = clipped[i];
+    }
+    count = clipped_count;
+}
+
+/**
+ * Function: Solves the linear program max(c_x * x + c_y * y) exactly over the feasible region.
+ * If a whole edge is optimal (ex.: maximizing x along x = x_max) the middle of the edge is returned,
+ * which keeps the chipload centred between the two chipload straights.
+ *
+ * Parameters:
+ * @param x_min The minimum x value allowed.
+ * @param x_max The maximum x value allowed.
+ * @param y_max The maximum y value allowed.
+ * @param a The slope of the upper bound straight, a constraint of the feasible region
+ * @param b The slope of the lower bound straight, a constraint of the feasible region
+ * @param c_x The x coefficient of the objective function.
+ * @param c_y The y coefficient of the objective function.
+ * @param extra Further constraints of the feasible region, ex.: the spindle power (see PowerConstraints).
+ * @param n_extra The number of further constraints.
+ * @param binding If not null, set to the CONSTRAINT_ bits of the constraints active at the optimum.
+ *
+ * Return:
+ * @return The optimal point, with feasible set to false if the feasible region is empty.
+ */
+Solution SolveLP(int x_min, int x_max, int y_max, float a, float b, float c_x, float c_y, const HalfPlane extra[], int n_extra, int *binding) {
+    Solution solution = {0, 0, false};
+    if (x_min > x_max || y_max < MIN_Y) {
+        return solution;
+    }
+
+    Vertex polygon[MAX_POLYGON] = {{(double)x_min, MIN_Y}, {(double)x_max, MIN_Y}, {(double)x_max, (double)y_max}, {(double)x_min, (double)y_max}};
+    int count = 4;
+    Clip(polygon, -a, 1, 0, count);     // y <= a * x
+    Clip(polygon, b, -1, 0, count);     // y >= b * x
+    for (int i = 0; i < n_extra && count > 0; i++) {
+        Clip(polygon, extra[i].n_x, extra[i].n_y, extra[i].c, count);
+    }
+    if (count == 0) {
+        return solution;
+    }
+
+    CountMetric(METRIC_SOLVER_ITERATIONS, count);
+    double best_value = -DBL_MAX;
+    for (int i = 0; i < count; i++) {
+        best_value = std::max(best_value, c_x * polygon[i].x + c_y * polygon[i].y);
+    }
+
+    // An optimal edge has two optimal vertices, take its middle
+    const double epsilon = 1e-9 * std::max(1.0, std::fabs((double)c_x) * x_max + std::fabs((double)c_y) * y_max);
+    Vertex first = {DBL_MAX, DBL_MAX};
+    Vertex last = {-DBL_MAX, -DBL_MAX};
+    for (int i = 0; i < count; i++) {
+        if (c_x * polygon[i].x + c_y * polygon[i].y >= best_value - epsilon) {
+            if (polygon[i].x + polygon[i].y < first.x + first.y) first = polygon[i];
+            if (polygon[i].x + polygon[i].y > last.x + last.y) last = polygon[i];
+        }
+    }
+    Vertex optimum = {(first.x + last.x) / 2, (first.y + last.y) / 2};
+    solution = {(float)optimum.x, (float)optimum.y, true};
+
+    if (binding != nullptr) {
+        // A constraint binds if the optimum lies on its line, within a relative tolerance
+        auto on_line = [&](double n_x, double n_y, double c) {
+            double slack = c - (n_x * optimum.x + n_y * optimum.y);
+            return std::fabs(slack) <= 1e-6 * std::max(1.0, std::fabs(n_x) * x_max + std::fabs(n_y) * y_max);
+        };
+        *binding = (on_line(-1, 0, -x_min) ? CONSTRAINT_MIN_SPEED : 0) | (on_line(1, 0, x_max) ? CONSTRAINT_MAX_SPEED : 0) |
+                   (on_line(0, 1, y_max) ? CONSTRAINT_MAX_FEED : 0) | (on_line(-a, 1, 0) ? CONSTRAINT_MAX_CHIPLOAD : 0) |
+                   (on_line(b, -1, 0) ? CONSTRAINT_MIN_CHIPLOAD : 0);
+        for (int i = 0; i < n_extra; i++) {
+            if (on_line(extra[i].n_x, extra[i].n_y, extra[i].c)) *binding |= extra[i].constraint;
+        }
+    }
+    return solution;
+}
+
+/**
+ * Function: Finds the optimal point maximizing x or y within the given constraints.
+ *
+ * Parameters:
+ * @param machine The machine profile, its speed range and max feedrate bound the feasible region.
+ * @param a The slope of the upper bound straight, a constraint of the feasible region
+ * @param b The slope of the lower bound straight, a constraint of the feasible region
+ * @param power_per_feed The cutting power in W per mm/m of feed, 0 leaves the spindle power out.
+ * @param maximize_y Flag to indicate whether to maximize y (true) or x (false).
+ * @param optimum The optimal point, rounded to whole rpm and mm/m.
+ * @param binding If not null, set to the CONSTRAINT_ bits of the constraints active at the optimum.
+ * 
+ * Return:
+ * @return true if the feasible region isn't empty, false otherwise (optimum is set to {0, 0}).
+ */
+bool Simplex(const Machine &machine, float a, float b, float power_per_feed, bool maximize_y, Point &optimum, int *binding) {
+    int x_min = machine.min_speed;
+    int x_max = machine.max_speed;
+    int y_max = machine.max_feed;
+    if (grid_simplex) {
+        // The grid walk only knows the rectangle and the chipload straights
+        optimum = GridSimplex(x_min, x_max, y_max, a, b, maximize_y);
+        if (binding != nullptr) *binding = 0;
+        return optimum.x != 0 || optimum.y != 0;
+    }
+
+    HalfPlane power[MAX_SPINDLE_POINTS];
+    int n_power = PowerConstraints(machine, power_per_feed, power);
+    Solution solution = SolveLP(x_min, x_max, y_max, a, b, maximize_y ? 0 : 1, maximize_y ? 1 : 0, power, n_power, binding);
+    optimum = {(int)std::lround(solution.x), (int)std::lround(solution.y)};
+    return solution.feasible;
+}
+
 /**
- * Function: Implements the Simplex algorithm to find the optimal point based on given constraints.
+ * Function: Finds the optimal point based on given constraints by walking a grid of 100 rpm by 50 mm/m.
  * It iterates over possible x or y values within bounds to maximize the objective function value.
+ * This was the original Simplex, kept to compare results (run with --grid-simplex), it returns {0, 0} if it finds no feasible point.
  *
  * Parameters:
  * @param x_min The minimum x value allowed.
@@ -48,9 +205,10 @@ bool is_feasible(const Point &p, int x_min, int x_max, int y_max, float a, float
  * Return:
  * @return The optimal point that maximizes the objective function value within the constraints.
  */
-Point Simplex(int x_min, int x_max, int y_max, float a, float b, bool maximize_y) {
+Point GridSimplex(int x_min, int x_max, int y_max, float a, float b, bool maximize_y) {
     Point best_point = {0, 0};
     float best_value = -FLT_MAX; // Initialize to the lowest possible negative float to ensure maximization
+    uint64_t iterations = 0;     // grid points visited, for the metrics
 
     if (maximize_y) {
         // Maximize y by iterating over possible x values
@@ -63,6 +221,7 @@ Point Simplex(int x_min, int x_max, int y_max, float a, float b, bool maximize_y
             y_max_limit = std::min(y_max, y_max_limit);
 
             for (int y = y_min; y <= y_max_limit; y += 50) {
+                iterations++;
                 Point p = {x, y};
                 if (is_feasible(p, x_min, x_max, y_max, a, b) && p.y > best_value) {
                     best_point = p;
@@ -81,6 +240,7 @@ Point Simplex(int x_min, int x_max, int y_max, float a, float b, bool maximize_y
             x_max_limit = std::min(x_max, x_max_limit);
 
             for (int x = x_min_limit; x <= x_max_limit; x += 100) {
+                iterations++;
                 Point p = {x, y};
                 if (is_feasible(p, x_min, x_max, y_max, a, b) && p.x > best_value) {
                     best_point = p;
@@ -90,6 +250,7 @@ Point Simplex(int x_min, int x_max, int y_max, float a, float b, bool maximize_y
         }
     }
 
+    CountMetric(METRIC_SOLVER_ITERATIONS, iterations);
     return best_point;
 }
 
@@ -97,15 +258,18 @@ Point Simplex(int x_min, int x_max, int y_max, float a, float b, bool maximize_y
  * Function: Calculate the midpoint of a given range based on the provided constraints.
  *
  * Parameters:
- * @param x_min The minimum x value allowed.
- * @param x_max The maximum x value allowed.
- * @param y_max The maximum y value allowed.
+ * @param machine The machine profile, its speed range and max feedrate bound the feasible region.
  * @param c The slope of the straight-segment for the midpoint
+ * @param power_per_feed The cutting power in W per mm/m of feed, the feedrate is capped by the spindle power at the middle rpm (0 for no cap).
+ * @param binding If not null, set to CONSTRAINT_POWER if the returned feedrate is on (or over) the spindle power cap, 0 otherwise.
  * 
  * Return:
  * @return The midpoint point that satisfies the constraints.
  */
-Point Midpoint(int x_min, int x_max, int y_max, float c) {
+Point Midpoint(const Machine &machine, float c, float power_per_feed, int *binding) {
+    int x_min = machine.min_speed;
+    int x_max = machine.max_speed;
+    int y_max = machine.max_feed;
     int mid_x = (x_min + x_max) / 2;
     int y_min_at_mid_x = static_cast<int>(c * mid_x);
 
@@ -113,6 +277,11 @@ Point Midpoint(int x_min, int x_max, int y_max, float c) {
     y_min_at_mid_x = std::max(MIN_Y, y_min_at_mid_x);
 
     int y_max_at_mid_x = y_max;
+    bool power_capped = false;
+    if (power_per_feed > 0 && SpindlePower(machine, mid_x) / power_per_feed < y_max) {
+        y_max_at_mid_x = std::max(0, (int)(SpindlePower(machine, mid_x) / power_per_feed));
+        power_capped = true;
+    }
     int mid_y = (y_min_at_mid_x + y_max_at_mid_x) / 2;
 
     Point midpoint = {mid_x, mid_y};
@@ -126,5 +295,7 @@ Point Midpoint(int x_min, int x_max, int y_max, float c) {
         midpoint.y = mid_y;
     }
 
+    // The cap only binds when the feedrate ends up on it, halfway under it the power has room left
+    if (binding != nullptr) *binding = power_capped && midpoint.y >= y_max_at_mid_x ? CONSTRAINT_POWER : 0;
     return midpoint;
 }
@@ -0,0 +1,475 @@
+/**
+ * This file contains the following function definitions for simulating the stock removed by a G-code program:
+ * - SimulateGcode
+ * - RunSimulate
+ *
+ * One feed per tool is wrong for a pocket that alternates between slotting and light side cuts. The simulator
+ * replays the program against a heightmap of the stock (a 2.5D grid of the height of the material in each cell)
+ * and measures what each move really cuts:
+ * - the stock is a block with its top at Z0, covering the area the program cuts below Z0
+ * - each move lowers the cells under the tool to its bottom (flat or ball nose), arcs are cut as chords
+ * - the radial engagement of a move is the area it cut divided by its length in XY (capped at the diameter),
+ *   its axial engagement is the deepest material it removed
+ * The feed of a move is the feed of its tool scaled by the chip-thinning factor of that engagement against the
+ * one the tool was solved for (the rpm stays the tool's), capped by the max feedrate and by the spindle power
+ * for the volume the move removes. Moves that cut nothing are air cuts and get the largest factor.
+ *
+ * The grid is split in square tiles. The moves are simulated in batches: each move of a batch is binned into
+ * the tiles it may touch, then the tiles are cut in parallel, each one applying its moves in program order, so
+ * every cell sees the same sequence of cuts as in a serial replay. The results of the tiles are added up after
+ * the batch.
+ */
+
+// Include headers & libraries
+#include <algorithm>    // for std::min, std::max and std::find_if
+#include <chrono>       // for timing the run
+#include <cmath>        // for sqrt, atan2 and ceil
+#include <cstdio>       // for standard input/output operations
+#include <cstring>      // for memchr and strlen
+#include <limits>       // for std::numeric_limits
+#include <string>       // for std::string
+#include <vector>       // for std::vector
+#include "chipload.h"   // for external user defined functions
+
+#define STOCK_TOP 0.0f          // Z of the top of the stock in mm
+
+// Represents a straight piece of a move, an arc is cut in several of them
+struct StockSegment {
+    float from[3];          // mm
+    float to[3];            // mm
+    uint32_t move;          // index in the moves
+};
+
+// Represents a cutting move of a tool of the tool map and what it removed
+struct StockMove {
+    size_t line;            // line of the program, from 0
+    int tool;               // index in the tool map
+    bool moves_xy;          // false for a plunge, which keeps the feed of the program
+    float length_xy = 0;    // mm
+    float length = 0;       // mm, along the path
+    double removed = 0;     // mm3
+    double area = 0;        // mm2 of cells cut
+    float depth = 0;        // mm, deepest material removed
+    float feed = 0;         // mm/m
+};
+
+// Represents the part of a move cut in one tile
+struct TileCut {
+    uint32_t segment;
+    uint32_t cells = 0;
+    float depth = 0;
+    double removed = 0;
+};
+
+// Represents the stock, the height of each cell of a grid in mm
+struct Heightmap {
+    float x0, y0;           // corner of the first cell in mm
+    float cell;             // size of a cell in mm
+    int columns, rows;
+    std::vector<float> heights;
+};
+
+/**
+ * Function: cuts the cells of a tile under a segment and records what the segment removed there.
+ *
+ * Parameters:
+ * @param stock: The stock.
+ * @param segment: The segment.
+ * @param radius: The tool radius in mm.
+ * @param ball_nose: true for a ball nose tool.
+ * @param columns: The first and past the last column of the tile and of the segment.
+ * @param rows: The first and past the last row of the tile and of the segment.
+ * @param cut: The cells cut, deepest cut and volume removed, added to.
+ */
+static void CutCells(Heightmap &stock, const StockSegment &segment, float radius, bool ball_nose, const int columns[2], const int rows[2], TileCut &cut) {
+    const float *a = segment.from, *b = segment.to;
+    float dx = b[0] - a[0], dy = b[1] - a[1], dz = b[2] - a[2];
+    float length = std::sqrt(dx * dx + dy * dy);
+    bool plunge = length < 1e-6f;
+    float ux = plunge ? 0 : dx / length, uy = plunge ? 0 : dy / length;
+    float r2 = radius * radius;
+    float lowest = std::min(a[2], b[2]);
+
+    for (int row = rows[0]; row < rows[1]; row++) {
+        float py = stock.y0 + (row + 0.5f) * stock.cell - a[1];
+        float *heights = &stock.heights[(size_t)row * stock.columns];
+        for (int column = columns[0]; column < columns[1]; column++) {
+            if (heights[column] <= lowest) continue; // already cut as deep as the segment goes
+            float px = stock.x0 + (column + 0.5f) * stock.cell - a[0];
+            float along = px * ux + py * uy;                // from the start, along the segment
+            float across = plunge ? 0 : px * uy - py * ux;   // from the line of the segment
+            float bottom;
+            if (plunge) {
+                float d2 = px * px + py * py;
+                if (d2 > r2) continue;
+                bottom = lowest + (ball_nose ? radius - std::sqrt(r2 - d2) : 0);
+            } else if (ball_nose) {
+                // Lowest point of the ball over the cell, from the closest position of the tool
+                float t = std::min(std::max(along, 0.0f), length);
+                float d2 = (along - t) * (along - t) + across * across;
+                if (d2 > r2) continue;
+                bottom = a[2] + dz * t / length + radius - std::sqrt(r2 - d2);
+            } else {
+                // The tool covers the cell from along - h to along + h, Z is lowest at one end of that range
+                if (across * across > r2) continue;
+                float h = std::sqrt(r2 - across * across);
+                float low = std::max(along - h, 0.0f), high = std::min(along + h, length);
+                if (low > high) continue;
+                bottom = a[2] + std::min(dz * low, dz * high) / length;
+            }
+            float removed = heights[column] - bottom;
+            if (removed > 0) {
+                cut.removed += removed;
+                cut.cells++;
+                cut.depth = std::max(cut.depth, removed);
+                heights[column] = bottom;
+            }
+        }
+    }
+}
+
+/**
+ * Function: replays segments against the stock and adds what each one removed to its move.
+ *
+ * Parameters:
+ * @param stock: The stock, cut by the segments.
+ * @param segments: The segments, in program order.
+ * @param moves: The moves of the segments.
+ * @param tools: The tool map, for the diameter and the shape of each tool.
+ */
+static void SimulateStock(Heightmap &stock, const std::vector<StockSegment> &segments, std::vector<StockMove> &moves, const std::vector<Tool> &tools) {
+    int tiles_x = (stock.columns + STOCK_TILE - 1) / STOCK_TILE;
+    int tiles_y = (stock.rows + STOCK_TILE - 1) / STOCK_TILE;
+    std::vector<std::vector<TileCut>> bins((size_t)tiles_x * tiles_y);
+    std::vector<uint32_t> active;
+    float cell_area = stock.cell * stock.cell;
+
+    // Cells under the segment, for its tool
+    auto bounds = [&](const StockSegment &segment, int columns[2], int rows[2]) {
+        float radius = tools[moves[segment.move].tool].result.diameter / 2;
+        float x[2] = {std::min(segment.from[0], segment.to[0]) - radius, std::max(segment.from[0], segment.to[0]) + radius};
+        float y[2] = {std::min(segment.from[1], segment.to[1]) - radius, std::max(segment.from[1], segment.to[1]) + radius};
+        columns[0] = std::max(0, (int)std::floor((x[0] - stock.x0) / stock.cell));
+        columns[1] = std::min(stock.columns, (int)std::floor((x[1] - stock.x0) / stock.cell) + 1);
+        rows[0] = std::max(0, (int)std::floor((y[0] - stock.y0) / stock.cell));
+        rows[1] = std::min(stock.rows, (int)std::floor((y[1] - stock.y0) / stock.cell) + 1);
+    };
+
+    for (size_t begin = 0; begin < segments.size(); begin += STOCK_BATCH) {
+        size_t end = std::min(segments.size(), begin + STOCK_BATCH);
+
+        // Bin the segments into the tiles they may cut, segments above the stock cut nothing
+        for (size_t s = begin; s < end; s++) {
+            const StockSegment &segment = segments[s];
+            if (std::min(segment.from[2], segment.to[2]) >= STOCK_TOP) continue;
+            int columns[2], rows[2];
+            bounds(segment, columns, rows);
+            if (columns[0] >= columns[1] || rows[0] >= rows[1]) continue;
+            for (int ty = rows[0] / STOCK_TILE; ty <= (rows[1] - 1) / STOCK_TILE; ty++) {
+                for (int tx = columns[0] / STOCK_TILE; tx <= (columns[1] - 1) / STOCK_TILE; tx++) {
+                    std::vector<TileCut> &bin = bins[(size_t)ty * tiles_x + tx];
+                    if (bin.empty()) active.push_back(ty * tiles_x + tx);
+                    bin.push_back(TileCut{(uint32_t)s});
+                }
+            }
+        }
+
+        // Each tile only writes its own cells and cuts
+        ParallelFor(active.size(), [&](size_t k) {
+            uint32_t tile = active[k];
+            int tile_columns[2] = {(int)(tile % tiles_x) * STOCK_TILE, 0};
+            int tile_rows[2] = {(int)(tile / tiles_x) * STOCK_TILE, 0};
+            tile_columns[1] = std::min(stock.columns, tile_columns[0] + STOCK_TILE);
+            tile_rows[1] = std::min(stock.rows, tile_rows[0] + STOCK_TILE);
+            for (TileCut &cut : bins[tile]) {
+                const StockSegment &segment = segments[cut.segment];
+                const Tool &tool = tools[moves[segment.move].tool];
+                int columns[2], rows[2];
+                bounds(segment, columns, rows);
+                columns[0] = std::max(columns[0], tile_columns[0]);
+                columns[1] = std::min(columns[1], tile_columns[1]);
+                rows[0] = std::max(rows[0], tile_rows[0]);
+                rows[1] = std::min(rows[1], tile_rows[1]);
+                CutCells(stock, segment, tool.result.diameter / 2, tool.job.ball_nose, columns, rows, cut);
+            }
+        });
+
+        for (uint32_t tile : active) {
+            for (const TileCut &cut : bins[tile]) {
+                StockMove &move = moves[segments[cut.segment].move];
+                move.removed += cut.removed * cell_area;
+                move.area += cut.cells * cell_area;
+                move.depth = std::max(move.depth, cut.depth);
+            }
+            bins[tile].clear();
+        }
+        active.clear();
+    }
+}
+
+/**
+ * Function: cuts the path of a line (see ParseGcodePath) in segments, an arc in the XY plane is cut in chords.
+ *
+ * Parameters:
+ * @param path: The path, a straight or an arc in the XY plane with a helix along Z.
+ * @param tolerance: How far a chord may be from its arc in mm.
+ * @param move: The index of the move the segments belong to.
+ * @param segments: The segments, added to.
+ */
+static void PathToSegments(const GcodePath &path, double tolerance, uint32_t move, std::vector<StockSegment> &segments) {
+    const double *start = path.start, *target = path.target;
+    if (!path.arc) {
+        segments.push_back({{(float)start[0], (float)start[1], (float)start[2]}, {(float)target[0], (float)target[1], (float)target[2]}, move});
+        return;
+    }
+    double step = tolerance < path.radius ? 2 * acos(1 - tolerance / path.radius) : M_PI / 2;
+    int chords = std::min(MAX_ARC_CHORDS, std::max(1, (int)ceil(fabs(path.sweep) / step)));
+    double from[3] = {start[0], start[1], start[2]};
+    for (int k = 1; k <= chords; k++) {
+        double angle = path.start_angle + path.sweep * k / chords;
+        double to[3] = {path.center[0] + path.radius * cos(angle), path.center[1] + path.radius * sin(angle),
+                        start[2] + (target[2] - start[2]) * k / chords};
+        if (k == chords) std::copy(target, target + 3, to);
+        segments.push_back({{(float)from[0], (float)from[1], (float)from[2]}, {(float)to[0], (float)to[1], (float)to[2]}, move});
+        std::copy(to, to + 3, from);
+    }
+}
+
+/**
+ * Function: simulates the stock removed by a G-code program, rewrites its F and S words with the feed of each move
+ * and prints a histogram of the radial engagement.
+ *
+ * Parameters:
+ * @param file_input: The G-code program.
+ * @param file_output: The rewritten program.
+ * @param tools: The tool map (see LoadToolMap), the feeds of each tool are solved when it's first loaded.
+ * @param material_index: The fuzzy index over the materials.
+ * @param machine: The machine profile to solve for.
+ * @param resolution: The size of a cell of the heightmap in mm.
+ *
+ * Returns:
+ * @return 0 if the program was rewritten, 3 if it can't be read or 15 if it can't be written.
+ */
+int SimulateGcode(const std::string &file_input, const std::string &file_output, std::vector<Tool> &tools, const FuzzyIndex &material_index, const Machine &machine, float resolution) {
+    size_t size = 0;
+    const char *data = MapFile(file_input, size);
+    if (data == nullptr) {
+        std::cerr << "Error opening file " << file_input << std::endl;
+        return 3;
+    }
+    auto start = std::chrono::steady_clock::now();
+    const char *end = data + size;
+    GcodeWord words[MAX_GCODE_WORDS];
+
+    // First pass: the cutting moves of the tools of the tool map, cut in segments
+    std::vector<StockSegment> segments;
+    std::vector<StockMove> moves;
+    GcodeState state;
+    int active = -1;                // index in the tool map of the loaded tool, -1 if it isn't in it or failed
+    size_t lines = 0;
+    float low[2] = {std::numeric_limits<float>::max(), std::numeric_limits<float>::max()};
+    float high[2] = {std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest()};
+    for (const char *line = data; line < end; lines++) {
+        const char *newline = static_cast<const char *>(memchr(line, '\n', end - line));
+        int count = ParseGcodeLine(line, newline ? newline : end, words);
+        line = newline ? newline + 1 : end;
+
+        GcodeLine parsed = ReadGcodeState(state, words, count);
+        long next_tool = state.next_tool;
+        if (parsed.tool_change) {
+            auto found = std::find_if(tools.begin(), tools.end(), [&](const Tool &tool) { return tool.number == next_tool; });
+            active = found == tools.end() ? -1 : found - tools.begin();
+            if (active < 0) {
+                fprintf(stderr, "%s:%zu: tool %ld isn't in the tool map, its moves aren't simulated\n", file_input.c_str(), lines + 1, next_tool);
+            } else if (!found->solved) {
+                found->error = SolveJob(found->job, material_index, machine, found->result);
+                found->solved = true;
+                if (found->error != 0) {
+                    fprintf(stderr, "%s:%zu: tool %ld can't be solved (error %d), its moves aren't simulated\n", file_input.c_str(), lines + 1, next_tool, found->error);
+                } else if (found->result.specific_energy <= 0) {
+                    fprintf(stderr, "%s:%zu: tool %ld, no cutting energy for %s, the spindle power isn't checked\n", file_input.c_str(), lines + 1, next_tool, found->result.material.c_str());
+                }
+            }
+            if (active >= 0 && tools[active].error != 0) active = -1;
+        }
+
+        GcodePath path;
+        bool cutting = state.motion != 0 && active >= 0;
+        if (!ParseGcodePath(state, words, count, path) || !cutting) {
+            continue; // rapids and moves of unknown tools only move the tool
+        }
+        size_t first = segments.size();
+        PathToSegments(path, resolution / 2, moves.size(), segments);
+        StockMove move;
+        move.line = lines;
+        move.tool = active;
+        move.moves_xy = parsed.moves_xy;
+        move.length = path.length;
+        move.length_xy = path.length_xy;
+        moves.push_back(move);
+        float radius = tools[active].result.diameter / 2;
+        for (size_t s = first; s < segments.size(); s++) {
+            const StockSegment &segment = segments[s];
+            if (std::min(segment.from[2], segment.to[2]) >= STOCK_TOP) continue;
+            for (int axis = 0; axis < 2; axis++) {
+                low[axis] = std::min(low[axis], std::min(segment.from[axis], segment.to[axis]) - radius);
+                high[axis] = std::max(high[axis], std::max(segment.from[axis], segment.to[axis]) + radius);
+            }
+        }
+    }
+
+    // The stock, coarser if the area cut needs more cells than the limit
+    Heightmap stock = {0, 0, resolution, 0, 0, {}};
+    if (low[0] <= high[0]) {
+        double area = (double)(high[0] - low[0]) * (high[1] - low[1]);
+        if (area / (resolution * resolution) > STOCK_MAX_CELLS) {
+            stock.cell = std::sqrt(area / STOCK_MAX_CELLS) * 1.01;
+            fprintf(stderr, "%s: %.0f x %.0f mm at %g mm is over %d cells, simulated at %.3f mm\n", file_input.c_str(),
+                    high[0] - low[0], high[1] - low[1], resolution, STOCK_MAX_CELLS, stock.cell);
+        }
+        stock.x0 = low[0];
+        stock.y0 = low[1];
+        stock.columns = (int)std::ceil((high[0] - low[0]) / stock.cell) + 1;
+        stock.rows = (int)std::ceil((high[1] - low[1]) / stock.cell) + 1;
+        stock.heights.assign((size_t)stock.columns * stock.rows, STOCK_TOP);
+    }
+    SimulateStock(stock, segments, moves, tools);
+    size_t segment_count = segments.size();
+    std::vector<StockSegment>().swap(segments);
+
+    // Feed of each move from its engagement, the thinning factors of a tool are computed in one call
+    double length_of_bin[ENGAGEMENT_BINS + 1] = {0};   // the last bin holds the air cuts
+    size_t moves_of_bin[ENGAGEMENT_BINS + 1] = {0};
+    std::vector<float> stepover, depth, thinning, effective_diameter;
+    std::vector<size_t> indices;
+    for (size_t t = 0; t < tools.size(); t++) {
+        const JobResult &base = tools[t].result;
+        indices.clear();
+        stepover.clear();
+        depth.clear();
+        for (size_t i = 0; i < moves.size(); i++) {
+            if (moves[i].tool != (int)t) continue;
+            if (moves[i].removed <= 0 || moves[i].length_xy <= 0) {
+                moves[i].feed = base.feeds.y * MAX_CHIP_THINNING / base.thinning; // air, or a plunge that cut nothing
+                continue;
+            }
+            indices.push_back(i);
+            stepover.push_back(std::min<float>(moves[i].area / moves[i].length_xy, base.diameter));
+            depth.push_back(moves[i].depth);
+        }
+        thinning.resize(indices.size());
+        effective_diameter.resize(indices.size());
+        EngagementFactors(base.diameter, tools[t].job.ball_nose, stepover.data(), depth.data(), indices.size(), thinning.data(), effective_diameter.data());
+        float spindle_power = SpindlePower(machine, base.feeds.x);
+        for (size_t k = 0; k < indices.size(); k++) {
+            StockMove &move = moves[indices[k]];
+            float power_per_feed = base.specific_energy * move.removed / move.length / 60;
+            move.feed = base.feeds.y * thinning[k] / base.thinning;
+            if (power_per_feed > 0) move.feed = std::min(move.feed, spindle_power / power_per_feed);
+            if (move.moves_xy) {
+                int bin = std::min(ENGAGEMENT_BINS - 1, (int)(stepover[k] / base.diameter * ENGAGEMENT_BINS));
+                length_of_bin[bin] += move.length;
+                moves_of_bin[bin]++;
+            }
+        }
+    }
+    for (StockMove &move : moves) {
+        move.feed = std::min(move.feed, (float)machine.max_feed);
+        if (move.moves_xy && move.removed <= 0) {
+            length_of_bin[ENGAGEMENT_BINS] += move.length;
+            moves_of_bin[ENGAGEMENT_BINS]++;
+        }
+    }
+    double simulated = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // Second pass: copy the program, with the feed of each cutting move along X or Y and the rpm of its tool
+    GcodeOutput output = {fopen(file_output.c_str(), "wb"), std::string()};
+    if (output.file == nullptr) {
+        std::cerr << "Error opening file " << file_output << std::endl;
+        UnmapFile(data, size);
+        return 15;
+    }
+    output.buffer.reserve(GCODE_BUFFER + MAX_LINE_LENGTH);
+    size_t next = 0, rewritten = 0;
+    ModalFeed modal;
+    state = GcodeState();
+    active = -1;
+    size_t line_number = 0;
+    for (const char *line = data; line < end; line_number++) {
+        const char *newline = static_cast<const char *>(memchr(line, '\n', end - line));
+        const char *line_end = newline ? newline : end;
+        int count = ParseGcodeLine(line, line_end, words);
+
+        GcodeLine parsed = ReadGcodeState(state, words, count);
+        if (parsed.tool_change) {
+            auto found = std::find_if(tools.begin(), tools.end(), [&](const Tool &tool) { return tool.number == state.next_tool; });
+            active = found == tools.end() || found->error != 0 ? -1 : found - tools.begin();
+        }
+
+        // The moves of the first pass are the cutting moves of solved tools, the feed policy is RunsAtToolFeed
+        const StockMove *move = next < moves.size() && moves[next].line == line_number ? &moves[next++] : nullptr;
+        char f_word[32] = "";
+        char s_word[32] = "";
+        if (move != nullptr && move->moves_xy) {
+            float feed_rate = Convert(FeedRate{move->feed, UNIT_MM_M}, state.inches ? UNIT_IN_M : UNIT_MM_M).value;
+            snprintf(f_word, sizeof(f_word), state.inches ? "F%.2f" : "F%.1f", feed_rate);
+        }
+        if (active >= 0) snprintf(s_word, sizeof(s_word), "S%d", tools[active].result.feeds.x);
+        const char *replacement = ReplaceFeed(modal, f_word[0] != '\0' ? f_word : nullptr, parsed.moves, parsed.feed);
+        const char *next_line = newline ? newline + 1 : end;
+        rewritten += CopyGcodeLine(output, line, next_line, words, count, replacement, s_word[0] != '\0' ? s_word : nullptr);
+        line = next_line;
+    }
+    output.Flush();
+    UnmapFile(data, size);
+    bool written = !output.failed && fclose(output.file) == 0;
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // Histogram of the radial engagement of the moves along X or Y
+    double total_length = 0;
+    for (int bin = 0; bin <= ENGAGEMENT_BINS; bin++) total_length += length_of_bin[bin];
+    printf("%-16s %10s %12s %7s\n", "Engagement", "Moves", "Length(mm)", "Share");
+    for (int bin = 0; bin <= ENGAGEMENT_BINS; bin++) {
+        char label[32];
+        if (bin == ENGAGEMENT_BINS) {
+            snprintf(label, sizeof(label), "air");
+        } else {
+            snprintf(label, sizeof(label), "%3d-%3d%% of D", bin * 100 / ENGAGEMENT_BINS, (bin + 1) * 100 / ENGAGEMENT_BINS);
+        }
+        double share = total_length > 0 ? length_of_bin[bin] / total_length : 0;
+        printf("%-16s %10zu %12.1f %6.1f%% %s\n", label, moves_of_bin[bin], length_of_bin[bin], 100 * share,
+               std::string((size_t)(share * 50 + 0.5), '#').c_str());
+    }
+    printf("Simulated %zu moves (%zu segments) on %d x %d cells of %.3f mm in %.3f s, rewrote %zu of %zu lines in %.3f s\n",
+           moves.size(), segment_count, stock.columns, stock.rows, stock.cell, simulated, rewritten, lines, seconds);
+    return written ? 0 : 15;
+}
+
+/**
+ * Function: loads the chipload table and a tool map, then simulates a G-code program and rewrites its feeds.
+ *
+ * Parameters:
+ * @param file_chipload: The chipload table .csv file.
+ * @param file_tools: The tool map .csv file.
+ * @param file_input: The G-code program.
+ * @param file_output: The rewritten program.
+ * @param resolution: The size of a cell of the heightmap in mm.
+ *
+ * Returns:
+ * @return 0 if the program was rewritten, otherwise the error code (1, 2, 3, 15 or 16 for a bad resolution).
+ */
+int RunSimulate(const std::string &file_chipload, const std::string &file_tools, const std::string &file_input, const std::string &file_output, float resolution) {
+    if (!(resolution > 0)) {
+        printf("The resolution is the size of a cell of the heightmap in mm, ex.: %g\n", STOCK_RESOLUTION);
+        return 16;
+    }
+    FuzzyIndex material_index;
+    std::vector<Tool> tools;
+    int error = LoadTableAndTools(file_chipload, file_tools, material_index, tools);
+    if (error != 0) {
+        return error;
+    }
+    error = SimulateGcode(file_input, file_output, tools, material_index, machine, resolution);
+    Unload();
+    return error;
+}
@@ -0,0 +1,320 @@
+/**
+ * This file contains the following function definitions for the binary snapshot of the chipload table:
+ * - WriteSnapshot
+ * - LoadSnapshot
+ * - UnmapSnapshot
+ * - HashBytes
+ * - HashTable
+ *
+ * After a successful Load the table is written next to the .csv file (ChiploadTable.csv.snapshot) with the
+ * exact layout of the arrays of a ChiploadTable. Later runs memory map the snapshot and point the table into
+ * the mapping, with no parsing and no allocation per row. The snapshot is versioned and checksummed and it's
+ * only used while the .csv file keeps the size, modification time and contents hash it was written from,
+ * and the binary keeps the same embedded table.
+ */
+
+// Include headers & libraries
+#include <cstdint>      // for fixed width integers
+#include <cstdio>       // for standard input/output operations
+#include <cstring>      // for memcmp and memcpy
+#include <string>       // for std::string
+#include <fcntl.h>      // for open
+#include <sys/mman.h>   // for mmap
+#include <sys/stat.h>   // for stat
+#include <unistd.h>     // for close, write and rename
+#include "chipload.h"   // for external user defined functions
+
+// Constant Expressions
+#define SNAPSHOT_MAGIC "CNCSNAP"    // 8 bytes with the '\0'
+#define SNAPSHOT_VERSION 2   // 2: material names longer than MAX_WORD_LENGTH are rejected
+
+// Represents the header of a snapshot file, the arrays follow it in the order of ChiploadTable
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t embedded;          // 1 if the table is the embedded one (no arrays follow)
+    uint32_t material_count;
+    uint32_t row_count;
+    uint32_t slot_count;
+    uint32_t names_size;        // size of the names, padded to 4 bytes
+    uint64_t csv_size;
+    int64_t csv_mtime_sec;
+    int64_t csv_mtime_nsec;
+    uint64_t csv_hash;          // hash of the .csv contents
+    uint64_t embedded_hash;     // hash of the table embedded in the binary that wrote the snapshot
+    uint64_t payload_hash;      // hash of the arrays
+};
+
+// The current mapping, the table points into it
+static void *mapped = nullptr;
+static size_t mapped_size = 0;
+
+/**
+ * Hash a block of memory (64 bit, 8 bytes at a time, FNV-1a style mixing).
+ */
+uint64_t HashBytes(const void *data, size_t size, uint64_t hash_value)
+{
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, bytes + i, 8);
+        hash_value = (hash_value ^ word) * 1099511628211ull;
+        hash_value ^= hash_value >> 29;
+    }
+    for (; i < size; i++)
+    {
+        hash_value = (hash_value ^ bytes[i]) * 1099511628211ull;
+    }
+    return hash_value;
+}
+
+/**
+ * Size of the names of a table, with the '\0' of the last one.
+ */
+static size_t NamesSize(const ChiploadTable &view)
+{
+    if (view.material_count == 0)
+    {
+        return 0;
+    }
+    const char *last = view.names + view.name_offsets[view.material_count - 1];
+    return last + strlen(last) + 1 - view.names;
+}
+
+/**
+ * Hash the arrays of a table, in snapshot order. It identifies the contents of a table, ex.: in the result cache.
+ */
+uint64_t HashTable(const ChiploadTable &view)
+{
+    uint64_t hash_value = HashBytes(view.names, NamesSize(view));
+    hash_value = HashBytes(view.name_offsets, view.material_count * sizeof(unsigned int), hash_value);
+    hash_value = HashBytes(view.offsets, (view.material_count + 1) * sizeof(unsigned int), hash_value);
+    hash_value = HashBytes(view.diameters, view.row_count * sizeof(float), hash_value);
+    hash_value = HashBytes(view.chiploads, view.row_count * sizeof(float), hash_value);
+    hash_value = HashBytes(view.factors, view.row_count * sizeof(float), hash_value);
+    return HashBytes(view.slots, view.slot_count * sizeof(int), hash_value);
+}
+
+/**
+ * Stat and hash the contents of the .csv file.
+ * 
+ * @return true if the file could be read, false otherwise.
+ */
+static bool FingerprintCSV(const std::string &filename, struct stat &file_stat, uint64_t &hash_value)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    if (fstat(fd, &file_stat) != 0)
+    {
+        close(fd);
+        return false;
+    }
+    hash_value = HashBytes(nullptr, 0);
+    if (file_stat.st_size > 0)
+    {
+        void *data = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED)
+        {
+            close(fd);
+            return false;
+        }
+        madvise(data, file_stat.st_size, MADV_SEQUENTIAL);
+        hash_value = HashBytes(data, file_stat.st_size);
+        munmap(data, file_stat.st_size);
+    }
+    close(fd);
+    return true;
+}
+
+/**
+ * Write the whole buffer to a file descriptor.
+ */
+static bool WriteAll(int fd, const void *data, size_t size)
+{
+    const char *bytes = static_cast<const char *>(data);
+    while (size > 0)
+    {
+        ssize_t written = write(fd, bytes, size);
+        if (written <= 0)
+        {
+            return false;
+        }
+        bytes += written;
+        size -= written;
+    }
+    return true;
+}
+
+/**
+ * Write the snapshot of a chipload table loaded from a .csv file, next to it.
+ * The snapshot is written to a temporary file and renamed, so readers never see a partial one.
+ * 
+ * @param filename The name of the .csv file the table was loaded from.
+ * @param view The chipload table.
+ * @return true if the snapshot was written, false otherwise.
+ */
+bool WriteSnapshot(const std::string &filename, const ChiploadTable &view)
+{
+    SnapshotHeader header = {};
+    struct stat file_stat;
+    if (!FingerprintCSV(filename, file_stat, header.csv_hash))
+    {
+        return false;
+    }
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.embedded = view.names == default_table.names;
+    header.csv_size = file_stat.st_size;
+    header.csv_mtime_sec = file_stat.st_mtim.tv_sec;
+    header.csv_mtime_nsec = file_stat.st_mtim.tv_nsec;
+    header.embedded_hash = HashTable(default_table);
+
+    // The arrays, one after the other, the names padded to 4 bytes to keep the other arrays aligned
+    std::string payload;
+    if (!header.embedded)
+    {
+        size_t names_size = NamesSize(view);
+        header.material_count = view.material_count;
+        header.row_count = view.row_count;
+        header.slot_count = view.slot_count;
+        header.names_size = (names_size + 3) / 4 * 4;
+        payload.append(view.names, names_size);
+        payload.append(header.names_size - names_size, '\0');
+        payload.append(reinterpret_cast<const char *>(view.name_offsets), view.material_count * sizeof(unsigned int));
+        payload.append(reinterpret_cast<const char *>(view.offsets), (view.material_count + 1) * sizeof(unsigned int));
+        payload.append(reinterpret_cast<const char *>(view.diameters), view.row_count * sizeof(float));
+        payload.append(reinterpret_cast<const char *>(view.chiploads), view.row_count * sizeof(float));
+        payload.append(reinterpret_cast<const char *>(view.factors), view.row_count * sizeof(float));
+        payload.append(reinterpret_cast<const char *>(view.slots), view.slot_count * sizeof(int));
+        header.payload_hash = HashBytes(payload.data(), payload.size());
+    }
+
+    std::string snapshot = filename + ".snapshot";
+    std::string temporary = snapshot + ".tmp";
+    int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        return false;
+    }
+    bool written = WriteAll(fd, &header, sizeof(header)) && WriteAll(fd, payload.data(), payload.size());
+    written = close(fd) == 0 && written;
+    if (!written || rename(temporary.c_str(), snapshot.c_str()) != 0)
+    {
+        unlink(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Load the chipload table from the snapshot of a .csv file, if it's still valid.
+ * The table points into the memory mapped snapshot until UnmapSnapshot is called.
+ * 
+ * @param filename The name of the .csv file.
+ * @param view The chipload table, only set if the snapshot is valid.
+ * @return true if the snapshot was valid and loaded, false otherwise (the .csv must be parsed).
+ */
+bool LoadSnapshot(const std::string &filename, ChiploadTable &view)
+{
+    std::string snapshot = filename + ".snapshot";
+    int fd = open(snapshot.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat snapshot_stat;
+    if (fstat(fd, &snapshot_stat) != 0 || (size_t)snapshot_stat.st_size < sizeof(SnapshotHeader))
+    {
+        close(fd);
+        return false;
+    }
+    size_t size = snapshot_stat.st_size;
+    void *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        return false;
+    }
+
+    // Check the header against the .csv file and the embedded table
+    SnapshotHeader header;
+    memcpy(&header, data, sizeof(header));
+    struct stat file_stat;
+    uint64_t csv_hash;
+    bool valid = memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) == 0 &&
+                 header.version == SNAPSHOT_VERSION &&
+                 FingerprintCSV(filename, file_stat, csv_hash) &&
+                 header.csv_size == (uint64_t)file_stat.st_size &&
+                 header.csv_mtime_sec == file_stat.st_mtim.tv_sec &&
+                 header.csv_mtime_nsec == file_stat.st_mtim.tv_nsec &&
+                 header.csv_hash == csv_hash &&
+                 header.embedded_hash == HashTable(default_table);
+
+    // Check the arrays fit the file and match their checksum
+    ChiploadTable loaded_view = {};
+    if (valid && header.embedded)
+    {
+        munmap(data, size);
+        view = default_table;
+        return true;
+    }
+    if (valid)
+    {
+        uint64_t payload_size = (uint64_t)header.names_size +
+                                (2 * (uint64_t)header.material_count + 1) * sizeof(unsigned int) +
+                                3 * (uint64_t)header.row_count * sizeof(float) +
+                                (uint64_t)header.slot_count * sizeof(int);
+        valid = header.material_count > 0 && (header.slot_count & (header.slot_count - 1)) == 0 &&
+                payload_size == size - sizeof(header) &&
+                HashBytes(static_cast<const char *>(data) + sizeof(header), payload_size) == header.payload_hash;
+    }
+    if (valid)
+    {
+        const char *p = static_cast<const char *>(data) + sizeof(header);
+        loaded_view.material_count = header.material_count;
+        loaded_view.row_count = header.row_count;
+        loaded_view.slot_count = header.slot_count;
+        loaded_view.names = p;
+        p += header.names_size;
+        loaded_view.name_offsets = reinterpret_cast<const unsigned int *>(p);
+        p += header.material_count * sizeof(unsigned int);
+        loaded_view.offsets = reinterpret_cast<const unsigned int *>(p);
+        p += (header.material_count + 1) * sizeof(unsigned int);
+        loaded_view.diameters = reinterpret_cast<const float *>(p);
+        p += header.row_count * sizeof(float);
+        loaded_view.chiploads = reinterpret_cast<const float *>(p);
+        p += header.row_count * sizeof(float);
+        loaded_view.factors = reinterpret_cast<const float *>(p);
+        p += header.row_count * sizeof(float);
+        loaded_view.slots = reinterpret_cast<const int *>(p);
+    }
+    if (!valid)
+    {
+        munmap(data, size);
+        return false;
+    }
+
+    UnmapSnapshot();
+    mapped = data;
+    mapped_size = size;
+    view = loaded_view;
+    return true;
+}
+
+/**
+ * Unmap the snapshot the chipload table points into, if any.
+ */
+void UnmapSnapshot(void)
+{
+    if (mapped)
+    {
+        munmap(mapped, mapped_size);
+        mapped = nullptr;
+        mapped_size = 0;
+    }
+}
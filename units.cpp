@@ -0,0 +1,167 @@
+/**
+ * This file contains the following function definitions for converting units:
+ * - ParseLengthUnit
+ * - ParseFeedUnit
+ * - UnitName
+ * - Convert
+ * - ConvertFeedRates
+ * - ConvertResultFeedRates
+ *
+ * A unit is parsed once into an enum, conversions are then a lookup in a factor matrix computed at compile time.
+ * Lengths and feedrates are separate types (Length and FeedRate), converting a length to a feedrate unit doesn't compile.
+ */
+
+// Include headers & libraries
+#include <array>        // for std::array
+#include <cstddef>      // for size_t
+#include <string>       // for std::string
+#include <vector>       // for std::vector
+#include "chipload.h"   // for external user defined functions
+
+// Spellings accepted for each unit, BestMatch picks one of them from the user input
+const std::vector<std::string> length_unit_names = {"mm", "in", "inch", "inches"};
+const std::vector<std::string> feed_unit_names = {"mm/s", "mm/m", "m/m", "inch/s", "inch/m", "in/s", "in/m", "feet/m"};
+static const LengthUnit length_unit_of[] = {UNIT_MM, UNIT_IN, UNIT_IN, UNIT_IN};
+static const FeedUnit feed_unit_of[] = {UNIT_MM_S, UNIT_MM_M, UNIT_M_M, UNIT_IN_S, UNIT_IN_M, UNIT_IN_S, UNIT_IN_M, UNIT_FT_M};
+
+// Size of each unit in mm and mm/m, in the order of the enums
+static constexpr double length_in_mm[N_LENGTH_UNITS] = {1.0, 25.4};
+static constexpr double feed_in_mm_per_min[N_FEED_UNITS] = {60.0, 1.0, 1000.0, 25.4 * 60.0, 25.4, 304.8};
+
+/**
+ * Function: builds the matrix of conversion factors, factors[from][to] converts a value from one unit to another.
+ */
+template <size_t N>
+static constexpr std::array<std::array<float, N>, N> FactorMatrix(const double (&size)[N]) {
+    std::array<std::array<float, N>, N> factors = {};
+    for (size_t from = 0; from < N; from++) {
+        for (size_t to = 0; to < N; to++) {
+            factors[from][to] = size[from] / size[to];
+        }
+    }
+    return factors;
+}
+
+static constexpr auto length_factors = FactorMatrix(length_in_mm);
+static constexpr auto feed_factors = FactorMatrix(feed_in_mm_per_min);
+static_assert(feed_factors[UNIT_MM_S][UNIT_MM_M] == 60.0f, "1 mm/s is 60 mm/m");
+static_assert(length_factors[UNIT_IN][UNIT_MM] == 25.4f, "1 inch is 25.4 mm");
+
+/**
+ * Function: parses a length unit.
+ *
+ * Parameters:
+ * @param name: The unit, one of length_unit_names.
+ * @param unit: The unit parsed.
+ *
+ * Returns:
+ * @return true if the unit is known, false otherwise.
+ */
+bool ParseLengthUnit(const std::string &name, LengthUnit &unit) {
+    for (size_t i = 0; i < length_unit_names.size(); i++) {
+        if (length_unit_names[i] == name) {
+            unit = length_unit_of[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Function: parses a feedrate unit.
+ *
+ * Parameters:
+ * @param name: The unit, one of feed_unit_names.
+ * @param unit: The unit parsed.
+ *
+ * Returns:
+ * @return true if the unit is known, false otherwise.
+ */
+bool ParseFeedUnit(const std::string &name, FeedUnit &unit) {
+    for (size_t i = 0; i < feed_unit_names.size(); i++) {
+        if (feed_unit_names[i] == name) {
+            unit = feed_unit_of[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+// Names of the units, in the order of the enums
+const char *UnitName(LengthUnit unit) {
+    static const char *names[N_LENGTH_UNITS] = {"mm", "in"};
+    return names[unit];
+}
+
+const char *UnitName(FeedUnit unit) {
+    static const char *names[N_FEED_UNITS] = {"mm/s", "mm/m", "m/m", "in/s", "in/m", "feet/m"};
+    return names[unit];
+}
+
+/**
+ * Function: converts a length to another unit.
+ *
+ * Parameters:
+ * @param length: The length.
+ * @param to: The unit to convert it to.
+ *
+ * Returns:
+ * @return The same length in the unit to.
+ */
+Length Convert(Length length, LengthUnit to) {
+    return {length.value * length_factors[length.unit][to], to};
+}
+
+/**
+ * Function: converts a feedrate to another unit.
+ *
+ * Parameters:
+ * @param feed_rate: The feedrate.
+ * @param to: The unit to convert it to.
+ *
+ * Returns:
+ * @return The same feedrate in the unit to.
+ */
+FeedRate Convert(FeedRate feed_rate, FeedUnit to) {
+    return {feed_rate.value * feed_factors[feed_rate.unit][to], to};
+}
+
+/**
+ * Function: converts a column of feedrates from one unit to another, ex.: every result of a batch.
+ * It's a single multiplication per value, which the compiler vectorizes.
+ *
+ * Parameters:
+ * @param values: The feedrates in the unit from.
+ * @param converted: The feedrates in the unit to, may be the same array as values.
+ * @param count: The number of feedrates.
+ * @param from: The unit of values.
+ * @param to: The unit to convert them to.
+ */
+void ConvertFeedRates(const float *values, float *converted, size_t count, FeedUnit from, FeedUnit to) {
+    const float factor = feed_factors[from][to];
+    for (size_t i = 0; i < count; i++) {
+        converted[i] = values[i] * factor;
+    }
+}
+
+/**
+ * Function: converts the feedrates of solved jobs as columns, one ConvertFeedRates call per output unit, for the
+ * modes that report many results (batch reports and machine comparisons).
+ *
+ * Parameters:
+ * @param results: The results, the feed_rate of each solved one is set from its feedrate in mm/m and its output unit.
+ */
+void ConvertResultFeedRates(std::vector<JobResult> &results) {
+    std::vector<size_t> indices[N_FEED_UNITS];
+    for (size_t i = 0; i < results.size(); i++) {
+        FeedUnit unit;
+        if (results[i].error == 0 && ParseFeedUnit(results[i].out_unit, unit)) indices[unit].push_back(i);
+    }
+    std::vector<float> column;
+    for (int unit = 0; unit < N_FEED_UNITS; unit++) {
+        column.resize(indices[unit].size());
+        for (size_t k = 0; k < column.size(); k++) column[k] = results[indices[unit][k]].feeds.y;
+        ConvertFeedRates(column.data(), column.data(), column.size(), UNIT_MM_M, (FeedUnit)unit);
+        for (size_t k = 0; k < column.size(); k++) results[indices[unit][k]].feed_rate = column[k];
+    }
+}
@@ -1,157 +1,318 @@
 /**
  * This file contains the following function definitions for writing results and messages to user output:
+ * - OpenReport
+ * - FlushReport
+ * - CloseReport
  * - ErrorMessage
  * - WarningMessage
  * - WriteResultsToFile
+ * - WriteSuggestions
+ *
+ * Everything goes through a Report: the output file is opened once, the text is collected in memory and
+ * written in large blocks. Besides the human readable text a report can be CSV or JSON lines (one object
+ * per line), chosen from the file extension, with one row per error, warning or result of a job.
  */
 
 // Include headers & libraries
 #include <iostream>     // for standard C++ library for input and output
+#include <cstdarg>      // for variable arguments
 #include <cstdio>       // for standard input/output operations
 #include <string>       // for std::string
 #include "chipload.h"   // for external user defined functions
 
+#define REPORT_BUFFER (1 << 20) // bytes collected before a report is written to its file
 
-// Initialize error counter (extern if main wants to print number of errors and or warnings)
-unsigned int number_errors = 0;
-unsigned int number_warnings = 0;
+// Columns of a CSV report, the rows of errors and warnings leave the result columns empty
+static const char csv_header[] = "job,type,code,material,distance,tool_diameter,tool_unit,flutes,quality,rpm,feed_mm_per_min,feedrate,out_unit,limits\n";
 
 
 /**
- * ErrorMessage: writes an error message to a file based on the error code provided.
+ * OpenReport: opens the output file (in append mode) for a report, the format follows the extension:
+ * .csv for CSV, .jsonl or .json for JSON lines and text otherwise.
+ *
+ * Parameters:
+ * @param report: The report to open.
+ * @param filename: The name of the output file.
+ *
+ * Returns:
+ * @return true if the file was opened, false otherwise.
+ */
+bool OpenReport(Report &report, const std::string &filename) {
+    CloseReport(report);
+    auto ends_with = [&](const char *extension) {
+        std::string end = extension;
+        return filename.size() >= end.size() && filename.compare(filename.size() - end.size(), end.size(), end) == 0;
+    };
+    report.format = ends_with(".csv") ? REPORT_CSV : ends_with(".jsonl") || ends_with(".json") ? REPORT_JSON : REPORT_TEXT;
+    report.filename = filename;
+    report.file = fopen(filename.c_str(), "a");  // open file in append mode
+    if (report.file == nullptr) {                // handles case where file can't be accessed
+        std::cerr << "Error opening file " << filename << std::endl;
+        return false;
+    }
+    report.buffer.reserve(REPORT_BUFFER);
+
+    // A new CSV file starts with its header
+    fseek(report.file, 0, SEEK_END);
+    if (report.format == REPORT_CSV && ftell(report.file) == 0) {
+        report.buffer += csv_header;
+    }
+    return true;
+}
+
+
+/**
+ * FlushReport: writes what the report collected so far to its file.
+ *
+ * Returns:
+ * @return true if it was written (or there was nothing to write), false otherwise.
+ */
+bool FlushReport(Report &report) {
+    if (report.file == nullptr || report.buffer.empty()) {
+        report.buffer.clear();
+        return report.file != nullptr;
+    }
+    bool written = fwrite(report.buffer.data(), 1, report.buffer.size(), report.file) == report.buffer.size();
+    report.written += report.buffer.size();
+    report.buffer.clear();
+    if (!written) {
+        std::cerr << "Error writing file " << report.filename << std::endl;
+    }
+    return written;
+}
+
+
+/**
+ * CloseReport: flushes the report and closes its file, a closed report can be opened again.
+ *
+ * Returns:
+ * @return true if everything was written, false otherwise.
+ */
+bool CloseReport(Report &report) {
+    if (report.file == nullptr) {
+        return true;
+    }
+    bool written = FlushReport(report);
+    written = fclose(report.file) == 0 && written;
+    report.file = nullptr;
+    return written;
+}
+
+Report::~Report() {
+    CloseReport(*this);
+}
+
+
+/**
+ * Appends formatted text to a report, written to the file once the buffer is full.
+ */
+static bool Append(Report &report, const char *format, ...) {
+    char line[MAX_LINE_LENGTH * 2];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    if (length < 0) {
+        return false;
+    }
+    if ((size_t)length < sizeof(line)) {
+        report.buffer.append(line, length);
+    } else {
+        size_t start = report.buffer.size();   // longer than the stack buffer, format straight into the report
+        report.buffer.resize(start + length + 1);
+        va_start(args, format);
+        vsnprintf(&report.buffer[start], length + 1, format, args);
+        va_end(args);
+        report.buffer.resize(start + length);
+    }
+    return report.buffer.size() < REPORT_BUFFER || FlushReport(report);
+}
+
+
+/**
+ * Appends a string as a CSV field (quoted if needed) or a JSON string.
+ */
+static void AppendField(Report &report, const std::string &value) {
+    if (report.format == REPORT_JSON) {
+        report.buffer += '"';
+        for (char c : value) {
+            if (c == '"' || c == '\\') {
+                report.buffer += '\\';
+                report.buffer += c;
+            } else if ((unsigned char)c < 0x20) {
+                char escaped[8];
+                snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                report.buffer += escaped;
+            } else {
+                report.buffer += c;
+            }
+        }
+        report.buffer += '"';
+    } else if (value.find_first_of(",\"\n") != std::string::npos) {
+        report.buffer += '"';
+        for (char c : value) {
+            if (c == '"') report.buffer += '"';
+            report.buffer += c;
+        }
+        report.buffer += '"';
+    } else {
+        report.buffer += value;
+    }
+}
+
+
+/**
+ * Appends the row of an error or a warning to a CSV or JSON lines report.
+ */
+static void AppendDiagnostic(Report &report, const char *type, int code) {
+    if (report.format == REPORT_CSV) {
+        Append(report, "%u,%s,%d,,,,,,,,,,,\n", report.job, type, code);
+    } else {
+        Append(report, "{\"job\":%u,\"type\":\"%s\",\"code\":%d}\n", report.job, type, code);
+    }
+}
+
+
+/**
+ * ErrorMessage: writes an error message to a report based on the error code provided.
  * 
  * Parameters:
- * @param filename: The name of the file to write the error message to.
+ * @param report: The report to write the error message to.
  * @param error: The error code to determine the specific error message to write.
  * 
  * Returns:
  * @return This function does not return a value.
  */
-void ErrorMessage(const std::string &filename, int error) {
-    FILE *file = fopen(filename.c_str(), "a");  // open file in append mode
-    if (file == nullptr) {                      // handles case where file can't be accessed
-        std::cerr << "Error opening file " << filename << std::endl; 
+void ErrorMessage(Report &report, int error) {
+    ++report.errors;    // for counting errors (change this in the future, an error returns and the program stops)
+    if (report.format != REPORT_TEXT) {
+        AppendDiagnostic(report, "error", error);
         return;
     }
 
-    fprintf(file, "============= ERRORS =============\n\n"); // print error header
-
-    ++number_errors;    // for counting errors (change this in the future, an error returns and the program stops)
+    Append(report, "============= ERRORS =============\n\n"); // print error header
 
     switch (error)      // print error message based on error
     {
     case 1:
-        fprintf(file, "ERROR 1: Failed to Load ChiploadTable.csv :(\n\n");
+        Append(report, "ERROR 1: Failed to Load ChiploadTable.csv :(\n\n");
         break;
     
     case 2:
-        fprintf(file, "ERROR 2: Failed to allocate memory for materials data structure :(\n\n");
+        Append(report, "ERROR 2: Failed to allocate memory for materials data structure :(\n\n");
         break;
 
     case 3:
-        fprintf(file, "ERROR 3: Failed to read from file.\n\n");
+        Append(report, "ERROR 3: Failed to read from file.\n\n");
         break;
 
     case 4:
-        fprintf(file, "ERROR 4: Ups! You forgot to select a material (ex.: Wood or cOrK).\n\n");
+        Append(report, "ERROR 4: Ups! You forgot to select a material (ex.: Wood or cOrK).\n\n");
         break;
     
     case 5:
-        fprintf(file, "ERROR 5: Ups! you forgot the tool diameter unit (ex.: 3mm or 1/4 inch).\n\n");
+        Append(report, "ERROR 5: Ups! you forgot the tool diameter unit (ex.: 3mm or 1/4 inch).\n\n");
         break;
     
     case 8:
-        fprintf(file, "ERROR 8: UPS! You forgot to specify a tool diameter (ex.: 3mm or 1/4 inch).\n\n");
+        Append(report, "ERROR 8: UPS! You forgot to specify a tool diameter (ex.: 3mm or 1/4 inch).\n\n");
         break;
     
     case 11:
-        fprintf(file, "ERROR 11: Ups! It looks like the tool diameter unit isn't valid (ex.: either mm or iNc3hes are valid but 3hfu349t9 isn't).\n\n");
+        Append(report, "ERROR 11: Ups! It looks like the tool diameter unit isn't valid (ex.: either mm or iNc3hes are valid but 3hfu349t9 isn't).\n\n");
         break;
     
     case 12:
-        fprintf(file, "ERROR 12: Ups! It looks like the material isn't supported (ex.: either Wood or WoO0ds are valid/supported but 3hfu349t9 isn't and Unobtanium isn't supported).\n\n");
+        Append(report, "ERROR 12: Ups! It looks like the material isn't supported (ex.: either Wood or WoO0ds are valid/supported but 3hfu349t9 isn't and Unobtanium isn't supported).\n\n");
         break;
     
     case 13:
-        fprintf(file, "ERROR 13: Ups! For that material the ChiploadTable.csv lacks data to satisfy the tool you want to use.\n\n");
+        Append(report, "ERROR 13: Ups! For that material the ChiploadTable.csv lacks data to satisfy the tool you want to use.\n\n");
         break;
 
     default:
-        fprintf(file, "ERROR DEFAULT: UNDOCUMENTED RANDOM ERROR :(\n\n");
+        Append(report, "ERROR DEFAULT: UNDOCUMENTED RANDOM ERROR :(\n\n");
         break;
     }
 
-    fprintf(file, "==================================\n\n\n"); // enclose error message to user
-
-    // Close the file
-    fclose(file);
+    Append(report, "==================================\n\n\n"); // enclose error message to user
 }
 
 
 /**
- * WarningMessage: writes a warning message to a file based on the warning code provided.
+ * WarningMessage: writes a warning message to a report based on the warning code provided.
  * 
  * Parameters:
- * @param filename: The name of the file to write the warning message to.
+ * @param report: The report to write the warning message to.
  * @param warning: The warning code to determine the specific warning message to write.
  * 
  * Returns:
  * @return This function does not return a value.
  */
-void WarningMessage(const std::string &filename, int warning) {
-    FILE *file = fopen(filename.c_str(), "a");  // open file in append mode
-    if (file == nullptr) {                      // handles case where file can't be accessed
-        std::cerr << "Error opening file " << filename << std::endl; 
+void WarningMessage(Report &report, int warning) {
+    if (report.format != REPORT_TEXT) {
+        ++report.warnings;
+        AppendDiagnostic(report, "warning", warning);
         return;
     }
 
-    if (number_warnings == 0)                  // print warning header if it's the first warning
-        fprintf(file, "============= WARNINGS =============\n");
+    if (report.warnings == 0)                  // print warning header if it's the first warning
+        Append(report, "============= WARNINGS =============\n");
 
-    ++number_warnings;                        // for counting warnings
+    ++report.warnings;                        // for counting warnings
    
     switch (warning)                          // print warning message based on warning
     {
     case 6:
-        fprintf(file, "Warning 6: You didn't specify the units you want the results to be displayed, the feedrate was calculated in mm/m.\n\n");
+        Append(report, "Warning 6: You didn't specify the units you want the results to be displayed, the feedrate was calculated in mm/m.\n\n");
         break;
     
     case 7:
-        fprintf(file, "Warning 7: You didn't specify how many cutting edges your tool has, the calculation has resumed with 2 cutting edges\n as it is the most common type. Make sure the tool has 2 cutting edges before resuming with any machining!\n\n");
+        Append(report, "Warning 7: You didn't specify how many cutting edges your tool has, the calculation has resumed with 2 cutting edges\n as it is the most common type. Make sure the tool has 2 cutting edges before resuming with any machining!\n\n");
         break;
 
     case 9:
-        fprintf(file, "Warning 9: You didn't specify the job quality, the values were calculated with the default of 3 (balanced).\n\n");
+        Append(report, "Warning 9: You didn't specify the job quality, the values were calculated with the default of 3 (balanced).\n\n");
         break;
     
     case 10:
-        fprintf(file, "Warning 10: You didn't enter a valid job quality (finish 1 - 5 speed), the values were calculated with the default of 3 (balanced).\n\n");
+        Append(report, "Warning 10: You didn't enter a valid job quality (finish 1 - 5 speed), the values were calculated with the default of 3 (balanced).\n\n");
         break;
     
     case 14:
-        fprintf(file, "Warning 14: You didn't specify the units you want the results to be displayed, the feedrate was calculated in mm/m.\n\n");
+        Append(report, "Warning 14: You didn't specify the units you want the results to be displayed, the feedrate was calculated in mm/m.\n\n");
         break;
     
     case 15:
-        fprintf(file, "Warning 15: BE CAREFUL!!! The feed is too high for the machine. You should get a tool with fewer cutting edges, smaller diameter, or even both.\n");
-        fprintf(file, "Still if you know what you are doing you could try to run the machine at its minimum feed for its maximum feedrate of %d mm/m @%d rpm\n\n", CNCMAXFEED, CNCMINSPEED);
+        Append(report, "Warning 15: BE CAREFUL!!! The feed is too high for the machine. You should get a tool with fewer cutting edges, smaller diameter, or even both.\n");
+        Append(report, "Still if you know what you are doing you could try to run the machine at its minimum feed for its maximum feedrate of %d mm/m @%d rpm\n\n", machine.max_feed, machine.min_speed);
+        break;
+
+    case 16:
+        Append(report, "Warning 16: The tool diameter is outside the diameters of the chipload table for this material, the chipload of the nearest\n diameter was used. Check it against the tool manufacturer's recommendations before machining!\n\n");
+        break;
+
+    case 17:
+        Append(report, "Warning 17: The specific cutting energy of this material isn't known, so the feeds weren't checked against the spindle power.\n Make sure the spindle can take the cut before machining!\n\n");
+        break;
+
+    case 18:
+        Append(report, "Warning 18: BE CAREFUL!!! The cut needs more power than the spindle gives at these feeds. Reduce the depth of cut or the stepover\n before machining, a faster feed or speed won't help.\n\n");
         break;
 
     default:
-        fprintf(file, "WARNING DEFAULT: UNKNOWN WARNING :(\n\n");
+        Append(report, "WARNING DEFAULT: UNKNOWN WARNING :(\n\n");
         break;
     }
-
-    // Close the file
-    fclose(file);
 }
 
 
 /**
- * WriteResultsToFile: writes the calculation results to a file, including details about the tool, material, speed, and generated results.
+ * WriteResultsToFile: writes the calculation results to a report, including details about the tool, material, speed, and generated results.
+ * CSV and JSON lines reports get one row with the results, without the checklist nor the materials list.
  * 
  * Parameters:
- * @param filename: The name of the file to write the results to.
+ * @param report: The report to write the results to.
  * @param material: The material being cut.
  * @param tool_diameter: The diameter of the cutting tool.
  * @param tool_unit: The unit of the tool diameter.
@@ -160,19 +321,48 @@ void WarningMessage(const std::string &filename, int warning) {
  * @param results: The calculated feedrate and RPM.
  * @param feed_rate: The feed rate value.
  * @param out_unit: The unit for the output feed rate.
+ * @param limits: The constraints that limit the feeds (see DescribeLimits), empty if none.
  * @param materials_list: Array containing the list of materials.
  * @param checklist: A flag indicating whether to include a checklist in the results.
  * @param supported_materials_list: A flag indicating whether to include a list of supported materials.
  * 
  * Returns:
- * @return true if the results were successfully written to the file, false otherwise.
+ * @return true if the results were successfully written to the report, false otherwise.
  */
-bool WriteResultsToFile(const std::string &filename, const std::string &material, float tool_diameter, const std::string &tool_unit, int tool_teeth, float speed, Point results, float feed_rate, const std::string &out_unit, const std::vector<std::string> &materials_list, bool checklist, bool supported_materials_list) {
-    FILE *file = fopen(filename.c_str(), "a");      // open file in append mode
-    if (file == nullptr) {                        // handles case where file can't be accessed
-        std::cerr << "Error opening file " << filename << std::endl; 
+bool WriteResultsToFile(Report &report, const std::string &material, float tool_diameter, const std::string &tool_unit, int tool_teeth, float speed, Point results, float feed_rate, const std::string &out_unit, const std::string &limits, const std::vector<std::string> &materials_list, bool checklist, bool supported_materials_list) {
+    StageTimer timer(STAGE_WRITE);
+    if (report.file == nullptr) {                 // handles case where the file couldn't be opened
         return false;
     }
+    size_t start = report.written + report.buffer.size(); // to count the bytes written
+
+    if (report.format != REPORT_TEXT) {
+        // Structured row: job, type, code, material, tool diameter and unit, flutes, quality, rpm, feed in mm/m and in out_unit, limits
+        if (report.format == REPORT_CSV) {
+            Append(report, "%u,result,0,", report.job);
+            AppendField(report, material);
+            Append(report, ",,%g,", tool_diameter);
+            AppendField(report, tool_unit);
+            Append(report, ",%d,%g,%d,%d,%.1f,", tool_teeth, speed, results.x, results.y, feed_rate);
+            AppendField(report, out_unit);
+            report.buffer += ',';
+            AppendField(report, limits);
+            report.buffer += '\n';
+        } else {
+            Append(report, "{\"job\":%u,\"type\":\"result\",\"material\":", report.job);
+            AppendField(report, material);
+            Append(report, ",\"tool_diameter\":%g,\"tool_unit\":", tool_diameter);
+            AppendField(report, tool_unit);
+            Append(report, ",\"flutes\":%d,\"quality\":%g,\"rpm\":%d,\"feed_mm_per_min\":%d,\"feedrate\":%.1f,\"out_unit\":",
+                   tool_teeth, speed, results.x, results.y, feed_rate);
+            AppendField(report, out_unit);
+            report.buffer += ",\"limits\":";
+            AppendField(report, limits);
+            report.buffer += "}\n";
+        }
+        CountMetric(METRIC_BYTES_WRITTEN, report.written + report.buffer.size() - start);
+        return report.buffer.size() < REPORT_BUFFER || FlushReport(report);
+    }
 
     // Initialize variable to print depth of cut
     float depth_of_cut = tool_diameter / 2;
@@ -180,56 +370,100 @@ bool WriteResultsToFile(const std::string &filename, const std::string &material
     // TODO: write logic to display depth of cut in inches if the tool is in inches
 
     // Write the results to the file
-    fprintf(file, "\n\n====================================================================================\n");
-    fprintf(file, "                      NEW TOOL: %.2f %s (%i flutes) for %s\n", tool_diameter, tool_unit.c_str(), tool_teeth, material.c_str());
-    fprintf(file, "====================================================================================\n\n");
-    fprintf(file, "Parameters optimized for quality/speed value of %.1f:\n", speed);
-    fprintf(file, "Feedrate: %.1f %s\n", feed_rate, out_unit.c_str());
-    fprintf(file, "RPM:      %i rpm\n\n", results.x);
-    fprintf(file, "Remember that this is a good starting point, first you should try testing it in a\n");
-    fprintf(file, "small piece of %s and note how it goes. Adjust it as needed or try to get\n", material.c_str());
-    fprintf(file, "different values by changing the job speed/finish (or other parameters). When testing\n");
+    Append(report, "\n\n====================================================================================\n");
+    Append(report, "                      NEW TOOL: %.2f %s (%i flutes) for %s\n", tool_diameter, tool_unit.c_str(), tool_teeth, material.c_str());
+    Append(report, "====================================================================================\n\n");
+    Append(report, "Parameters optimized for quality/speed value of %.1f:\n", speed);
+    Append(report, "Feedrate: %.1f %s\n", feed_rate, out_unit.c_str());
+    Append(report, "RPM:      %i rpm\n", results.x);
+    if (!limits.empty()) {
+        Append(report, "Limited by: %s\n", limits.c_str());
+    }
+    Append(report, "\n");
+    Append(report, "Remember that this is a good starting point, first you should try testing it in a\n");
+    Append(report, "small piece of %s and note how it goes. Adjust it as needed or try to get\n", material.c_str());
+    Append(report, "different values by changing the job speed/finish (or other parameters). When testing\n");
     // TODO: write logic depth of cut in metals and very hard or gummy materials
-    fprintf(file, "start with a relatively low depth of cut of %.2f %s and increment it until a max of\n", depth_of_cut, tool_unit.c_str());
-    fprintf(file, "%.2f %s. If dealing with metals like aluminum or steel don't go above %.2f %s.\n\n\n", tool_diameter, tool_unit.c_str(), depth_of_cut, tool_unit.c_str());
+    Append(report, "start with a relatively low depth of cut of %.2f %s and increment it until a max of\n", depth_of_cut, tool_unit.c_str());
+    Append(report, "%.2f %s. If dealing with metals like aluminum or steel don't go above %.2f %s.\n\n\n", tool_diameter, tool_unit.c_str(), depth_of_cut, tool_unit.c_str());
     // Print checklist if user specifies it
     if (checklist) {
-        fprintf(file, "=========\n");
-        fprintf(file, "CHECKLIST\n");
-        fprintf(file, "=========\n\n");
-        fprintf(file, "□ Go over CAD model and check dimensions.\n");
-        fprintf(file, "□ Go over CAD model and check what is the smallest path width in the design (should be equal or more than the tool diameter being used).\n");
-        fprintf(file, "□ Go over the tool paths and check if all the parameters are correct.\n");
-        fprintf(file, "□ Does the reference point and stock material in CAD correctly match the machine setup?\n");
-        fprintf(file, "□ Is the stock material firmly secured in place?\n");
-        fprintf(file, "□ Is any of the fixing hardware in the way of the toolpath?\n");
-        fprintf(file, "□ Is the CNC correctly homed?\n");
-        fprintf(file, "□ Is the CNC tool correctly fixed?\n");
-        fprintf(file, "□ Is the CNC tool length measured?\n");
-        fprintf(file, "□ Is the CNC zero point correctly setup matching the CAD reference point for the toolpaths?\n");
-        fprintf(file, "□ Observe from a safe place, if possible, the machine running, take notes of what you see\n");
-        fprintf(file, "□ Observe the machined piece, take notes\n");
-        fprintf(file, "□ If you observed something out of the ordinary or the results were unsatisfactory, collect your notes, search for possible solutions and/or ask for help\n\n\n");
+        Append(report, "=========\n");
+        Append(report, "CHECKLIST\n");
+        Append(report, "=========\n\n");
+        Append(report, "□ Go over CAD model and check dimensions.\n");
+        Append(report, "□ Go over CAD model and check what is the smallest path width in the design (should be equal or more than the tool diameter being used).\n");
+        Append(report, "□ Go over the tool paths and check if all the parameters are correct.\n");
+        Append(report, "□ Does the reference point and stock material in CAD correctly match the machine setup?\n");
+        Append(report, "□ Is the stock material firmly secured in place?\n");
+        Append(report, "□ Is any of the fixing hardware in the way of the toolpath?\n");
+        Append(report, "□ Is the CNC correctly homed?\n");
+        Append(report, "□ Is the CNC tool correctly fixed?\n");
+        Append(report, "□ Is the CNC tool length measured?\n");
+        Append(report, "□ Is the CNC zero point correctly setup matching the CAD reference point for the toolpaths?\n");
+        Append(report, "□ Observe from a safe place, if possible, the machine running, take notes of what you see\n");
+        Append(report, "□ Observe the machined piece, take notes\n");
+        Append(report, "□ If you observed something out of the ordinary or the results were unsatisfactory, collect your notes, search for possible solutions and/or ask for help\n\n\n");
     }
 
     // Print materials list if user specifies it
     if (supported_materials_list) {
-        fprintf(file, "===================\n");
-        fprintf(file, "%u Materials Supported:\n", unique_materials_count);
-        fprintf(file, "===================\n\n");
+        Append(report, "===================\n");
+        Append(report, "%u Materials Supported:\n", unique_materials_count);
+        Append(report, "===================\n\n");
 
         for (const auto &mat : materials_list) {
-            fprintf(file, "%s\n", mat.c_str());
+            Append(report, "%s\n", mat.c_str());
         }
         
-        fprintf(file, "\n");
+        Append(report, "\n");
     }
 
-    fprintf(file, "=======================================================================================\n\n\n");
-    
-    // Close the file
-    fclose(file);
+    Append(report, "=======================================================================================\n\n\n");
+    CountMetric(METRIC_BYTES_WRITTEN, report.written + report.buffer.size() - start);
 
     // Return
-    return true;
+    return report.buffer.size() < REPORT_BUFFER || FlushReport(report);
+}
+
+
+
+/**
+ * WriteSuggestions: writes the closest materials to the one the user entered, if it wasn't an exact match.
+ * CSV and JSON lines reports get one suggestion row per material, with its distance.
+ * 
+ * Parameters:
+ * @param report: The report to write the suggestions to.
+ * @param material: The material as entered by the user.
+ * @param result: The job result holding the suggestions (see FuzzyMatches).
+ * @param materials_list: The materials the suggestions refer to.
+ * 
+ * Returns:
+ * @return This function does not return a value.
+ */
+void WriteSuggestions(Report &report, const std::string &material, const JobResult &result, const std::vector<std::string> &materials_list) {
+    if (result.suggestions.empty() || result.suggestions[0].distance == 0) {
+        return; // nothing to suggest when the material was found as entered
+    }
+
+    if (report.format != REPORT_TEXT) {
+        for (const Match &match : result.suggestions) {
+            if (report.format == REPORT_CSV) {
+                Append(report, "%u,suggestion,0,", report.job);
+                AppendField(report, materials_list[match.index]);
+                Append(report, ",%d,,,,,,,,,\n", match.distance);
+            } else {
+                Append(report, "{\"job\":%u,\"type\":\"suggestion\",\"material\":", report.job);
+                AppendField(report, materials_list[match.index]);
+                Append(report, ",\"distance\":%d}\n", match.distance);
+            }
+        }
+        return;
+    }
+
+    Append(report, "We calculated for %s as there is no material called \"%s\", did you mean:\n", result.material.c_str(), material.c_str());
+    for (const Match &match : result.suggestions) {
+        Append(report, "  %s (%d edits away)\n", materials_list[match.index].c_str(), match.distance);
+    }
+    Append(report, "\n\n");
 }